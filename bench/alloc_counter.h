@@ -0,0 +1,134 @@
+#ifndef CODEGEN_BENCH_ALLOC_COUNTER_H
+#define CODEGEN_BENCH_ALLOC_COUNTER_H
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// alloc_counter.h - replaces the global allocation functions to count heap allocations of all threads.
+// The replacements are definitions, so exactly one translation unit of a program includes this header.
+
+namespace {
+
+std::atomic<std::size_t> g_allocation_count{};
+
+void *counted_allocate(std::size_t size) {
+   g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+   if (auto *ptr = std::malloc(size); ptr != nullptr)
+      return ptr;
+   throw std::bad_alloc();
+}
+
+void *counted_allocate(std::size_t size, std::align_val_t alignment) {
+   g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+   auto align = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+   if (auto *ptr = std::aligned_alloc(align, (size + align - 1) / align * align); ptr != nullptr)
+      return ptr;
+   throw std::bad_alloc();
+}
+
+// allocation_count - heap allocations made so far by all threads
+[[maybe_unused]] std::size_t allocation_count() {
+   return g_allocation_count.load(std::memory_order_relaxed);
+}
+
+}// namespace
+
+// every replaceable form is replaced, so array, over-aligned and nothrow allocations are counted too
+void *operator new(std::size_t size) {
+   return counted_allocate(size);
+}
+
+void *operator new[](std::size_t size) {
+   return counted_allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+   return counted_allocate(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+   return counted_allocate(size, alignment);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t & /*tag*/) noexcept {
+   try {
+      return counted_allocate(size);
+   } catch (const std::bad_alloc &) {
+      return nullptr;
+   }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t & /*tag*/) noexcept {
+   try {
+      return counted_allocate(size);
+   } catch (const std::bad_alloc &) {
+      return nullptr;
+   }
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t & /*tag*/) noexcept {
+   try {
+      return counted_allocate(size, alignment);
+   } catch (const std::bad_alloc &) {
+      return nullptr;
+   }
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t & /*tag*/) noexcept {
+   try {
+      return counted_allocate(size, alignment);
+   } catch (const std::bad_alloc &) {
+      return nullptr;
+   }
+}
+
+void operator delete(void *ptr) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+   std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t /*size*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t /*size*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t /*alignment*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t /*alignment*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t /*size*/, std::align_val_t /*alignment*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t /*size*/, std::align_val_t /*alignment*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t & /*tag*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t & /*tag*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t /*alignment*/, const std::nothrow_t & /*tag*/) noexcept {
+   std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t /*alignment*/, const std::nothrow_t & /*tag*/) noexcept {
+   std::free(ptr);
+}
+
+#endif//CODEGEN_BENCH_ALLOC_COUNTER_H
@@ -0,0 +1,218 @@
+#include "alloc_counter.h"
+#include "fixtures.h"
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <mb/codegen/class.h>
+#include <mb/codegen/component.h>
+#include <mb/codegen/flat.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace mb::codegen;
+using namespace mb::codegen::bench;
+
+// allocation_counter - reports heap allocations per node of the benchmarked tree
+class allocation_counter {
+   benchmark::State &m_state;
+   std::size_t m_start;
+
+ public:
+   explicit allocation_counter(benchmark::State &state) : m_state(state), m_start(allocation_count()) {}
+
+   void report(std::size_t node_count) {
+      auto allocations = allocation_count() - m_start;
+      m_state.counters["allocs/node"] = benchmark::Counter(
+              static_cast<double>(allocations) / static_cast<double>(node_count * m_state.iterations()));
+   }
+};
+
+// node_count - size of the definable as a flat tree, the unit allocations are reported per
+std::size_t node_count(const definable &def) {
+   flat_tree tree;
+   flat_builder b(tree);
+   b.set_root(def.lower_definable(b));
+   return tree.node_count();
+}
+
+void bm_writer(benchmark::State &state) {
+   auto line_count = state.range(0);
+   std::size_t bytes{};
+   for (auto _ : state) {
+      writer w;
+      w.scope("namespace bench");
+      for (int i = 0; i < line_count; ++i) {
+         w.line("int value_{} = compute({}, \"{}\");", i, i * 3, "text");
+      }
+      w.descope();
+      bytes += w.view().size();
+      benchmark::DoNotOptimize(w.view().data());
+   }
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(bm_writer)->Arg(1000)->Arg(100000);
+
+// bm_copy_shared_tree - copies share their state until modified, so this measures the shallow copy,
+// which does not depend on the depth of the tree
+void bm_copy_shared_tree(benchmark::State &state) {
+   auto def = deep_function(static_cast<int>(state.range(0)));
+   auto nodes = node_count(def);
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      auto copy = def.copy();
+      benchmark::DoNotOptimize(copy.get());
+   }
+   allocations.report(nodes);
+}
+BENCHMARK(bm_copy_shared_tree)->Arg(256);
+
+// bm_copy_deep_tree - the tree is built in a context and copied out of it,
+// so the state of every node gets cloned and the cost grows with the depth
+void bm_copy_deep_tree(benchmark::State &state) {
+   context arena;
+   auto def = [&] {
+      context::scope scope(arena);
+      return make_node<function>(deep_function(static_cast<int>(state.range(0))));
+   }();
+   auto nodes = node_count(*def);
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      auto copy = def->copy();
+      benchmark::DoNotOptimize(copy.get());
+   }
+   allocations.report(nodes);
+}
+BENCHMARK(bm_copy_deep_tree)->Arg(16)->Arg(256);
+
+void bm_class_spec_construction(benchmark::State &state) {
+   auto field_count = static_cast<int>(state.range(0));
+   auto nodes = node_count(message_class(0, field_count));
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      auto cls = message_class(0, field_count);
+      benchmark::DoNotOptimize(&cls);
+   }
+   allocations.report(nodes);
+}
+BENCHMARK(bm_class_spec_construction)->Arg(8)->Arg(128);
+
+void bm_component_write_header(benchmark::State &state) {
+   auto cmp = schema_component(static_cast<int>(state.range(0)));
+   auto nodes = cmp.lower().node_count();
+   std::size_t bytes{};
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      writer w;
+      cmp.write_header(w);
+      bytes += w.view().size();
+   }
+   allocations.report(nodes);
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(bm_component_write_header)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+void bm_component_write_source(benchmark::State &state) {
+   auto cmp = schema_component(static_cast<int>(state.range(0)));
+   auto nodes = cmp.lower().node_count();
+   std::size_t bytes{};
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      writer w;
+      cmp.write_source(w);
+      bytes += w.view().size();
+   }
+   allocations.report(nodes);
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(bm_component_write_source)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// bm_flat_lower - lowering the component into a flat tree, paid once before writing it
+void bm_flat_lower(benchmark::State &state) {
+   auto cmp = schema_component(static_cast<int>(state.range(0)));
+   std::size_t nodes{};
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      auto tree = cmp.lower();
+      nodes = tree.node_count();
+      benchmark::DoNotOptimize(tree.root());
+   }
+   allocations.report(nodes);
+}
+BENCHMARK(bm_flat_lower)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// bm_flat_write_source - the same output as bm_component_write_source written from the flat tree
+void bm_flat_write_source(benchmark::State &state) {
+   auto tree = schema_component(static_cast<int>(state.range(0))).lower();
+   std::size_t bytes{};
+   allocation_counter allocations(state);
+   for (auto _ : state) {
+      writer w;
+      tree.write_source(w);
+      bytes += w.view().size();
+   }
+   allocations.report(tree.node_count());
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(bm_flat_write_source)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// saved_tree - the lowered schema component saved to a temporary file for the lifetime of the benchmark
+class saved_tree {
+   std::filesystem::path m_path;
+
+ public:
+   explicit saved_tree(int element_count) : m_path(std::filesystem::temp_directory_path() / fmt::format("codegen_bench_{}_{}.ast", ::getpid(), element_count)) {
+      schema_component(element_count).lower().save(m_path);
+   }
+   saved_tree(const saved_tree &) = delete;
+   saved_tree &operator=(const saved_tree &) = delete;
+   ~saved_tree() {
+      std::filesystem::remove(m_path);
+   }
+
+   [[nodiscard]] const std::filesystem::path &path() const {
+      return m_path;
+   }
+};
+
+// bm_flat_rebuild_and_write - regenerating the source from the generators, what mapping a saved tree avoids
+void bm_flat_rebuild_and_write(benchmark::State &state) {
+   std::size_t bytes{};
+   for (auto _ : state) {
+      auto tree = schema_component(static_cast<int>(state.range(0))).lower();
+      writer w;
+      tree.write_source(w);
+      bytes += w.view().size();
+   }
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+}
+BENCHMARK(bm_flat_rebuild_and_write)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// bm_flat_map_and_write - writes the source from a saved tree mapped into memory, also reports the image size
+void bm_flat_map_and_write(benchmark::State &state) {
+   saved_tree saved(static_cast<int>(state.range(0)));
+   std::size_t bytes{};
+   for (auto _ : state) {
+      auto tree = flat_tree::map(saved.path());
+      writer w;
+      tree.write_source(w);
+      bytes += w.view().size();
+   }
+   state.SetBytesProcessed(static_cast<std::int64_t>(bytes));
+   state.counters["image_bytes"] = static_cast<double>(std::filesystem::file_size(saved.path()));
+}
+BENCHMARK(bm_flat_map_and_write)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// bm_flat_map - mapping and validating a saved tree without writing it
+void bm_flat_map(benchmark::State &state) {
+   saved_tree saved(static_cast<int>(state.range(0)));
+   for (auto _ : state) {
+      auto tree = flat_tree::map(saved.path());
+      benchmark::DoNotOptimize(tree.root());
+   }
+}
+BENCHMARK(bm_flat_map)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+}// namespace
+
+BENCHMARK_MAIN();
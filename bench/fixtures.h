@@ -0,0 +1,95 @@
+#ifndef CODEGEN_BENCH_FIXTURES_H
+#define CODEGEN_BENCH_FIXTURES_H
+#include <fmt/format.h>
+#include <mb/codegen/class.h>
+#include <mb/codegen/component.h>
+#include <vector>
+
+// fixtures.h - synthetic trees shaped like generated code, shared by the benchmarks
+
+namespace mb::codegen::bench {
+
+// message_class - mimics a class generated from a schema message:
+// fields with accessors, a constructor and serialization switching over the field id
+inline class_spec message_class(int index, int field_count) {
+   class_spec cls(fmt::format("message_{}", index));
+   std::vector<arg> constructor_args;
+   for (int f = 0; f < field_count; ++f) {
+      constructor_args.push_back({"int", fmt::format("field_{}", f)});
+   }
+   cls.add_public(constructor(constructor_args, [field_count](statement::collector &col) {
+      for (int f = 0; f < field_count; ++f) {
+         col << assign(fmt::format("m_field_{}", f), raw("field_{}", f));
+      }
+   }));
+   for (int f = 0; f < field_count; ++f) {
+      cls.add_private("int", fmt::format("m_field_{}", f));
+      cls.add_public(method("int", fmt::format("field_{}", f), {}, true, [f](statement::collector &col) {
+         col << return_statement(raw("m_field_{}", f));
+      }));
+      cls.add_public(method("void", fmt::format("set_field_{}", f), {{"int", "value"}}, [f](statement::collector &col) {
+         col << assign(fmt::format("m_field_{}", f), raw("value"));
+      }));
+   }
+   cls.add_public(method("void", "serialize", {{"writer &", "w"}, {"int", "id"}}, true, [field_count](statement::collector &col) {
+      switch_statement fields(raw("id"));
+      for (int f = 0; f < field_count; ++f) {
+         fields.add(raw("{}", f), [f](statement::collector &col) {
+            col << method_call(raw("w"), "write_int", raw("m_field_{}", f));
+            col << return_statement();
+         });
+      }
+      col << fields;
+   }));
+   return cls;
+}
+
+// handler_function - mimics a generated free function with nested control flow
+inline function handler_function(int index) {
+   return function("int", fmt::format("handle_{}", index), {{"int", "a"}, {"const std::vector<int> &", "values"}}, [index](statement::collector &col) {
+      col << assign("a", call("compute", raw("a"), raw("{}", index)));
+      col << ranged_for_statement("int", "value", raw("values"), [](statement::collector &col) {
+         col << if_statement(binary_operator(raw("value"), ">", raw("a")), [](statement::collector &col) {
+            col << method_call(raw("result"), "push_back", raw("value"));
+         });
+      });
+      col << return_statement(binary_operator(raw("a"), "+", call("values.size")));
+   });
+}
+
+// schema_component - element_count elements, every fourth one a message class
+inline component schema_component(int element_count) {
+   component cmp("mb::bench");
+   cmp.header_include("vector");
+   cmp.source_include_local("bench.h");
+   for (int i = 0; i < element_count; ++i) {
+      if (i % 4 == 0) {
+         cmp << message_class(i, 4);
+      } else {
+         cmp << handler_function(i);
+      }
+   }
+   return cmp;
+}
+
+inline void nest(statement::collector &col, int level, int depth) {
+   if (level == depth) {
+      col << call("leaf");
+      return;
+   }
+   col << assign(fmt::format("v_{}", level), call("step", raw("{}", level)));
+   col << if_statement(raw("v_{}", level), [level, depth](statement::collector &col) {
+      nest(col, level + 1, depth);
+   });
+}
+
+// deep_function - function with statements nested depth levels deep
+inline function deep_function(int depth) {
+   return function("void", "deep", {}, [depth](statement::collector &col) {
+      nest(col, 0, depth);
+   });
+}
+
+}// namespace mb::codegen::bench
+
+#endif//CODEGEN_BENCH_FIXTURES_H
@@ -0,0 +1,70 @@
+#include "alloc_counter.h"
+#include <chrono>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <functional>
+#include <mb/codegen/definable.h>
+
+namespace {
+
+using namespace mb::codegen;
+
+constexpr int g_default_block_count = 1000000;
+constexpr int g_repetitions = 5;
+
+struct result {
+   double seconds;
+   std::size_t allocations;
+};
+
+// run - constructs if statements whose generators capture more than fits into std::function's small buffer
+template<typename Wrap>
+result run(int block_count, Wrap wrap) {
+   result best{std::chrono::duration<double>::max().count(), 0};
+   for (int r = 0; r < g_repetitions; ++r) {
+      std::size_t total{};
+      auto allocations = allocation_count();
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < block_count; ++i) {
+         const char *name = "value";
+         int a = i, b = i + 1, c = i + 2;
+         if_statement stmt(raw("condition"), wrap([name, a, b, c, &total](statement::collector &col) {
+            total += static_cast<std::size_t>(a + b + c);
+            col << raw(name);
+         }));
+         total += stmt.copy() != nullptr;
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      allocations = allocation_count() - allocations;
+      if (elapsed.count() < best.seconds) {
+         best = result{elapsed.count(), allocations};
+      }
+      if (total == 0) {
+         std::abort();
+      }
+   }
+   return best;
+}
+
+void report(std::string_view name, int block_count, const result &res) {
+   fmt::print("{:<16} {:>8.1f} ns/block {:>8.2f} allocations/block\n", name, res.seconds * 1e9 / block_count, static_cast<double>(res.allocations) / block_count);
+}
+
+}// namespace
+
+// statement_gen_bench - construction cost of a statement block passed as std::function and as function_ref
+int main(int argc, char **argv) {
+   auto block_count = argc > 1 ? std::atoi(argv[1]) : g_default_block_count;
+
+   auto erased = run(block_count, [](auto &&gen) {
+      return std::function<void(statement::collector &)>(gen);
+   });
+   auto direct = run(block_count, [](auto &&gen) {
+      return gen;
+   });
+
+   fmt::print("{} blocks\n", block_count);
+   report("std::function", block_count, erased);
+   report("function_ref", block_count, direct);
+   return 0;
+}
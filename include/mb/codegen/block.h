@@ -0,0 +1,78 @@
+#ifndef CODEGEN_BLOCK_H
+#define CODEGEN_BLOCK_H
+#include "statement.h"
+#include "statement_stream.h"
+#include "thread_pool.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace mb::codegen {
+
+// block - statements of a function body, either built up front or generated lazily.
+// A lazy block keeps its generator and runs it only when the body is written,
+// so writing declarations alone never builds the body.
+// A streamed block writes each statement as its coroutine yields it and drops it right away,
+// so the memory needed to write it does not grow with the size of the body.
+// The fingerprint of a lazy block is its key, a block without a key has none,
+// so elements containing it are never served from a render cache.
+class block {
+ public:
+   using lazy_generator = std::function<void(statement::collector &)>;
+   using stream_generator = std::function<statement_stream()>;
+
+   enum class memoization {
+      regenerate,// runs the generator on every write, the statements live in a scratch context
+      memoize,   // runs the generator once and keeps the statements
+   };
+
+ private:
+   struct lazy_state {
+      lazy_generator generator;
+      stream_generator stream;
+      memoization mode;
+      mb::u64 key;
+      std::once_flag generated;
+      node_vector<statement::ptr> statements;
+
+      lazy_state(lazy_generator generator, memoization mode, mb::u64 key);
+   };
+
+   node_vector<statement::ptr> m_statements;
+   std::shared_ptr<lazy_state> m_lazy;
+
+   static const node_vector<statement::ptr> &memoized(lazy_state &state);
+
+ public:
+   block() = default;
+   explicit block(node_vector<statement::ptr> statements);
+   explicit block(statement::generator statement_gen);
+   block(const block &other);
+   block(block &&other) noexcept = default;
+   block &operator=(const block &other);
+   block &operator=(block &&other) noexcept = default;
+
+   // lazy - the generator is copied into the block, so it has to own everything it captures.
+   // key - hash of everything the generator reads, blocks with equal keys have to generate equal statements
+   [[nodiscard]] static block lazy(lazy_generator generator, memoization mode = memoization::regenerate, mb::u64 key = fingerprint_none);
+   // stream - the coroutine is started anew on every write, the statements are allocated on the heap
+   [[nodiscard]] static block stream(stream_generator generator, mb::u64 key = fingerprint_none);
+
+   [[nodiscard]] bool is_lazy() const;
+
+   // statements - generates lazy blocks on first use and keeps the result
+   [[nodiscard]] const node_vector<statement::ptr> &statements() const;
+
+   // prepare - schedules the generator of a memoized lazy block on the pool,
+   // the generator has to be safe to run on another thread concurrently with other generators
+   void prepare(task_group &tasks) const;
+
+   // fingerprint - hash of the statements, or of the key of a lazy block, which is never generated for it
+   [[nodiscard]] mb::u64 fingerprint() const;
+
+   void write(writer &w) const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_BLOCK_H
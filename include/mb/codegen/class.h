@@ -5,17 +5,17 @@
 namespace mb::codegen {
 
 struct attribute {
-   std::string type;
-   std::string name;
+   symbol type;
+   symbol name;
    bool default_constr{};
 
    attribute() = default;
-   attribute(std::string type, std::string name, bool default_const = true);
+   attribute(std::string_view type, std::string_view name, bool default_const = true);
 };
 
 class class_member {
  public:
-   using ptr = std::unique_ptr<class_member>;
+   using ptr = node_ptr<class_member>;
 
    virtual ~class_member() noexcept = default;
 
@@ -23,133 +23,221 @@ class class_member {
    virtual void write_definition(writer &w) const = 0;
    virtual void set_class_name(std::string class_name) = 0;
    [[nodiscard]] virtual ptr copy() const = 0;
+   // lower_member - appends the member to a flat tree, by default as a foreign node
+   [[nodiscard]] virtual flat_index lower_member(flat_builder &b) const;
+   // fingerprint - stable structural hash of the node, equal nodes render equally.
+   // Nodes of the library keep it in their state, by default it is the hash of the rendered text.
+   [[nodiscard]] virtual mb::u64 fingerprint() const;
+   // prepare - schedules generation of lazy memoized bodies, by default there are none
+   virtual void prepare(task_group &tasks) const;
 };
 
 class class_spec : public definable {
-   std::string m_name;
-   std::vector<class_member::ptr> m_public_members;
-   std::vector<class_member::ptr> m_private_members;
-   std::vector<attribute> m_public_attributes;
-   std::vector<attribute> m_private_attributes;
-   std::string m_class_constant;
+   struct state {
+      symbol name;
+      node_vector<class_member::ptr> public_members;
+      node_vector<class_member::ptr> private_members;
+      node_vector<attribute> public_attributes;
+      node_vector<attribute> private_attributes;
+      node_string class_constant;
+
+      state(std::string_view name, std::string_view constant);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    explicit class_spec(std::string name);
    explicit class_spec(std::string name, std::string constant);
-   class_spec(const class_spec &other);
 
    void add_public(const class_member &member);
    void add_private(const class_member &member);
+   void add_public(class_member::ptr member);
+   void add_private(class_member::ptr member);
+   template<node_source<class_member> M>
+   void add_public(M &&member) {
+      add_public(take_node<class_member>(std::forward<M>(member)));
+   }
+   template<node_source<class_member> M>
+   void add_private(M &&member) {
+      add_private(take_node<class_member>(std::forward<M>(member)));
+   }
    void add_public(std::string_view type, std::string_view name, bool default_value = true);
    void add_private(std::string_view type, std::string_view name, bool default_value = true);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_definable(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 class method : public class_member {
  private:
-   std::string m_return_type;
-   std::string m_class_name;
-   std::string m_name;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
-   bool m_const{};
+   struct state {
+      symbol return_type;
+      symbol class_name;
+      symbol name;
+      node_vector<arg> arguments;
+      block body;
+      bool is_const{};
+
+      state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, bool constant, block body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, bool constant, std::function<void(statement::collector &)> statement_gen);
-   method(const method &other);
+   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, statement::generator statement_gen);
+   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, bool constant, statement::generator statement_gen);
+   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body);
+   method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, bool constant, block body);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 class method_template : public class_member {
  private:
-   std::string m_return_type;
-   std::string m_name;
-   std::vector<arg> m_template_arguments;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
-   bool m_const{};
+   struct state {
+      symbol return_type;
+      symbol name;
+      node_vector<arg> template_arguments;
+      node_vector<arg> arguments;
+      node_vector<statement::ptr> statements;
+      bool is_const{};
+
+      state(std::string_view return_type, std::string_view name, const std::vector<arg> &template_arguments, const std::vector<arg> &arguments, bool constant, node_vector<statement::ptr> statements);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   method_template(std::string_view return_type, std::string_view name, std::vector<arg> template_arguments, std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   method_template(std::string_view return_type, std::string_view name, std::vector<arg> template_arguments, std::vector<arg> arguments, bool constant, std::function<void(statement::collector &)> statement_gen);
-   method_template(const method_template &other);
+   method_template(std::string_view return_type, std::string_view name, std::vector<arg> template_arguments, std::vector<arg> arguments, statement::generator statement_gen);
+   method_template(std::string_view return_type, std::string_view name, std::vector<arg> template_arguments, std::vector<arg> arguments, bool constant, statement::generator statement_gen);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class static_method : public class_member {
  private:
-   std::string m_return_type;
-   std::string m_class_name;
-   std::string m_name;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
+   struct state {
+      symbol return_type;
+      symbol class_name;
+      symbol name;
+      node_vector<arg> arguments;
+      block body;
+
+      state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, block body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   static_method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   static_method(const static_method &other);
+   static_method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, statement::generator statement_gen);
+   static_method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 class default_constructor : public class_member {
-   std::string m_class_name;
+   struct state {
+      symbol class_name;
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   default_constructor() = default;
-   default_constructor(const default_constructor &other);
+   default_constructor();
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class constructor : public class_member {
  private:
-   std::string m_class_name;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
+   struct state {
+      symbol class_name;
+      node_vector<arg> arguments;
+      block body;
+
+      state(const std::vector<arg> &arguments, block body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   constructor(std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   constructor(const constructor &other);
+   constructor(std::vector<arg> arguments, statement::generator statement_gen);
+   constructor(std::vector<arg> arguments, block body);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 class static_attribute : public class_member {
  private:
-   std::string m_class_name;
-   std::string m_type;
-   std::string m_name;
-   expression::ptr m_value;
+   struct state {
+      symbol class_name;
+      symbol type;
+      symbol name;
+      expression::ptr value;
+
+      state(std::string_view type, std::string_view name, expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    static_attribute(std::string_view type, std::string_view name, const expression &value);
-   static_attribute(const static_attribute &other);
+   static_attribute(std::string_view type, std::string_view name, expression::ptr value);
+   template<node_source<expression> E>
+   static_attribute(std::string_view type, std::string_view name, E &&value) : static_attribute(type, name, take_node<expression>(std::forward<E>(value))) {}
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    void set_class_name(std::string class_name) override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_member(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 }// namespace mb::codegen
@@ -1,6 +1,9 @@
 #ifndef CODEGEN_COMPONENT_H
 #define CODEGEN_COMPONENT_H
 #include "definable.h"
+#include "file.h"
+#include "render_cache.h"
+#include "thread_pool.h"
 #include <set>
 #include <string>
 #include <string_view>
@@ -8,10 +11,10 @@
 namespace mb::codegen {
 
 struct include {
-   std::string path;
+   node_string path;
    bool local{false};
 
-   include(std::string_view path, bool local) : path{std::string{path}},
+   include(std::string_view path, bool local) : path{path},
                                                 local{local} {
    }
 
@@ -24,12 +27,18 @@ struct include {
    }
 };
 
+using include_set = std::set<include, std::less<>, node_allocator<include>>;
+
 class component {
-   std::string m_namespace;
-   std::string m_header_constant;
-   std::set<include> m_header_includes;
-   std::set<include> m_source_includes;
-   std::vector<definable::ptr> m_elements;
+   node_string m_namespace;
+   node_string m_header_constant;
+   include_set m_header_includes;
+   include_set m_source_includes;
+   node_vector<definable::ptr> m_elements;
+   writer_style m_style;
+
+   void write_header(writer &w, thread_pool *pool);
+   void write_source(writer &w, thread_pool *pool);
 
  public:
    explicit component(std::string ns);
@@ -40,10 +49,90 @@ class component {
    void header_include(const std::string &inc);
    void header_include_local(const std::string &inc);
 
+   // set_style - style of the writers the component creates itself, writers passed in keep their own
+   void set_style(const writer_style &style);
+   [[nodiscard]] const writer_style &style() const;
+
    void operator<<(const definable &def);
+   void operator<<(definable::ptr def);
+   template<node_source<definable> D>
+      requires(!std::is_reference_v<D>)
+   void operator<<(D &&def) {
+      *this << take_node<definable>(std::move(def));
+   }
 
    void write_header(std::ostream &stream);
    void write_source(std::ostream &stream);
+   void write_header(writer &w);
+   void write_source(writer &w);
+
+   // prepare - generates lazy memoized bodies of all elements on the pool and waits for them
+   void prepare(thread_pool &pool) const;
+
+   // write_* - parallel build mode, bodies are generated and elements rendered on the pool
+   // into separate buffers which are then joined in order, so the output is identical to the serial one.
+   // Generators of lazy bodies may run on any thread concurrently with each other,
+   // they must not share unsynchronized state. Nodes must not be modified until the call returns.
+   void write_header(writer &w, thread_pool &pool);
+   void write_source(writer &w, thread_pool &pool);
+
+   // write_*_file - renders in memory and replaces the file only if the contents differ,
+   // returns true if the file has been written
+   bool write_header_file(const std::filesystem::path &path);
+   bool write_source_file(const std::filesystem::path &path);
+   output_report write_files(const std::filesystem::path &header_path, const std::filesystem::path &source_path);
+
+   // write - incremental mode, elements whose fingerprint is in the cache are copied from it
+   // instead of being rendered, rendered elements are added to the cache.
+   // Fingerprints are kept by the nodes, so a cached element is never walked.
+   // Writers emitting origins and elements without a fingerprint bypass the cache.
+   void write(writer &header, writer &source, render_cache &cache);
+   output_report write_files(const std::filesystem::path &header_path, const std::filesystem::path &source_path, render_cache &cache);
+
+   // lower - converts the component into a flat tree rooted at the component,
+   // foreign nodes in the tree reference nodes of this component
+   [[nodiscard]] flat_tree lower() const;
+
+   // measure - bytes, lines, statements and templates emitted with the component style for every element and class member,
+   // elements over the budget are flagged
+   [[nodiscard]] size_report measure(const size_budget &budget = {}) const;
+};
+
+// streaming_component - writes every element into the header and source writers as soon as it is added
+// and keeps nothing of it, so with writers flushing into sinks memory is bounded by the largest element.
+// Includes have to be added before the first element, finish closes the namespace and the header guard.
+// The destructor finishes a component that has not been finished, call finish explicitly to handle errors.
+// The output is the same as the one of a component with the same elements.
+class streaming_component {
+   writer &m_header;
+   writer &m_source;
+   node_string m_namespace;
+   node_string m_header_constant;
+   include_set m_header_includes;
+   include_set m_source_includes;
+   bool m_started{false};
+   bool m_finished{false};
+
+   void start();
+   include_set &includes(include_set &set);
+
+ public:
+   streaming_component(writer &header, writer &source, std::string ns);
+   streaming_component(writer &header, writer &source, std::string ns, std::string header_constant);
+   streaming_component(const streaming_component &other) = delete;
+   streaming_component &operator=(const streaming_component &other) = delete;
+   ~streaming_component() noexcept;
+
+   void source_include(const std::string &inc);
+   void source_include_local(const std::string &inc);
+   void header_include(const std::string &inc);
+   void header_include_local(const std::string &inc);
+
+   // operator<< - writes the element right away, an owned element is released afterwards
+   void operator<<(const definable &def);
+   void operator<<(definable::ptr def);
+
+   void finish();
 };
 
 }// namespace mb::codegen
@@ -0,0 +1,65 @@
+#ifndef CODEGEN_COMPONENT_BUILDER_H
+#define CODEGEN_COMPONENT_BUILDER_H
+#include "component.h"
+#include <deque>
+#include <mb/int.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mb::codegen {
+
+// component_builder - fills one component from many producer threads.
+// Every producer takes its own shard once and appends to it without any locking,
+// merge_into then orders the elements of all shards by the key given with each element,
+// so the result does not depend on which thread produced what or when.
+// Elements are ordered by sequence number, then sort key, elements with equal keys by their fingerprint,
+// elements without a fingerprint (such as lazy bodies without a key) by the order their shards were made
+// in and then the order they were added, so such ties are only stable if the shards are made in a fixed order.
+// Nodes copied into a shard are allocated on the heap, owned nodes moved in must outlive the merge.
+class component_builder {
+ public:
+   class shard {
+      friend class component_builder;
+
+      struct element {
+         mb::u64 sequence;
+         std::string sort_key;
+         definable::ptr def;
+      };
+
+      std::vector<element> m_elements;
+      std::vector<include> m_header_includes;
+      std::vector<include> m_source_includes;
+
+      void add(mb::u64 sequence, std::string_view sort_key, definable::ptr def);
+
+    public:
+      void add(mb::u64 sequence, const definable &def);
+      void add(mb::u64 sequence, definable::ptr def);
+      void add(std::string_view sort_key, const definable &def);
+      void add(std::string_view sort_key, definable::ptr def);
+
+      void source_include(const std::string &inc);
+      void source_include_local(const std::string &inc);
+      void header_include(const std::string &inc);
+      void header_include_local(const std::string &inc);
+   };
+
+ private:
+   std::mutex m_mutex;
+   std::deque<shard> m_shards;
+
+ public:
+   // make_shard - the only call synchronized between threads, a shard must only be used by one thread
+   [[nodiscard]] shard &make_shard();
+
+   // merge_into - moves the contents of all shards into the component,
+   // must not be called while producers are still adding
+   void merge_into(component &cmp);
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_COMPONENT_BUILDER_H
@@ -0,0 +1,145 @@
+#ifndef CODEGEN_CONTEXT_H
+#define CODEGEN_CONTEXT_H
+#include "instrument.h"
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mb::codegen {
+
+// node_deleter - deletes heap allocated nodes, nodes allocated in a context are destructed by the context
+struct node_deleter {
+   bool in_context{false};
+
+   constexpr node_deleter() noexcept = default;
+   constexpr explicit node_deleter(bool in_context) noexcept : in_context(in_context) {}
+   template<typename T>
+   constexpr node_deleter(const std::default_delete<T> & /*other*/) noexcept {}
+
+   template<typename T>
+   void operator()(T *node) const noexcept {
+      if (!in_context) {
+         delete node;
+      }
+   }
+};
+
+template<typename T>
+using node_ptr = std::unique_ptr<T, node_deleter>;
+
+// context - monotonic arena for nodes, their strings and child arrays.
+// Nodes allocated in the context are destructed in reverse order of construction when the context is dropped,
+// so whatever they hold outside of it (such as lazy bodies) is released, the memory is released all at once.
+// Nothing built inside may outlive the context.
+// Nodes built outside of the context should be passed by reference (copied), not moved in.
+// A context must only be used by one thread at a time.
+class context {
+   // destructor - record of a node to destruct, kept in the arena next to the node
+   struct destructor {
+      void (*destroy)(void *object) noexcept;
+      void *object;
+      destructor *next;
+   };
+
+   std::pmr::monotonic_buffer_resource m_resource;
+   destructor *m_destructors = nullptr;
+   inline static thread_local context *s_current = nullptr;
+
+ public:
+   static constexpr std::size_t default_block_size = 64 * 1024;
+
+   context();
+   explicit context(std::size_t initial_size);
+   context(const context &other) = delete;
+   context &operator=(const context &other) = delete;
+   ~context() noexcept;
+
+   // scope - makes node allocations of the current thread go into the context
+   class scope {
+      context *m_previous;
+
+    public:
+      explicit scope(context &ctx);
+      // scope - a null context routes allocations to the heap
+      explicit scope(context *ctx);
+      scope(const scope &other) = delete;
+      scope &operator=(const scope &other) = delete;
+      ~scope() noexcept;
+   };
+
+   // make - constructs a node in the context, the handle does not own it
+   template<typename T, typename... ARGS>
+   [[nodiscard]] node_ptr<T> make(ARGS &&...args) {
+      scope s(*this);
+      auto *memory = m_resource.allocate(sizeof(T), alignof(T));
+      auto *node = new (memory) T(std::forward<ARGS>(args)...);
+      if constexpr (!std::is_trivially_destructible_v<T>) {
+         auto *record = m_resource.allocate(sizeof(destructor), alignof(destructor));
+         m_destructors = new (record) destructor{[](void *object) noexcept { static_cast<T *>(object)->~T(); }, node, m_destructors};
+      }
+      return node_ptr<T>(node, node_deleter(true));
+   }
+
+   [[nodiscard]] std::pmr::memory_resource *resource();
+
+   [[nodiscard]] static context *current() {
+      return s_current;
+   }
+
+   [[nodiscard]] static std::pmr::memory_resource *current_resource() {
+      if (s_current == nullptr)
+         return std::pmr::new_delete_resource();
+      return &s_current->m_resource;
+   }
+};
+
+// make_node - allocates a node in the current context or on the heap if there is none
+template<typename T, typename... ARGS>
+[[nodiscard]] node_ptr<T> make_node(ARGS &&...args) {
+   instrumentation::node_allocated<T, ARGS...>();
+   if (auto *ctx = context::current(); ctx != nullptr) {
+      return ctx->make<T>(std::forward<ARGS>(args)...);
+   }
+   return node_ptr<T>(new T(std::forward<ARGS>(args)...));
+}
+
+// node_allocator - allocates from the context current at the time of construction,
+// copies of containers pick up the context current at the time of copying
+template<typename T>
+class node_allocator {
+   std::pmr::memory_resource *m_resource;
+
+   template<typename U>
+   friend class node_allocator;
+
+ public:
+   using value_type = T;
+
+   node_allocator() noexcept : m_resource(context::current_resource()) {}
+   template<typename U>
+   node_allocator(const node_allocator<U> &other) noexcept : m_resource(other.m_resource) {}
+
+   [[nodiscard]] T *allocate(std::size_t n) {
+      return static_cast<T *>(m_resource->allocate(n * sizeof(T), alignof(T)));
+   }
+
+   void deallocate(T *ptr, std::size_t n) noexcept {
+      m_resource->deallocate(ptr, n * sizeof(T), alignof(T));
+   }
+
+   [[nodiscard]] node_allocator select_on_container_copy_construction() const noexcept {
+      return node_allocator();
+   }
+
+   template<typename U>
+   bool operator==(const node_allocator<U> &other) const noexcept {
+      return m_resource == other.m_resource;
+   }
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_CONTEXT_H
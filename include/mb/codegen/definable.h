@@ -1,5 +1,6 @@
 #ifndef LIBMB_OBJECT_H
 #define LIBMB_OBJECT_H
+#include "block.h"
 #include "expression.h"
 #include "statement.h"
 #include "writer.h"
@@ -9,62 +10,138 @@ namespace mb::codegen {
 
 class definable {
  public:
-   using ptr = std::unique_ptr<definable>;
+   using ptr = node_ptr<definable>;
 
    virtual ~definable() noexcept = default;
 
    virtual void write_declaration(writer &w) const = 0;
    virtual void write_definition(writer &w) const = 0;
    [[nodiscard]] virtual definable::ptr copy() const = 0;
+   // lower_definable - appends the definable to a flat tree, by default as a foreign node
+   [[nodiscard]] virtual flat_index lower_definable(flat_builder &b) const;
+   // fingerprint - stable structural hash of the node, equal nodes render equally.
+   // Nodes of the library keep it in their state, by default it is the hash of the rendered text.
+   [[nodiscard]] virtual mb::u64 fingerprint() const;
+   // prepare - schedules generation of lazy memoized bodies, by default there are none
+   virtual void prepare(task_group &tasks) const;
 };
 
 class globalvar : public definable {
-   std::string_view m_type;
-   std::string_view m_name;
-   expression::ptr m_value;
+   struct state {
+      symbol type;
+      symbol name;
+      expression::ptr value;
+
+      state(std::string_view type, std::string_view name, expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    globalvar(std::string_view type, std::string_view name, const expression &value);
+   globalvar(std::string_view type, std::string_view name, expression::ptr value);
+   template<node_source<expression> E>
+   globalvar(std::string_view type, std::string_view name, E &&value) : globalvar(type, name, take_node<expression>(std::forward<E>(value))) {}
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    [[nodiscard]] definable::ptr copy() const override;
+   [[nodiscard]] flat_index lower_definable(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 struct arg {
-   std::string type;
-   std::string name;
+   symbol type;
+   symbol name;
    arg(std::string_view type, std::string_view name);
 };
 
 class function : public definable {
  private:
-   std::string_view m_return_type;
-   std::string_view m_name;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
+   struct state {
+      symbol return_type;
+      symbol name;
+      node_vector<arg> arguments;
+      block body;
+
+      state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, block body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   function(std::string_view return_type, std::string_view name, std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   function(const function &other);
+   function(std::string_view return_type, std::string_view name, std::vector<arg> arguments, statement::generator statement_gen);
+   function(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body);
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_definable(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 class template_arguments : public definable {
  private:
-   std::vector<arg> m_arguments;
-   std::unique_ptr<definable> m_definable;
+   struct state {
+      node_vector<arg> arguments;
+      definable::ptr inner;
+
+      state(const std::vector<arg> &arguments, definable::ptr inner);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    template_arguments(std::vector<arg> arguments, const definable &def);
-   template_arguments(const template_arguments &other);
+   template_arguments(std::vector<arg> arguments, definable::ptr def);
+   template<node_source<definable> D>
+   template_arguments(std::vector<arg> arguments, D &&def) : template_arguments(std::move(arguments), take_node<definable>(std::forward<D>(def))) {}
+
+   void write_declaration(writer &w) const override;
+   void write_definition(writer &w) const override;
+   [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_definable(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
+};
+
+// located_definable - a definable that knows the place in a schema input it was generated from,
+// the writer emits the origin as configured by writer_style::origins
+class located_definable : public definable {
+ private:
+   struct state {
+      symbol file;
+      mb::u32 line;
+      definable::ptr inner;
+
+      state(const source_origin &origin, definable::ptr inner);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
+
+ public:
+   located_definable(const source_origin &origin, const definable &def);
+   located_definable(const source_origin &origin, definable::ptr def);
+   template<node_source<definable> D>
+   located_definable(const source_origin &origin, D &&def) : located_definable(origin, take_node<definable>(std::forward<D>(def))) {}
+
+   [[nodiscard]] source_origin origin() const;
 
    void write_declaration(writer &w) const override;
    void write_definition(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_definable(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+   void prepare(task_group &tasks) const override;
 };
 
 }// namespace mb::codegen
@@ -1,5 +1,6 @@
 #ifndef LIBMB_EXPRESSION_H
 #define LIBMB_EXPRESSION_H
+#include "node.h"
 #include "writer.h"
 #include <mb/generic.h>
 #include <memory>
@@ -10,114 +11,230 @@ namespace mb::codegen {
 
 class expression {
  public:
-   using ptr = std::unique_ptr<expression>;
+   using ptr = node_ptr<expression>;
 
    virtual ~expression() noexcept = default;
 
    virtual void write_expression(writer &w) const = 0;
    [[nodiscard]] virtual expression::ptr copy() const = 0;
+   // lower_expression - appends the expression to a flat tree, by default as a foreign node
+   [[nodiscard]] virtual flat_index lower_expression(flat_builder &b) const;
+   // fingerprint - stable structural hash of the node, equal nodes render equally.
+   // Nodes of the library keep it in their state, by default it is the hash of the rendered text.
+   [[nodiscard]] virtual mb::u64 fingerprint() const;
 };
 
 class raw : public expression {
-   std::string m_contents;
+   struct state {
+      node_string contents;
+
+      state() = default;
+      explicit state(std::string_view contents);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    explicit raw(const std::string &contents);
 #if FMT_VERSION && FMT_VERSION < 80000
    template<typename... ARGS>
-   constexpr explicit raw(const std::string_view format, ARGS &&...args) : m_contents(fmt::format(format, std::forward<ARGS>(args)...)) {}
+   constexpr explicit raw(const std::string_view format, ARGS &&...args) : m_state(std::in_place) {
+      fmt::format_to(std::back_inserter(m_state.edit().contents), format, std::forward<ARGS>(args)...);
+   }
 #else
    template<typename... ARGS>
-   constexpr explicit raw(fmt::format_string<ARGS...> format, ARGS &&...args) : m_contents(fmt::format(format, std::forward<ARGS>(args)...)) {}
+   constexpr explicit raw(fmt::format_string<ARGS...> format, ARGS &&...args) : m_state(std::in_place) {
+      fmt::format_to(std::back_inserter(m_state.edit().contents), format, std::forward<ARGS>(args)...);
+   }
 #endif
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class call : public expression {
-   expression::ptr m_function_name;
-   std::vector<expression::ptr> m_arguments;
+   struct state {
+      expression::ptr function_name;
+      node_vector<expression::ptr> arguments;
+
+      state(expression::ptr function_name, node_vector<expression::ptr> arguments);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    template<typename... ARGS>
-   explicit call(const std::string &function_name, ARGS &&...args) : m_function_name(raw(function_name).copy()), m_arguments(as_vector_copy<expression::ptr, expression>(args...)) {}
+   explicit call(const std::string &function_name, ARGS &&...args) : m_state(std::in_place, make_node<raw>(function_name), take_nodes<expression>(std::forward<ARGS>(args)...)) {}
+   template<typename... ARGS>
+   explicit call(const expression &expre, ARGS &&...args) : m_state(std::in_place, expre.copy(), take_nodes<expression>(std::forward<ARGS>(args)...)) {}
    template<typename... ARGS>
-   explicit call(const expression &expre, ARGS &&...args) : m_function_name(expre.copy()), m_arguments(as_vector_copy<expression::ptr, expression>(args...)) {}
-   call(const call &other);
+   explicit call(expression::ptr expre, ARGS &&...args) : m_state(std::in_place, std::move(expre), take_nodes<expression>(std::forward<ARGS>(args)...)) {}
+   template<node_source<expression> E, typename... ARGS>
+      requires(!std::is_same_v<std::remove_cvref_t<E>, call> || sizeof...(ARGS) > 0)
+   explicit call(E &&expre, ARGS &&...args) : m_state(std::in_place, take_node<expression>(std::forward<E>(expre)), take_nodes<expression>(std::forward<ARGS>(args)...)) {}
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class method_call : public expression {
-   expression::ptr m_object;
-   std::string m_method_name;
-   std::vector<expression::ptr> m_arguments;
+   struct state {
+      expression::ptr object;
+      symbol method_name;
+      node_vector<expression::ptr> arguments;
+
+      state(expression::ptr object, std::string_view method_name, node_vector<expression::ptr> arguments);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    template<typename... ARGS>
-   method_call(const expression &object, std::string method_name, ARGS &&...args) : m_object(object.copy()), m_method_name(std::move(method_name)), m_arguments(as_vector_copy<expression::ptr, expression>(args...)) {}
-   method_call(const method_call &other);
+   method_call(const expression &object, std::string method_name, ARGS &&...args) : m_state(std::in_place, object.copy(), method_name, take_nodes<expression>(std::forward<ARGS>(args)...)) {}
+   template<typename... ARGS>
+   method_call(expression::ptr object, std::string method_name, ARGS &&...args) : m_state(std::in_place, std::move(object), method_name, take_nodes<expression>(std::forward<ARGS>(args)...)) {}
+   template<node_source<expression> E, typename... ARGS>
+   method_call(E &&object, std::string method_name, ARGS &&...args) : m_state(std::in_place, take_node<expression>(std::forward<E>(object)), method_name, take_nodes<expression>(std::forward<ARGS>(args)...)) {}
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class assign : public expression {
-   std::string m_variable;
-   expression::ptr m_value;
+   struct state {
+      symbol variable;
+      expression::ptr value;
+
+      state(std::string_view variable, expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    assign(std::string_view variable, const expression &value);
+   assign(std::string_view variable, expression::ptr value);
+   template<node_source<expression> E>
+   assign(std::string_view variable, E &&value) : assign(variable, take_node<expression>(std::forward<E>(value))) {}
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class binary_operator : public expression {
-   expression::ptr m_lhs;
-   std::string m_operator;
-   expression::ptr m_rhs;
+   struct state {
+      expression::ptr lhs;
+      symbol op;
+      expression::ptr rhs;
+
+      state(expression::ptr lhs, std::string_view op, expression::ptr rhs);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    binary_operator(const expression &lhs, std::string_view op, const expression &rhs);
+   binary_operator(expression::ptr lhs, std::string_view op, expression::ptr rhs);
+   template<node_source<expression> L, node_source<expression> R>
+   binary_operator(L &&lhs, std::string_view op, R &&rhs) : binary_operator(take_node<expression>(std::forward<L>(lhs)), op, take_node<expression>(std::forward<R>(rhs))) {}
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class items : public expression {
-   std::vector<expression::ptr> m_items;
+   struct state {
+      node_vector<expression::ptr> items;
+
+      state() = default;
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   items() = default;
-   items(const items &other);
+   items();
 
    void add(const expression &expr);
+   void add(expression::ptr expr);
+   template<node_source<expression> E>
+   void add(E &&expr) {
+      add(take_node<expression>(std::forward<E>(expr)));
+   }
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class struct_constructor : public expression {
-   std::vector<expression::ptr> m_items;
+   struct state {
+      node_vector<expression::ptr> items;
+
+      state() = default;
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   struct_constructor() = default;
-   struct_constructor(const struct_constructor &other);
+   struct_constructor();
 
    void add(const expression &expr);
+   void add(expression::ptr expr);
+   template<node_source<expression> E>
+   void add(E &&expr) {
+      add(take_node<expression>(std::forward<E>(expr)));
+   }
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
-struct deref : public expression {
-   expression::ptr m_value;
+class deref : public expression {
+   struct state {
+      expression::ptr value;
+
+      explicit state(expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
+ public:
    explicit deref(const expression &value);
+   explicit deref(expression::ptr value);
+   template<node_source<expression> E>
+   explicit deref(E &&value) : deref(take_node<expression>(std::forward<E>(value))) {}
+
+   [[nodiscard]] const expression &value() const;
 
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 }// namespace mb::codegen
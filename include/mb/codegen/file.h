@@ -0,0 +1,26 @@
+#ifndef CODEGEN_FILE_H
+#define CODEGEN_FILE_H
+#include <filesystem>
+#include <mb/int.h>
+#include <string_view>
+#include <vector>
+
+namespace mb::codegen {
+
+struct output_report {
+   std::vector<std::filesystem::path> written;
+   std::vector<std::filesystem::path> unchanged;
+
+   void add(const std::filesystem::path &path, bool was_written);
+   void merge(const output_report &other);
+};
+
+[[nodiscard]] mb::u64 content_hash(std::string_view contents);
+
+// write_if_changed - replaces the file atomically unless it already has the same contents,
+// returns true if the file has been written
+bool write_if_changed(const std::filesystem::path &path, std::string_view contents);
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_FILE_H
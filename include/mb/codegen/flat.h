@@ -0,0 +1,321 @@
+#ifndef CODEGEN_FLAT_H
+#define CODEGEN_FLAT_H
+#include "size_report.h"
+#include "symbol.h"
+#include "writer.h"
+#include <array>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mb/int.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mb::codegen {
+
+class expression;
+class statement;
+class definable;
+class class_member;
+
+using flat_index = mb::u32;
+
+constexpr flat_index flat_none = std::numeric_limits<flat_index>::max();
+
+enum class flat_kind : mb::u8 {
+   // expressions
+   raw,                  // text
+   call,                 // function, arguments
+   method_call,          // object, name, arguments
+   assign,               // variable, value
+   binary_operator,      // lhs, op, rhs
+   items,                // items
+   struct_constructor,   // items
+   deref,                // value
+   lambda,               // captures, arguments, statements
+   // statements
+   expr,                 // expression
+   if_statement,         // condition, then, else [constexpr]
+   if_switch,            // cases
+   if_case,              // condition, statements
+   switch_statement,     // value, cases, default [scoped default]
+   switch_case,          // value, statements [scoped]
+   return_statement,     // value or flat_none
+   for_statement,        // start, condition, progress, statements
+   ranged_for,           // type, name, range, statements
+   // definables
+   globalvar,            // type, name, value
+   function,             // return type, name, arguments, statements
+   template_arguments,   // arguments, definable
+   class_spec,           // name, constant, private members, public members
+   // class members
+   attribute,            // type, name [default constructed]
+   method,               // return type, class, name, arguments, statements [const]
+   method_template,      // return type, name, template arguments, arguments, statements [const]
+   static_method,        // return type, class, name, arguments, statements
+   default_constructor,  // class
+   constructor,          // class, arguments, statements
+   static_attribute,     // class, type, name, value
+   // nodes with an origin
+   located_statement,    // file, line, statement
+   located_definable,    // file, line, definable
+   // component
+   component,            // namespace, header constant, header includes, source includes, elements
+   include,              // path [local]
+   // nodes that could not be lowered, emitted through their virtual interface
+   foreign_expression,
+   foreign_statement,
+   foreign_definable,
+   foreign_member,
+};
+
+// flat_flag - kind specific bits of flat_node::flags
+namespace flat_flag {
+constexpr mb::u8 is_const = 1;
+constexpr mb::u8 is_constexpr = 1;
+constexpr mb::u8 scoped = 1;
+constexpr mb::u8 default_constr = 1;
+constexpr mb::u8 local = 1;
+}// namespace flat_flag
+
+// flat_node - a node read from its record, see flat_tree
+struct flat_node {
+   flat_kind kind;
+   mb::u8 flags;
+   const flat_index *operands;
+};
+
+struct flat_text {
+   mb::u32 offset;
+   mb::u32 size;
+};
+
+// render_memo - rendered text of expression and statement subtrees within a run,
+// keyed by the structural hash of the subtree, the indentation and the style it was written with,
+// so a memo can be shared by writers of different styles.
+// Only flat_tree consults the memo: a flat tree written into a writer with a memo copies the text
+// of a repeated subtree instead of walking it again, nodes written through write_expression
+// and write_statement are always rendered. Only subtrees of at least min_nodes nodes are memoized,
+// smaller ones are cheaper to render than to look up. With a column limit only statements are memoized,
+// expressions are laid out together with the rest of their line.
+class render_memo {
+   struct key {
+      mb::u64 hash;
+      mb::u32 indent;
+      writer_style style;
+
+      bool operator==(const key &other) const = default;
+   };
+
+   struct key_hash {
+      std::size_t operator()(const key &k) const noexcept {
+         return static_cast<std::size_t>(k.hash ^ (static_cast<mb::u64>(k.indent) * 0x9e3779b97f4a7c15ull));
+      }
+   };
+
+   std::unordered_map<key, std::string, key_hash> m_rendered;
+   std::size_t m_min_nodes;
+   std::size_t m_hits{};
+   std::size_t m_misses{};
+
+ public:
+   static constexpr std::size_t default_min_nodes = 8;
+
+   explicit render_memo(std::size_t min_nodes = default_min_nodes);
+
+   [[nodiscard]] std::size_t min_nodes() const;
+   [[nodiscard]] const std::string *find(mb::u64 hash, mb::u32 indent, const writer_style &style);
+   void store(mb::u64 hash, mb::u32 indent, const writer_style &style, std::string text);
+
+   [[nodiscard]] std::size_t size() const;
+   [[nodiscard]] std::size_t hits() const;
+   [[nodiscard]] std::size_t misses() const;
+};
+
+// flat_tree - data oriented form of the syntax tree.
+// Nodes are stored in pre-order as records in a single array and refer to each other by index.
+// A record is a header word holding the kind and the flags followed by as many operands as the kind has,
+// the index of a node is the offset of its record.
+// Operands are either node indices, text indices or list indices depending on the kind.
+// A list is a count followed by its elements in the children array,
+// argument lists store a type and a name text per element.
+// Foreign nodes only reference the original nodes, which have to outlive the tree.
+// A tree without foreign nodes can be saved to a file and mapped back in another process,
+// a mapped tree is read from the mapping directly.
+class flat_tree {
+   friend class flat_builder;
+
+   // storage - arrays of a tree built in memory
+   struct storage {
+      std::vector<flat_index> nodes;
+      std::vector<flat_index> children;
+      std::vector<flat_text> texts;
+      std::vector<char> text_data;
+   };
+
+   storage m_storage;
+   std::shared_ptr<const void> m_mapping;
+   // views the tree is read through, over the storage or the mapping
+   std::span<const flat_index> m_nodes;
+   std::size_t m_node_count = 0;
+   std::span<const flat_index> m_children;
+   std::span<const flat_text> m_texts;
+   std::string_view m_text_data;
+   std::vector<const expression *> m_foreign_expressions;
+   std::vector<const statement *> m_foreign_statements;
+   std::vector<const definable *> m_foreign_definables;
+   std::vector<const class_member *> m_foreign_members;
+   flat_index m_root = flat_none;
+   std::vector<mb::u64> m_hashes;
+   std::vector<mb::u32> m_sizes;
+
+   void refresh_views();
+   // check_operands - reason the first operand referring outside of the tree is invalid, empty if there is none
+   [[nodiscard]] std::string_view check_operands() const;
+   [[nodiscard]] mb::u64 compute_hash(flat_index index) const;
+   void write_node(writer &w, flat_index index, bool definition) const;
+   void render_node(writer &w, flat_index index, bool definition) const;
+   void write_nodes(writer &w, flat_index list, bool definition) const;
+   void write_separated(writer &w, flat_index list) const;
+   void write_arguments(writer &w, flat_index list) const;
+   void write_includes(writer &w, flat_index list) const;
+   void write_block(writer &w, flat_index list) const;
+   [[nodiscard]] mb::u64 hash_list(flat_index list) const;
+   [[nodiscard]] std::string size_label(flat_index index) const;
+   [[nodiscard]] std::size_t count_statements(flat_index index) const;
+   [[nodiscard]] std::size_t count_statement_list(flat_index list) const;
+   void count_emitted(code_size &size, flat_index index, bool definition) const;
+   [[nodiscard]] code_size measure_node(const writer_style &style, flat_index index, bool definition, mb::u32 indent) const;
+   void measure_entry(size_report &report, const size_budget &budget, const writer_style &style, flat_index index, std::size_t depth, mb::u32 indent, bool header_definition) const;
+
+ public:
+   // format_version - version of the file format, bumped whenever the layout or flat_kind changes
+   static constexpr mb::u32 format_version = 3;
+
+   flat_tree() = default;
+   flat_tree(const flat_tree &other) = delete;
+   flat_tree &operator=(const flat_tree &other) = delete;
+   flat_tree(flat_tree &&other) noexcept = default;
+   flat_tree &operator=(flat_tree &&other) noexcept = default;
+
+   // serialize - binary image of the tree, throws std::invalid_argument if it has foreign nodes
+   [[nodiscard]] std::string serialize() const;
+   // save - writes the image if it differs from the file, returns true if the file has been written
+   bool save(const std::filesystem::path &path) const;
+   // view - reads the tree from an image kept alive by the caller, nothing is copied
+   [[nodiscard]] static flat_tree view(std::string_view image);
+   // map - maps a saved tree into memory, the mapping lives as long as the tree
+   [[nodiscard]] static flat_tree map(const std::filesystem::path &path);
+
+   [[nodiscard]] flat_node node(flat_index index) const {
+      auto header = m_nodes[index];
+      return {static_cast<flat_kind>(header & 0xff), static_cast<mb::u8>(header >> 8), m_nodes.data() + index + 1};
+   }
+
+   [[nodiscard]] std::string_view text(flat_index index) const {
+      const auto &t = m_texts[index];
+      return {m_text_data.data() + t.offset, t.size};
+   }
+
+   [[nodiscard]] flat_index root() const {
+      return m_root;
+   }
+
+   [[nodiscard]] std::size_t node_count() const {
+      return m_node_count;
+   }
+
+   // hash - structural hash of the subtree, stable across runs and processes.
+   // Foreign nodes are hashed by their fingerprint.
+   [[nodiscard]] mb::u64 hash(flat_index index) const;
+
+   // index_hashes - computes hashes and sizes of all subtrees at once,
+   // required for the tree to use the render memo of a writer
+   void index_hashes();
+
+   void write_expression(writer &w, flat_index index) const;
+   void write_statement(writer &w, flat_index index) const;
+   void write_declaration(writer &w, flat_index index) const;
+   void write_definition(writer &w, flat_index index) const;
+
+   // write_header, write_source - emit the root component
+   void write_header(writer &w) const;
+   void write_source(writer &w) const;
+
+   // measure - sizes of the elements of the root component as write_header and write_source emit them,
+   // written with the given style, class members and definables wrapped in template_arguments
+   // are measured separately as nested entries
+   [[nodiscard]] size_report measure(const size_budget &budget = {}, const writer_style &style = {}) const;
+};
+
+// flat_builder - appends lowered nodes to a tree.
+// A node is added before its children, so operands get set once the children are lowered.
+class flat_builder {
+   flat_tree &m_tree;
+   std::unordered_map<const char *, flat_index> m_symbols;
+   std::unordered_map<std::size_t, flat_index> m_texts;
+
+ public:
+   explicit flat_builder(flat_tree &tree);
+
+   [[nodiscard]] flat_index add(flat_kind kind, mb::u8 flags = 0);
+   void set(flat_index node, std::size_t operand, flat_index value);
+   void set_root(flat_index node);
+
+   // text - every text is stored once per tree
+   [[nodiscard]] flat_index text(symbol value);
+   [[nodiscard]] flat_index text(std::string_view value);
+
+   // list - reserves a list of given size, elements are set with set_element
+   [[nodiscard]] flat_index list(std::size_t size);
+   void set_element(flat_index list, std::size_t at, flat_index value);
+
+   template<typename Container, typename F>
+   [[nodiscard]] flat_index list(const Container &elements, F lower) {
+      auto result = list(elements.size());
+      std::size_t at{};
+      for (const auto &element : elements) {
+         set_element(result, at++, lower(element));
+      }
+      return result;
+   }
+
+   template<typename Container>
+   [[nodiscard]] flat_index expressions(const Container &nodes) {
+      return list(nodes, [this](const auto &node) { return node->lower_expression(*this); });
+   }
+
+   template<typename Container>
+   [[nodiscard]] flat_index statements(const Container &nodes) {
+      return list(nodes, [this](const auto &node) { return node->lower_statement(*this); });
+   }
+
+   template<typename Container>
+   [[nodiscard]] flat_index definables(const Container &nodes) {
+      return list(nodes, [this](const auto &node) { return node->lower_definable(*this); });
+   }
+
+   template<typename Container>
+   [[nodiscard]] flat_index arguments(const Container &args) {
+      auto result = list(2 * args.size());
+      std::size_t at{};
+      for (const auto &a : args) {
+         set_element(result, at++, text(a.type));
+         set_element(result, at++, text(a.name));
+      }
+      m_tree.m_storage.children[result] = static_cast<flat_index>(args.size());
+      return result;
+   }
+
+   [[nodiscard]] flat_index foreign(const expression &expr);
+   [[nodiscard]] flat_index foreign(const statement &stmt);
+   [[nodiscard]] flat_index foreign(const definable &def);
+   [[nodiscard]] flat_index foreign(const class_member &member);
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_FLAT_H
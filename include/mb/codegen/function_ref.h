@@ -0,0 +1,52 @@
+#ifndef CODEGEN_FUNCTION_REF_H
+#define CODEGEN_FUNCTION_REF_H
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace mb::codegen {
+
+template<typename Signature>
+class function_ref;
+
+// function_ref - non-owning reference to a callable.
+// Binding it neither allocates nor copies the callable, which has to outlive the reference,
+// so it is meant for parameters that are invoked before the call returns.
+template<typename R, typename... Args>
+class function_ref<R(Args...)> {
+   // functions are not objects, so their pointers cannot round-trip through void *
+   union storage {
+      void *object;
+      void (*function)();
+   };
+
+   storage m_callable;
+   R (*m_invoke)(storage, Args...);
+
+ public:
+   template<typename F>
+      requires(!std::is_same_v<std::remove_cvref_t<F>, function_ref> && std::is_invocable_r_v<R, F &, Args...>)
+   function_ref(F &&callable) noexcept {
+      using decayed = std::decay_t<F>;
+      if constexpr (std::is_function_v<std::remove_pointer_t<decayed>>) {
+         m_callable.function = reinterpret_cast<void (*)()>(static_cast<decayed>(callable));
+         m_invoke = [](storage target, Args... args) -> R {
+            return std::invoke(reinterpret_cast<decayed>(target.function), std::forward<Args>(args)...);
+         };
+      } else {
+         m_callable.object = const_cast<void *>(static_cast<const void *>(std::addressof(callable)));
+         m_invoke = [](storage target, Args... args) -> R {
+            return std::invoke(*static_cast<std::add_pointer_t<std::remove_reference_t<F>>>(target.object), std::forward<Args>(args)...);
+         };
+      }
+   }
+
+   R operator()(Args... args) const {
+      return m_invoke(m_callable, std::forward<Args>(args)...);
+   }
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_FUNCTION_REF_H
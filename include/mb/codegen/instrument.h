@@ -0,0 +1,158 @@
+#ifndef CODEGEN_INSTRUMENT_H
+#define CODEGEN_INSTRUMENT_H
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace mb::codegen {
+
+#ifdef LIBMB_CODEGEN_INSTRUMENTATION
+inline constexpr bool instrumentation_enabled = true;
+#else
+inline constexpr bool instrumentation_enabled = false;
+#endif
+
+// node_type_name - unqualified name of a node class, taken from the compiler's function signature
+template<typename T>
+[[nodiscard]] std::string_view node_type_name() {
+   std::string_view signature = __PRETTY_FUNCTION__;
+   auto begin = signature.find("T = ");
+   if (begin == std::string_view::npos)
+      return signature;
+   begin += 4;
+   auto name = signature.substr(begin, signature.find_first_of(";]", begin) - begin);
+   if (auto ns = name.rfind("::"); ns != std::string_view::npos) {
+      name.remove_prefix(ns + 2);
+   }
+   return name;
+}
+
+// instrumentation - statistics of the generation running on a thread.
+// The hooks compile to nothing unless the library is built with LIBMB_CODEGEN_INSTRUMENTATION,
+// when it is, they record into the instrumentation made current by a scope.
+// Only the thread that opened the scope is recorded, work run on a thread pool is not.
+// Nodes are counted as they are allocated into a tree: a node moved in counts as constructed,
+// a node copied in (or copied by copy()) counts as a copy. The node allocations include the shared
+// state of nodes, other heap allocations (strings, vectors, writer buffers) are not counted.
+class instrumentation {
+ public:
+   enum class phase {
+      other,
+      generate,
+      write,
+   };
+
+   struct node_counters {
+      std::size_t constructed{};
+      std::size_t copies{};
+   };
+
+   struct definable_stats {
+      std::string label;
+      std::size_t bytes{};
+   };
+
+ private:
+   std::string m_name;
+   std::map<std::string_view, node_counters, std::less<>> m_nodes;
+   std::vector<definable_stats> m_definables;
+   std::size_t m_node_allocations{};
+   std::size_t m_node_bytes{};
+   std::array<std::chrono::nanoseconds, 3> m_times{};
+   phase m_phase = phase::other;
+   std::chrono::steady_clock::time_point m_phase_start;
+   inline static thread_local instrumentation *s_current = nullptr;
+
+   void switch_phase(phase next);
+   void count_node(std::string_view type, bool copy, std::size_t bytes);
+
+ public:
+   explicit instrumentation(std::string name = {});
+
+   // scope - makes the instrumentation record everything done on the current thread
+   class scope {
+      instrumentation *m_previous;
+
+    public:
+      explicit scope(instrumentation &target);
+      scope(const scope &other) = delete;
+      scope &operator=(const scope &other) = delete;
+      ~scope() noexcept;
+   };
+
+   // phase_scope - attributes the time spent within to a phase, time of nested phases is excluded
+   class phase_scope {
+      phase m_previous = phase::other;
+
+    public:
+      explicit phase_scope(phase p) {
+         if constexpr (instrumentation_enabled) {
+            if (s_current != nullptr) {
+               m_previous = s_current->m_phase;
+               s_current->switch_phase(p);
+            }
+         }
+      }
+      phase_scope(const phase_scope &other) = delete;
+      phase_scope &operator=(const phase_scope &other) = delete;
+      ~phase_scope() noexcept {
+         if constexpr (instrumentation_enabled) {
+            if (s_current != nullptr) {
+               s_current->switch_phase(m_previous);
+            }
+         }
+      }
+   };
+
+   [[nodiscard]] static instrumentation *current() {
+      if constexpr (instrumentation_enabled) {
+         return s_current;
+      }
+      return nullptr;
+   }
+
+   // node_allocated - hook of make_node
+   template<typename T, typename... ARGS>
+   static void node_allocated() {
+      if constexpr (instrumentation_enabled) {
+         if (s_current != nullptr) {
+            constexpr bool copy = sizeof...(ARGS) == 1 && (std::is_same_v<ARGS, const T &> && ...);
+            s_current->count_node(node_type_name<T>(), copy, sizeof(T));
+         }
+      }
+   }
+
+   // node_state_allocated - hook of the allocation of the shared state of a node
+   static void node_state_allocated(std::size_t bytes) {
+      if constexpr (instrumentation_enabled) {
+         if (s_current != nullptr) {
+            ++s_current->m_node_allocations;
+            s_current->m_node_bytes += bytes;
+         }
+      }
+   }
+
+   // definable_written - hook of component writes, label identifies the definable in the report
+   static void definable_written(std::string_view label, std::size_t bytes);
+
+   [[nodiscard]] const std::string &name() const;
+   [[nodiscard]] const std::map<std::string_view, node_counters, std::less<>> &nodes() const;
+   [[nodiscard]] const std::vector<definable_stats> &definables() const;
+   // node_allocations, node_bytes - allocations of nodes and their state, see instrumentation
+   [[nodiscard]] std::size_t node_allocations() const;
+   [[nodiscard]] std::size_t node_bytes() const;
+   [[nodiscard]] std::chrono::nanoseconds time(phase p) const;
+
+   // text, json - the report, definables are listed from the largest
+   [[nodiscard]] std::string text() const;
+   [[nodiscard]] std::string json() const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_INSTRUMENT_H
@@ -7,26 +7,35 @@
 namespace mb::codegen {
 
 class lambda : public expression {
-   std::vector<expression::ptr> m_captures;
-   std::vector<arg> m_arguments;
-   std::vector<statement::ptr> m_statements;
+   struct state {
+      node_vector<expression::ptr> captures;
+      node_vector<arg> arguments;
+      block body;
+
+      state(node_vector<expression::ptr> captures, const std::vector<arg> &arguments, block body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   lambda(std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen);
-   lambda(const lambda &other);
+   lambda(std::vector<arg> arguments, statement::generator statement_gen);
+   lambda(std::vector<arg> arguments, block body);
 
    template<typename... ARGS>
-   lambda(std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen, ARGS... captures) : m_captures(as_vector_copy<expression::ptr, expression>(captures...)),
-                                                                                                                     m_arguments(std::move(arguments)),
-                                                                                                                     m_statements([&statement_gen]() {
-                                                                                                                        statement::collector col;
-                                                                                                                        statement_gen(col);
-                                                                                                                        return col.build();
-                                                                                                                     }()) {}
+   lambda(std::vector<arg> arguments, statement::generator statement_gen, ARGS &&...captures) : m_state(std::in_place, take_nodes<expression>(std::forward<ARGS>(captures)...), arguments, block(statement_gen)) {}
 
    void add_capture(const expression &cap);
+   void add_capture(expression::ptr cap);
+   template<node_source<expression> E>
+   void add_capture(E &&cap) {
+      add_capture(take_node<expression>(std::forward<E>(cap)));
+   }
    void write_expression(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_expression(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 }// namespace mb::codegen
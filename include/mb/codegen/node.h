@@ -0,0 +1,201 @@
+#ifndef CODEGEN_NODE_H
+#define CODEGEN_NODE_H
+#include "context.h"
+#include "flat.h"
+#include "symbol.h"
+#include <atomic>
+#include <concepts>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mb::codegen {
+
+using node_string = std::basic_string<char, std::char_traits<char>, node_allocator<char>>;
+template<typename T>
+using node_vector = std::vector<T, node_allocator<T>>;
+
+// node_source - a node of given base type passed by value or reference
+template<typename T, typename Base>
+concept node_source = std::derived_from<std::remove_cvref_t<T>, Base>;
+
+// take_node - transfers a node into an owning pointer of its base type,
+// rvalues and owning pointers are moved, lvalues are copied
+template<typename Base, typename T>
+[[nodiscard]] typename Base::ptr take_node(T &&node) {
+   using type = std::remove_cvref_t<T>;
+   if constexpr (std::is_same_v<type, typename Base::ptr>) {
+      if constexpr (std::is_reference_v<T>) {
+         return node->copy();
+      } else {
+         return std::move(node);
+      }
+   } else if constexpr (!std::is_reference_v<T> && !std::is_abstract_v<type> && std::is_move_constructible_v<type>) {
+      return make_node<type>(std::move(node));
+   } else {
+      return node.copy();
+   }
+}
+
+template<typename Ptr>
+[[nodiscard]] node_vector<Ptr> copy_nodes(const node_vector<Ptr> &nodes) {
+   node_vector<Ptr> result;
+   result.reserve(nodes.size());
+   for (const auto &node : nodes) {
+      result.emplace_back(node->copy());
+   }
+   return result;
+}
+
+// fingerprint_none - fingerprint of a node whose output is not known before it is written,
+// such as a lazy body without a key, the node and every node containing it are never cached
+constexpr mb::u64 fingerprint_none = 0;
+// fingerprint_stale - marks a fingerprint of an edited state that has not been recomputed yet
+constexpr mb::u64 fingerprint_stale = 1;
+
+// structural_hash - accumulates the fingerprint of a node state from its kind, flags, texts
+// and the fingerprints of its children. Children keep their own fingerprints,
+// so hashing a state only visits its direct children.
+class structural_hash {
+   mb::u64 m_value;
+   bool m_known{true};
+
+ public:
+   // structural_hash - a sequence that is not a node of its own, such as a block
+   structural_hash();
+   explicit structural_hash(flat_kind kind, mb::u8 flags = 0);
+
+   structural_hash &number(mb::u64 value);
+   structural_hash &text(std::string_view value);
+   // fingerprint - adds the fingerprint of a child, fingerprint_none makes the whole hash unknown
+   structural_hash &fingerprint(mb::u64 value);
+
+   template<typename Node>
+   structural_hash &node(const Node &node) {
+      return fingerprint(node.fingerprint());
+   }
+
+   // optional - a child that may be absent
+   template<typename Ptr>
+   structural_hash &optional(const Ptr &node) {
+      return node == nullptr ? number(0) : fingerprint(node->fingerprint());
+   }
+
+   template<typename Container>
+   structural_hash &nodes(const Container &nodes) {
+      number(nodes.size());
+      for (const auto &node : nodes) {
+         fingerprint(node->fingerprint());
+      }
+      return *this;
+   }
+
+   template<typename Container>
+   structural_hash &arguments(const Container &args) {
+      number(args.size());
+      for (const auto &a : args) {
+         text(a.type);
+         text(a.name);
+      }
+      return *this;
+   }
+
+   // value - the fingerprint, never one of the reserved values unless it is unknown
+   [[nodiscard]] mb::u64 value() const;
+
+   operator mb::u64() const {
+      return value();
+   }
+};
+
+// cow - copy-on-write holder of node state.
+// Copies made within the same context share the state, it is cloned when a shared state
+// gets modified or when a node is copied or moved into a different context.
+// The state is kept together with its fingerprint, computed by T::fingerprint when the state is built.
+// An edit marks the fingerprint stale, it is recomputed the next time it is asked for,
+// so a run of edits costs one rehash rather than one per edit.
+template<typename T>
+class cow {
+   struct entry {
+      T state;
+      mutable std::atomic<mb::u64> fingerprint;
+
+      template<typename... ARGS>
+      explicit entry(std::in_place_t /*tag*/, ARGS &&...args) : state(std::forward<ARGS>(args)...),
+                                                                 fingerprint(state.fingerprint()) {}
+
+      entry(const entry &other) : state(other.state),
+                                  fingerprint(other.fingerprint.load(std::memory_order_relaxed)) {}
+   };
+
+   std::shared_ptr<entry> m_state;
+   context *m_context;
+
+   [[nodiscard]] static std::shared_ptr<entry> clone(const entry &state) {
+      instrumentation::node_state_allocated(sizeof(entry));
+      return std::allocate_shared<entry>(node_allocator<entry>(), state);
+   }
+
+ public:
+   template<typename... ARGS>
+   explicit cow(std::in_place_t /*tag*/, ARGS &&...args) : m_state(std::allocate_shared<entry>(node_allocator<entry>(), std::in_place, std::forward<ARGS>(args)...)),
+                                                             m_context(context::current()) {
+      instrumentation::node_state_allocated(sizeof(entry));
+   }
+
+   cow(const cow &other) : m_state(other.m_context == context::current() ? other.m_state : clone(*other.m_state)),
+                           m_context(context::current()) {}
+
+   cow(cow &&other) : m_state(other.m_context == context::current() ? std::move(other.m_state) : clone(*other.m_state)),
+                      m_context(context::current()) {}
+
+   cow &operator=(const cow &other) = delete;
+   cow &operator=(cow &&other) = delete;
+
+   const T &operator*() const {
+      return m_state->state;
+   }
+
+   const T *operator->() const {
+      return &m_state->state;
+   }
+
+   // edit - access for modification, clones the state in its own context if it is shared
+   [[nodiscard]] T &edit() {
+      if (m_state.use_count() > 1) {
+         context::scope scope(m_context);
+         m_state = clone(*m_state);
+      }
+      m_state->fingerprint.store(fingerprint_stale, std::memory_order_relaxed);
+      return m_state->state;
+   }
+
+   [[nodiscard]] bool shared() const {
+      return m_state.use_count() > 1;
+   }
+
+   // fingerprint - structural hash of the state, recomputed from the children only after an edit.
+   // Concurrent readers of a stale fingerprint compute the same value.
+   [[nodiscard]] mb::u64 fingerprint() const {
+      auto value = m_state->fingerprint.load(std::memory_order_relaxed);
+      if (value == fingerprint_stale) {
+         value = m_state->state.fingerprint();
+         m_state->fingerprint.store(value, std::memory_order_relaxed);
+      }
+      return value;
+   }
+};
+
+template<typename Base, typename... ARGS>
+[[nodiscard]] node_vector<typename Base::ptr> take_nodes(ARGS &&...args) {
+   node_vector<typename Base::ptr> result;
+   result.reserve(sizeof...(ARGS));
+   (result.emplace_back(take_node<Base>(std::forward<ARGS>(args))), ...);
+   return result;
+}
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_NODE_H
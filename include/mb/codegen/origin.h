@@ -0,0 +1,57 @@
+#ifndef CODEGEN_ORIGIN_H
+#define CODEGEN_ORIGIN_H
+#include <mb/int.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mb::codegen {
+
+// source_origin - place in a schema input that generated code comes from, an empty file means none
+struct source_origin {
+   std::string_view file;
+   mb::u32 line{};
+
+   [[nodiscard]] bool empty() const {
+      return file.empty();
+   }
+   bool operator==(const source_origin &other) const = default;
+};
+
+// source_map - origins of the generated code by the position they start at (lines and columns from 1 and 0),
+// an entry without a file ends the code of the previous origin
+class source_map {
+ public:
+   static constexpr mb::u32 no_file = ~mb::u32{};
+
+   struct entry {
+      mb::u32 line;
+      mb::u32 column;
+      mb::u32 file;
+      mb::u32 origin_line;
+   };
+
+ private:
+   std::vector<std::string> m_files;
+   std::unordered_map<std::string, mb::u32> m_file_index;
+   std::vector<entry> m_entries;
+
+ public:
+   // add - entries are added in the order of the generated code
+   void add(mb::u32 line, mb::u32 column, const source_origin &origin);
+   void clear();
+
+   [[nodiscard]] const std::vector<std::string> &files() const;
+   [[nodiscard]] const std::vector<entry> &entries() const;
+   // find - origin of the code at a generated position, empty if it has none
+   [[nodiscard]] source_origin find(mb::u32 line, mb::u32 column) const;
+
+   // text - "file <path>" lines followed by "<line>:<column> <file index>:<line>" lines,
+   // an entry without a file has "-" in place of the origin
+   [[nodiscard]] std::string text() const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_ORIGIN_H
@@ -0,0 +1,88 @@
+#ifndef CODEGEN_PROJECT_H
+#define CODEGEN_PROJECT_H
+#include "component.h"
+#include "file.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mb/int.h>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace mb::codegen {
+
+struct project_report {
+   output_report files;
+   std::size_t component_count{};
+   std::size_t file_count{};
+   std::size_t bytes{};
+   std::chrono::nanoseconds wall_time{};
+};
+
+// project_shard - selects the part of a project written by one of count processes.
+// Components are assigned by a hash of the file name of their header (without its directory),
+// so every process computes the same partition without coordination, also when the output
+// directories differ. Renaming a header may move its component to another shard.
+struct project_shard {
+   mb::u32 index{};
+   mb::u32 count{1};
+
+   // parse - reads "index/count", throws std::invalid_argument on malformed input
+   static project_shard parse(std::string_view spec);
+
+   // owns - whether the component with this header is written by the shard. Building components
+   // is usually what a shard should save, so check it before building one, or add it with project::add_lazy.
+   [[nodiscard]] bool owns(const std::filesystem::path &header_path) const;
+};
+
+// project - set of components together with the paths of their header and source files.
+// Components are written concurrently in batches, each batch renders into the writer buffer
+// of the thread it runs on and replaces only files whose contents changed.
+// Paths in the report keep the order in which the components were added,
+// so repeated runs produce the same files and the same report regardless of scheduling.
+class project {
+   struct entry {
+      std::optional<component> cmp;
+      std::function<component()> build;
+      std::filesystem::path header_path;
+      std::filesystem::path source_path;
+   };
+
+   std::deque<entry> m_entries;
+   std::size_t m_batch_size;
+
+   [[nodiscard]] std::vector<entry *> select(project_shard shard);
+
+ public:
+   static constexpr std::size_t default_batch_size = 16;
+
+   explicit project(std::size_t batch_size = default_batch_size);
+
+   // add - the returned reference stays valid as more components are added
+   component &add(component cmp, std::filesystem::path header_path, std::filesystem::path source_path);
+   // add_lazy - the component is built by every write that owns it, on the thread writing it,
+   // so a sharded write builds only the components of its shard
+   void add_lazy(std::function<component()> build, std::filesystem::path header_path, std::filesystem::path source_path);
+
+   [[nodiscard]] std::size_t size() const;
+
+   project_report write(thread_pool &pool);
+   project_report write();
+   // write - writes only the components the shard owns and builds only those added lazily,
+   // running every shard of a project produces the same files as an unsharded write
+   project_report write(project_shard shard, thread_pool &pool);
+   project_report write(project_shard shard);
+
+   // write_aggregate - header including the headers of all components in the order they were added,
+   // paths are relative to the directory of the aggregate. It does not render any component,
+   // so it is the cheap merge step after the shards have been written.
+   bool write_aggregate(const std::filesystem::path &path) const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_PROJECT_H
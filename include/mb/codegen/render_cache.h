@@ -0,0 +1,54 @@
+#ifndef CODEGEN_RENDER_CACHE_H
+#define CODEGEN_RENDER_CACHE_H
+#include <cstddef>
+#include <filesystem>
+#include <mb/int.h>
+#include <string>
+#include <unordered_map>
+
+namespace mb::codegen {
+
+// render_cache - rendered declaration and definition text of definables by their fingerprint.
+// The cache is kept on disk between runs, saving it keeps only the entries used since it was loaded,
+// so elements removed from the schema do not pile up.
+// A render_cache must only be used by one thread at a time.
+class render_cache {
+ public:
+   struct entry {
+      std::string declaration;
+      std::string definition;
+   };
+
+   // format_version - part of the file header, bumped whenever the rendered output changes
+   static constexpr mb::u32 format_version = 1;
+
+ private:
+   struct slot {
+      entry contents;
+      bool used{};
+   };
+
+   std::unordered_map<mb::u64, slot> m_entries;
+   std::size_t m_hits{};
+   std::size_t m_misses{};
+
+ public:
+   // load - replaces the contents with the cache file,
+   // a missing, corrupted or outdated file leaves the cache empty and returns false
+   bool load(const std::filesystem::path &path);
+   // save - returns true if the file has been written
+   bool save(const std::filesystem::path &path) const;
+
+   // find - counts a hit or a miss, returns null on a miss
+   [[nodiscard]] const entry *find(mb::u64 fingerprint);
+   void store(mb::u64 fingerprint, entry contents);
+
+   [[nodiscard]] std::size_t size() const;
+   [[nodiscard]] std::size_t hits() const;
+   [[nodiscard]] std::size_t misses() const;
+   [[nodiscard]] double hit_rate() const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_RENDER_CACHE_H
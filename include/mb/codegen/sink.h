@@ -0,0 +1,48 @@
+#ifndef CODEGEN_SINK_H
+#define CODEGEN_SINK_H
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+namespace mb::codegen {
+
+// sink - destination the writer flushes its buffer into
+class sink {
+ public:
+   virtual ~sink() noexcept = default;
+
+   virtual void write(std::string_view data) = 0;
+};
+
+class ostream_sink : public sink {
+   std::ostream &m_stream;
+
+ public:
+   explicit ostream_sink(std::ostream &stream);
+
+   void write(std::string_view data) override;
+   [[nodiscard]] std::ostream &stream() const;
+};
+
+// fd_sink - writes to a file descriptor, the descriptor is not closed by the sink
+class fd_sink : public sink {
+   int m_fd;
+
+ public:
+   explicit fd_sink(int fd);
+
+   void write(std::string_view data) override;
+};
+
+class callback_sink : public sink {
+   std::function<void(std::string_view)> m_callback;
+
+ public:
+   explicit callback_sink(std::function<void(std::string_view)> callback);
+
+   void write(std::string_view data) override;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_SINK_H
@@ -0,0 +1,58 @@
+#ifndef CODEGEN_SIZE_REPORT_H
+#define CODEGEN_SIZE_REPORT_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mb::codegen {
+
+// code_size - amount of code emitted into one file
+struct code_size {
+   std::size_t bytes{};
+   std::size_t lines{};
+   std::size_t statements{};
+   // templates - template declarations, template_arguments wrappers and method templates
+   std::size_t templates{};
+
+   code_size &operator+=(const code_size &other);
+};
+
+[[nodiscard]] code_size operator+(code_size lhs, const code_size &rhs);
+
+// size_budget - limits of the code emitted for a single element into the header and source together,
+// a zero limit is not checked
+struct size_budget {
+   std::size_t bytes{};
+   std::size_t lines{};
+   std::size_t statements{};
+   std::size_t templates{};
+
+   [[nodiscard]] bool exceeded_by(const code_size &size) const;
+};
+
+// size_entry - code emitted for a definable, a class member or a definable wrapped in template_arguments.
+// Entries nested in another one (depth > 0) are included in the size of their parent.
+struct size_entry {
+   std::string label;
+   std::size_t depth{};
+   code_size header;
+   code_size source;
+   bool over_budget{};
+
+   [[nodiscard]] code_size total() const;
+};
+
+// size_report - sizes of the elements of a component in the order they are emitted
+struct size_report {
+   std::vector<size_entry> entries;
+   code_size header;
+   code_size source;
+
+   [[nodiscard]] std::vector<const size_entry *> over_budget() const;
+   // text - one line per entry, nested entries are indented, entries over budget are marked with "!"
+   [[nodiscard]] std::string text() const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_SIZE_REPORT_H
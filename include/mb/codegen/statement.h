@@ -1,142 +1,296 @@
 #ifndef LIBMB_STATEMENT_H
 #define LIBMB_STATEMENT_H
 #include "expression.h"
+#include "function_ref.h"
 #include "writer.h"
 #include <memory>
-#include <functional>
 
 namespace mb::codegen {
 
 class statement {
  public:
-   using ptr = std::unique_ptr<statement>;
+   using ptr = node_ptr<statement>;
 
    virtual ~statement() noexcept = default;
 
    virtual void write_statement(writer &w) const = 0;
    [[nodiscard]] virtual statement::ptr copy() const = 0;
+   // lower_statement - appends the statement to a flat tree, by default as a foreign node
+   [[nodiscard]] virtual flat_index lower_statement(flat_builder &b) const;
+   // fingerprint - stable structural hash of the node, equal nodes render equally.
+   // Nodes of the library keep it in their state, by default it is the hash of the rendered text.
+   [[nodiscard]] virtual mb::u64 fingerprint() const;
 
    class collector {
-      std::vector<statement::ptr> m_statements;
+      node_vector<statement::ptr> m_statements;
 
     public:
       collector &operator<<(const statement &stmt);
       collector &operator<<(const expression &expre);
-      std::vector<statement::ptr> build();
+      collector &operator<<(statement::ptr stmt);
+      collector &operator<<(expression::ptr expre);
+
+      template<typename T>
+         requires(!std::is_reference_v<T> && (node_source<T, statement> || node_source<T, expression>))
+      collector &operator<<(T &&node) {
+         if constexpr (node_source<T, statement>) {
+            return *this << take_node<statement>(std::move(node));
+         } else {
+            return *this << take_node<expression>(std::move(node));
+         }
+      }
+
+      node_vector<statement::ptr> build();
    };
+
+   // generator - fills a block of statements, invoked while the owning node is constructed
+   using generator = function_ref<void(collector &)>;
+
+   // collect - runs a statement generator and returns the collected statements
+   [[nodiscard]] static node_vector<statement::ptr> collect(generator statement_gen);
 };
 
 // expr - an expression statement
 class expr : public statement {
-   expression::ptr m_expr;
+   struct state {
+      expression::ptr expr;
+
+      explicit state(expression::ptr expr);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    explicit expr(const expression &expr);
+   explicit expr(expression::ptr expr);
+   template<node_source<expression> E>
+   explicit expr(E &&expre) : expr(take_node<expression>(std::forward<E>(expre))) {}
 
    void write_statement(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class if_statement : public statement {
-   expression::ptr m_condition;
-   std::vector<statement::ptr> m_if_then;
-   std::vector<statement::ptr> m_if_else;
-   bool m_constexpr = false;
+   struct state {
+      expression::ptr condition;
+      node_vector<statement::ptr> if_then;
+      node_vector<statement::ptr> if_else;
+      bool is_constexpr = false;
+
+      state(expression::ptr condition, node_vector<statement::ptr> if_then, node_vector<statement::ptr> if_else);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   if_statement(const expression &condition, std::function<void(statement::collector &)> if_then);
-   if_statement(const expression &condition, std::function<void(statement::collector &)> if_then, std::function<void(statement::collector &)> if_else);
-   if_statement(const if_statement &other);
+   if_statement(const expression &condition, statement::generator if_then);
+   if_statement(const expression &condition, statement::generator if_then, statement::generator if_else);
+   if_statement(expression::ptr condition, statement::generator if_then);
+   if_statement(expression::ptr condition, statement::generator if_then, statement::generator if_else);
+   template<node_source<expression> E>
+   if_statement(E &&condition, statement::generator if_then) : if_statement(take_node<expression>(std::forward<E>(condition)), if_then) {}
+   template<node_source<expression> E>
+   if_statement(E &&condition, statement::generator if_then, statement::generator if_else) : if_statement(take_node<expression>(std::forward<E>(condition)), if_then, if_else) {}
 
-   constexpr if_statement &with_constexpr() {
-      m_constexpr = true;
-      return *this;
-   }
+   if_statement &with_constexpr();
 
    void write_statement(writer &w) const override;
    ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class if_switch_statement : public statement {
    struct if_case {
       expression::ptr condition;
-      std::vector<statement::ptr> block;
+      node_vector<statement::ptr> block;
    };
 
-   std::vector<if_case> m_cases;
+   struct state {
+      node_vector<if_case> cases;
+
+      state() = default;
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
-   if_switch_statement() = default;
-   if_switch_statement(const if_switch_statement &other);
-   void add_case(const expression &condition, std::function<void(statement::collector &)> block);
+   if_switch_statement();
+   void add_case(const expression &condition, statement::generator block);
+   void add_case(expression::ptr condition, statement::generator block);
+   template<node_source<expression> E>
+   void add_case(E &&condition, statement::generator block) {
+      add_case(take_node<expression>(std::forward<E>(condition)), block);
+   }
 
    void write_statement(writer &w) const override;
    ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class switch_statement : public statement {
    struct case_statement {
       expression::ptr m_case;
-      std::vector<statement::ptr> m_statements;
+      node_vector<statement::ptr> m_statements;
       bool m_scope{true};
 
-      case_statement(const expression &case_expr, std::vector<statement::ptr> statements);
-      case_statement(const expression &case_expr, std::vector<statement::ptr> statements, bool scope);
+      case_statement(expression::ptr case_expr, node_vector<statement::ptr> statements, bool scope);
       case_statement(const case_statement &other);
+      case_statement(case_statement &&other) noexcept = default;
    };
-   expression::ptr m_value;
-   std::vector<case_statement> m_cases;
-   std::vector<statement::ptr> m_default_case;
-   bool m_default_case_scope{true};
+
+   struct state {
+      expression::ptr value;
+      node_vector<case_statement> cases;
+      node_vector<statement::ptr> default_case;
+      bool default_case_scope{true};
+
+      explicit state(expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
 
  public:
    explicit switch_statement(const expression &value);
-   switch_statement(const switch_statement &other);
+   explicit switch_statement(expression::ptr value);
+   template<node_source<expression> E>
+   explicit switch_statement(E &&value) : switch_statement(take_node<expression>(std::forward<E>(value))) {}
 
-   void add(const expression &case_expr, std::function<void(statement::collector &)> statements);
-   void add_noscope(const expression &case_expr, std::function<void(statement::collector &)> statements);
-   void add_default(std::function<void(statement::collector &)> statements);
-   void add_default_noscope(std::function<void(statement::collector &)> statements);
+   void add(const expression &case_expr, statement::generator statements);
+   void add(expression::ptr case_expr, statement::generator statements);
+   void add_noscope(const expression &case_expr, statement::generator statements);
+   void add_noscope(expression::ptr case_expr, statement::generator statements);
+   template<node_source<expression> E>
+   void add(E &&case_expr, statement::generator statements) {
+      add(take_node<expression>(std::forward<E>(case_expr)), statements);
+   }
+   template<node_source<expression> E>
+   void add_noscope(E &&case_expr, statement::generator statements) {
+      add_noscope(take_node<expression>(std::forward<E>(case_expr)), statements);
+   }
+   void add_default(statement::generator statements);
+   void add_default_noscope(statement::generator statements);
 
    void write_statement(writer &w) const override;
    ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class return_statement : public statement {
-   expression::ptr m_value;
+   struct state {
+      expression::ptr value;
+
+      explicit state(expression::ptr value);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
+
  public:
-   return_statement() = default;
+   return_statement();
    explicit return_statement(const expression &expre);
-   return_statement(const return_statement &other);
+   explicit return_statement(expression::ptr expre);
+   template<node_source<expression> E>
+   explicit return_statement(E &&expre) : return_statement(take_node<expression>(std::forward<E>(expre))) {}
 
    void write_statement(writer &w) const override;
    ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class for_statement : public statement {
-   expression::ptr m_start;
-   expression::ptr m_condition;
-   expression::ptr m_progress;
-   std::vector<statement::ptr> m_body;
+   struct state {
+      expression::ptr start;
+      expression::ptr condition;
+      expression::ptr progress;
+      node_vector<statement::ptr> body;
+
+      state(expression::ptr start, expression::ptr condition, expression::ptr progress, node_vector<statement::ptr> body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
+
  public:
-   for_statement(const expression& start, const expression &condition, const expression &progress, std::function<void(statement::collector &)> body);
-   for_statement(const for_statement &other);
+   for_statement(const expression &start, const expression &condition, const expression &progress, statement::generator body);
+   for_statement(expression::ptr start, expression::ptr condition, expression::ptr progress, statement::generator body);
+   template<node_source<expression> S, node_source<expression> C, node_source<expression> P>
+   for_statement(S &&start, C &&condition, P &&progress, statement::generator body) : for_statement(take_node<expression>(std::forward<S>(start)), take_node<expression>(std::forward<C>(condition)), take_node<expression>(std::forward<P>(progress)), body) {}
 
    void write_statement(writer &w) const override;
    ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 class ranged_for_statement : public statement {
-   std::string m_item_type;
-   std::string m_value_name;
-   expression::ptr m_range;
-   std::vector<statement::ptr> m_body;
+   struct state {
+      symbol item_type;
+      symbol value_name;
+      expression::ptr range;
+      node_vector<statement::ptr> body;
+
+      state(std::string_view item_type, std::string_view value_name, expression::ptr range, node_vector<statement::ptr> body);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
+
  public:
-   ranged_for_statement(std::string_view item_type, std::string_view value_name,  const expression& range, std::function<void(statement::collector &)> body);
-   ranged_for_statement(const ranged_for_statement &other);
+   ranged_for_statement(std::string_view item_type, std::string_view value_name, const expression &range, statement::generator body);
+   ranged_for_statement(std::string_view item_type, std::string_view value_name, expression::ptr range, statement::generator body);
+   template<node_source<expression> E>
+   ranged_for_statement(std::string_view item_type, std::string_view value_name, E &&range, statement::generator body) : ranged_for_statement(item_type, value_name, take_node<expression>(std::forward<E>(range)), body) {}
+
+   void write_statement(writer &w) const override;
+   [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
+};
+
+// located_statement - a statement that knows the place in a schema input it was generated from,
+// the writer emits the origin as configured by writer_style::origins
+class located_statement : public statement {
+   struct state {
+      symbol file;
+      mb::u32 line;
+      statement::ptr inner;
+
+      state(const source_origin &origin, statement::ptr inner);
+      state(const state &other);
+
+      [[nodiscard]] mb::u64 fingerprint() const;
+   };
+   cow<state> m_state;
+
+ public:
+   located_statement(const source_origin &origin, const statement &stmt);
+   located_statement(const source_origin &origin, statement::ptr stmt);
+   template<node_source<statement> S>
+   located_statement(const source_origin &origin, S &&stmt) : located_statement(origin, take_node<statement>(std::forward<S>(stmt))) {}
+
+   [[nodiscard]] source_origin origin() const;
 
    void write_statement(writer &w) const override;
    [[nodiscard]] ptr copy() const override;
+   [[nodiscard]] flat_index lower_statement(flat_builder &b) const override;
+   [[nodiscard]] mb::u64 fingerprint() const override;
 };
 
 }// namespace mb::codegen
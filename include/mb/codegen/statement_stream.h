@@ -0,0 +1,115 @@
+#ifndef CODEGEN_STATEMENT_STREAM_H
+#define CODEGEN_STATEMENT_STREAM_H
+#include "statement.h"
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+namespace mb::codegen {
+
+// statement_stream - coroutine yielding the statements of a block one at a time.
+// The coroutine runs only while the stream is being consumed, on the consuming thread,
+// so nodes it yields are allocated in the context current at that time.
+// Yielded expressions become expression statements, as with statement::collector.
+//
+//   statement_stream dispatch(int count) {
+//      for (int i = 0; i < count; ++i) {
+//         co_yield call(fmt::format("handle_{}", i));
+//      }
+//   }
+class statement_stream {
+ public:
+   struct promise_type {
+      statement::ptr current;
+      std::exception_ptr error;
+
+      statement_stream get_return_object() {
+         return statement_stream(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() noexcept {
+         return {};
+      }
+
+      std::suspend_always final_suspend() noexcept {
+         return {};
+      }
+
+      std::suspend_always yield_value(statement::ptr stmt);
+      std::suspend_always yield_value(expression::ptr expre);
+
+      template<typename T>
+         requires(node_source<T, statement> || node_source<T, expression>)
+      std::suspend_always yield_value(T &&node) {
+         if constexpr (node_source<T, statement>) {
+            return yield_value(take_node<statement>(std::forward<T>(node)));
+         } else {
+            return yield_value(take_node<expression>(std::forward<T>(node)));
+         }
+      }
+
+      void return_void() noexcept {}
+
+      void unhandled_exception() noexcept {
+         error = std::current_exception();
+      }
+   };
+
+   class iterator {
+      statement_stream *m_stream = nullptr;
+
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = statement::ptr;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+      explicit iterator(statement_stream &stream) : m_stream(&stream) {}
+
+      statement::ptr &operator*() const {
+         return m_stream->m_handle.promise().current;
+      }
+
+      iterator &operator++() {
+         if (!m_stream->advance()) {
+            m_stream = nullptr;
+         }
+         return *this;
+      }
+
+      void operator++(int) {
+         ++*this;
+      }
+
+      bool operator==(const iterator &other) const {
+         return m_stream == other.m_stream;
+      }
+   };
+
+ private:
+   std::coroutine_handle<promise_type> m_handle;
+
+   explicit statement_stream(std::coroutine_handle<promise_type> handle);
+
+   // advance - resumes the coroutine until the next statement, the previous one is released first
+   bool advance();
+
+ public:
+   statement_stream(const statement_stream &other) = delete;
+   statement_stream &operator=(const statement_stream &other) = delete;
+   statement_stream(statement_stream &&other) noexcept;
+   statement_stream &operator=(statement_stream &&other) noexcept;
+   ~statement_stream() noexcept;
+
+   // begin - starts the coroutine, a stream can only be iterated once
+   [[nodiscard]] iterator begin();
+   [[nodiscard]] iterator end();
+
+   // next - takes the next statement, null once the coroutine has finished
+   [[nodiscard]] statement::ptr next();
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_STATEMENT_STREAM_H
@@ -0,0 +1,66 @@
+#ifndef CODEGEN_SYMBOL_H
+#define CODEGEN_SYMBOL_H
+#include <cstddef>
+#include <fmt/format.h>
+#include <functional>
+#include <string_view>
+
+namespace mb::codegen {
+
+// symbol - interned name or type string.
+// Equal strings are interned into the same storage, so symbols compare by address
+// and copying one never allocates. Interned storage lives until the program exits.
+// Interning is thread safe.
+class symbol {
+   std::string_view m_value;
+
+ public:
+   constexpr symbol() noexcept = default;
+   explicit symbol(std::string_view value);
+
+   [[nodiscard]] constexpr std::string_view view() const noexcept {
+      return m_value;
+   }
+
+   [[nodiscard]] constexpr const char *data() const noexcept {
+      return m_value.data();
+   }
+
+   [[nodiscard]] constexpr std::size_t size() const noexcept {
+      return m_value.size();
+   }
+
+   [[nodiscard]] constexpr bool empty() const noexcept {
+      return m_value.empty();
+   }
+
+   constexpr operator std::string_view() const noexcept {
+      return m_value;
+   }
+
+   constexpr bool operator==(const symbol &other) const noexcept {
+      return m_value.data() == other.m_value.data();
+   }
+
+   // interned_count - number of distinct strings interned so far
+   [[nodiscard]] static std::size_t interned_count();
+};
+
+}// namespace mb::codegen
+
+template<>
+struct std::hash<mb::codegen::symbol> {
+   std::size_t operator()(const mb::codegen::symbol &sym) const noexcept {
+      return std::hash<const char *>()(sym.data());
+   }
+};
+
+template<>
+struct fmt::formatter<mb::codegen::symbol> : fmt::formatter<std::string_view> {
+   template<typename FormatContext>
+   auto format(const mb::codegen::symbol &sym, FormatContext &ctx) const {
+      return fmt::formatter<std::string_view>::format(sym.view(), ctx);
+   }
+};
+
+#endif//CODEGEN_SYMBOL_H
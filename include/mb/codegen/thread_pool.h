@@ -0,0 +1,83 @@
+#ifndef CODEGEN_THREAD_POOL_H
+#define CODEGEN_THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mb::codegen {
+
+// thread_pool - work stealing pool.
+// Every worker owns a queue, tasks submitted from a worker go to its own queue and are taken
+// newest first, idle workers steal the oldest tasks of other queues.
+// Tasks run without a current context, nodes they build are allocated on the heap.
+class thread_pool {
+ public:
+   using task = std::function<void()>;
+
+ private:
+   struct queue {
+      std::mutex mutex;
+      std::deque<task> tasks;
+   };
+
+   std::vector<std::unique_ptr<queue>> m_queues;
+   std::vector<std::thread> m_threads;
+   std::atomic<std::size_t> m_pending{};
+   std::atomic<std::size_t> m_next_queue{};
+   std::mutex m_wake_mutex;
+   std::condition_variable m_wake;
+   bool m_stopping{false};
+
+   inline static thread_local thread_pool *s_pool = nullptr;
+   inline static thread_local std::size_t s_queue = 0;
+
+   [[nodiscard]] bool take(std::size_t home, task &out);
+   void work(std::size_t index);
+
+ public:
+   // thread_pool - zero threads picks the hardware concurrency
+   explicit thread_pool(std::size_t thread_count = 0);
+   thread_pool(const thread_pool &other) = delete;
+   thread_pool &operator=(const thread_pool &other) = delete;
+   ~thread_pool() noexcept;
+
+   void submit(task t);
+
+   // run_one - runs a single pending task on the calling thread, returns false if there was none
+   bool run_one();
+
+   [[nodiscard]] std::size_t thread_count() const;
+};
+
+// task_group - set of tasks waited for together.
+// The waiting thread keeps running pending tasks of the pool, so groups may be nested inside tasks.
+// The first exception thrown by a task is rethrown from wait.
+class task_group {
+   thread_pool &m_pool;
+   std::atomic<std::size_t> m_remaining{};
+   std::mutex m_mutex;
+   std::condition_variable m_done;
+   std::exception_ptr m_error;
+
+ public:
+   explicit task_group(thread_pool &pool);
+   task_group(const task_group &other) = delete;
+   task_group &operator=(const task_group &other) = delete;
+   ~task_group() noexcept;
+
+   void run(std::function<void()> fn);
+   void wait();
+
+   [[nodiscard]] thread_pool &pool() const;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_THREAD_POOL_H
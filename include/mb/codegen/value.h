@@ -0,0 +1,255 @@
+#ifndef CODEGEN_VALUE_H
+#define CODEGEN_VALUE_H
+#include "definable.h"
+#include "statement.h"
+#include <optional>
+#include <type_traits>
+#include <variant>
+
+namespace mb::codegen {
+
+// variant_alternative - T is one of the alternatives of the variant
+template<typename T, typename Variant>
+struct is_variant_alternative : std::false_type {};
+
+template<typename T, typename... Ts>
+struct is_variant_alternative<T, std::variant<Ts...>> : std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+
+template<typename T, typename Variant>
+concept variant_alternative = is_variant_alternative<std::remove_cvref_t<T>, Variant>::value;
+
+// boxed - owning handle to a single child value with value semantics, copies are deep
+template<typename T>
+class boxed {
+   node_ptr<T> m_value;
+
+ public:
+   template<typename U>
+      requires(!std::is_same_v<std::remove_cvref_t<U>, boxed> && std::is_constructible_v<T, U &&>)
+   boxed(U &&value) : m_value(make_node<T>(std::forward<U>(value))) {}
+
+   boxed(const boxed &other) : m_value(make_node<T>(*other.m_value)) {}
+   boxed(boxed &&other) noexcept = default;
+
+   boxed &operator=(const boxed &other) {
+      if (this != &other) {
+         m_value = make_node<T>(*other.m_value);
+      }
+      return *this;
+   }
+   boxed &operator=(boxed &&other) noexcept = default;
+
+   const T &operator*() const {
+      return *m_value;
+   }
+
+   const T *operator->() const {
+      return m_value.get();
+   }
+};
+
+class expression_value;
+class statement_value;
+
+// *_value - alternatives of expression_value, mirror the expression classes
+struct raw_value {
+   node_string contents;
+};
+
+struct call_value {
+   boxed<expression_value> function;
+   node_vector<expression_value> arguments;
+};
+
+struct method_call_value {
+   boxed<expression_value> object;
+   symbol method_name;
+   node_vector<expression_value> arguments;
+};
+
+struct assign_value {
+   symbol variable;
+   boxed<expression_value> value;
+};
+
+struct binary_operator_value {
+   boxed<expression_value> lhs;
+   symbol op;
+   boxed<expression_value> rhs;
+};
+
+struct items_value {
+   node_vector<expression_value> items;
+};
+
+struct struct_constructor_value {
+   node_vector<expression_value> items;
+};
+
+struct deref_value {
+   boxed<expression_value> value;
+};
+
+struct lambda_value {
+   node_vector<expression_value> captures;
+   node_vector<arg> arguments;
+   node_vector<statement_value> statements;
+};
+
+// any_expression - escape hatch for expressions outside of the closed set
+struct any_expression {
+   expression::ptr node;
+
+   explicit any_expression(expression::ptr node);
+   explicit any_expression(const expression &node);
+   any_expression(const any_expression &other);
+   any_expression(any_expression &&other) noexcept = default;
+   any_expression &operator=(const any_expression &other);
+   any_expression &operator=(any_expression &&other) noexcept = default;
+};
+
+// expression_value - expression held by value.
+// Nodes of the closed set are stored inline, children in lists are stored contiguously,
+// so emitting and copying them needs neither a virtual call nor an allocation per node.
+class expression_value {
+ public:
+   using variant = std::variant<raw_value, call_value, method_call_value, assign_value, binary_operator_value,
+                                items_value, struct_constructor_value, deref_value, lambda_value, any_expression>;
+
+ private:
+   variant m_value;
+
+ public:
+   template<variant_alternative<variant> T>
+   expression_value(T &&value) : m_value(std::forward<T>(value)) {}
+
+   [[nodiscard]] const variant &get() const {
+      return m_value;
+   }
+
+   template<typename T>
+   [[nodiscard]] const T *get_if() const {
+      return std::get_if<T>(&m_value);
+   }
+
+   void write_expression(writer &w) const;
+};
+
+// *_value - alternatives of statement_value, mirror the statement classes
+struct expr_value {
+   expression_value expr;
+};
+
+struct if_value {
+   expression_value condition;
+   node_vector<statement_value> if_then;
+   node_vector<statement_value> if_else;
+   bool is_constexpr{};
+};
+
+struct if_switch_value {
+   struct case_value {
+      expression_value condition;
+      node_vector<statement_value> block;
+   };
+
+   node_vector<case_value> cases;
+};
+
+struct switch_value {
+   struct case_value {
+      expression_value value;
+      node_vector<statement_value> statements;
+      bool scope{true};
+   };
+
+   expression_value value;
+   node_vector<case_value> cases;
+   node_vector<statement_value> default_case;
+   bool default_case_scope{true};
+};
+
+struct return_value {
+   std::optional<expression_value> value;
+};
+
+struct for_value {
+   expression_value start;
+   expression_value condition;
+   expression_value progress;
+   node_vector<statement_value> body;
+};
+
+struct ranged_for_value {
+   symbol item_type;
+   symbol value_name;
+   expression_value range;
+   node_vector<statement_value> body;
+};
+
+// any_statement - escape hatch for statements outside of the closed set
+struct any_statement {
+   statement::ptr node;
+
+   explicit any_statement(statement::ptr node);
+   explicit any_statement(const statement &node);
+   any_statement(const any_statement &other);
+   any_statement(any_statement &&other) noexcept = default;
+   any_statement &operator=(const any_statement &other);
+   any_statement &operator=(any_statement &&other) noexcept = default;
+};
+
+// statement_value - statement held by value, see expression_value
+class statement_value {
+ public:
+   using variant = std::variant<expr_value, if_value, if_switch_value, switch_value, return_value,
+                                for_value, ranged_for_value, any_statement>;
+
+ private:
+   variant m_value;
+
+ public:
+   template<variant_alternative<variant> T>
+   statement_value(T &&value) : m_value(std::forward<T>(value)) {}
+
+   [[nodiscard]] const variant &get() const {
+      return m_value;
+   }
+
+   template<typename T>
+   [[nodiscard]] const T *get_if() const {
+      return std::get_if<T>(&m_value);
+   }
+
+   void write_statement(writer &w) const;
+};
+
+// value_expression - adapts an expression value to the expression interface
+class value_expression : public expression {
+   expression_value m_value;
+
+ public:
+   explicit value_expression(expression_value value);
+
+   [[nodiscard]] const expression_value &value() const;
+
+   void write_expression(writer &w) const override;
+   [[nodiscard]] ptr copy() const override;
+};
+
+// value_statement - adapts a statement value to the statement interface
+class value_statement : public statement {
+   statement_value m_value;
+
+ public:
+   explicit value_statement(statement_value value);
+
+   [[nodiscard]] const statement_value &value() const;
+
+   void write_statement(writer &w) const override;
+   [[nodiscard]] ptr copy() const override;
+};
+
+}// namespace mb::codegen
+
+#endif//CODEGEN_VALUE_H
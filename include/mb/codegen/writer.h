@@ -1,24 +1,165 @@
 #ifndef LIBMB_SCRIPT_WRITER_H
 #define LIBMB_SCRIPT_WRITER_H
+#include "origin.h"
+#include "sink.h"
 #include <cstdint>
-#include <fmt/core.h>
+#include <fmt/format.h>
+#include <iterator>
 #include <mb/int.h>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <vector>
 
 namespace mb::codegen {
 
+class render_memo;
+
+enum class brace_style {
+   attach,// "if (a) {"
+   allman,// "if (a)" and "{" on the next line
+};
+
+// origin_mode - how origins of located nodes are emitted, see writer::set_origin
+enum class origin_mode {
+   none,
+   line_directives,// #line directives in the generated code
+   source_map,     // a source_map recorded by the writer
+};
+
+// writer_style - layout of the generated code.
+// With a zero column limit lines are never broken, which is the fastest.
+struct writer_style {
+   mb::u32 column_limit = 0;
+   mb::u32 indent_width = 3;
+   bool use_tabs = false;
+   // braces - placement of braces opening functions, classes and control statements,
+   // namespaces, lambdas and case blocks always keep the brace on their line
+   brace_style braces = brace_style::attach;
+   // compact - for sources only a compiler reads: no indentation, no blank lines and no space before braces.
+   // Every line still ends with a new line, so preprocessor lines and comments stay valid.
+   // The column limit and brace placement are ignored.
+   bool compact = false;
+   // origins - text rendered with origins depends on where it is written,
+   // so they disable the render memo, the render cache and rendering elements on a thread pool
+   origin_mode origins = origin_mode::none;
+
+   bool operator==(const writer_style &other) const = default;
+};
+
+// writer - formats generated code into a contiguous buffer,
+// the buffer is flushed into the sink (if any) in large blocks.
+// A writer constructed without a sink keeps everything in memory.
+// A writer constructed from std::ostream writes through to the stream after every call,
+// so the stream can be read while the writer is alive, pass an ostream_sink to write in blocks.
 class writer {
-   std::ostream &m_stream;
+   fmt::memory_buffer m_buffer;
+   std::unique_ptr<sink> m_owned_sink;
+   sink *m_sink = nullptr;
+   std::ostream *m_stream = nullptr;
    mb::u32 m_indent = 0;
+   std::size_t m_flushed = 0;
+   render_memo *m_memo = nullptr;
+   writer_style m_style;
+
+   // layout of the current line, see begin_group
+   enum class mark_kind : mb::u8 {
+      begin,
+      end,
+      soft_break,
+      origin,
+   };
+   struct layout_mark {
+      std::size_t offset;
+      std::size_t length;
+      mark_kind kind;
+   };
+   static constexpr std::size_t no_layout = static_cast<std::size_t>(-1);
+   std::vector<layout_mark> m_marks;
+   std::size_t m_layout_start = no_layout;
+   std::size_t m_layout_scanned = 0;
+   mb::u32 m_layout_column = 0;
+   mb::u32 m_layout_indent = 0;
+   mb::u32 m_group_depth = 0;
+   // origins set within the layout, added to the source map once their position is final
+   std::vector<source_origin> m_layout_origins;
+
+   // position of the end of the buffer, the buffer is scanned up to m_position_scanned
+   source_origin m_origin;
+   std::string m_output_name;
+   source_map m_source_map;
+   mb::u32 m_line = 1;
+   mb::u32 m_flushed_column = 0;
+   std::size_t m_position_scanned = 0;
+
+   [[nodiscard]] mb::u32 width(std::string_view text) const;
+   void complete_line();
+   void layout_line(std::size_t end);
+   void map_layout_origins(std::size_t start, const std::vector<std::size_t> &offsets);
 
  public:
+   static constexpr std::size_t flush_threshold = 64 * 1024;
+
+   writer() = default;
    explicit writer(std::ostream &m_stream);
+   explicit writer(sink &s);
+   explicit writer(std::unique_ptr<sink> s);
+   writer(const writer &other) = delete;
+   writer &operator=(const writer &other) = delete;
+   ~writer() noexcept;
 
    void indent_in();
    void indent_out();
+   [[nodiscard]] mb::u32 indent() const;
+   void set_indent(mb::u32 indent);
+
+   void set_style(const writer_style &style);
+   [[nodiscard]] const writer_style &style() const;
+
+   // begin_group, end_group - delimit a group of soft breaks. Once a line with groups ends,
+   // it is laid out in a single linear pass: a group that does not fit into the column limit
+   // breaks at the soft breaks after which the line would not fit,
+   // continuation lines are aligned with the column the group started at.
+   // The text of a line is final only once the line ends or the writer is flushed.
+   void begin_group();
+   void end_group();
+   // soft_break - flat_text if the group is not broken here, a new line otherwise
+   void soft_break(std::string_view flat_text = " ");
+
+   // open_brace - opens a block at the end of a declaration or a statement head, see writer_style::braces
+   void open_brace();
+   // open_else - "else" written after the closing brace of the if block, followed by open_brace or " if ("
+   void open_else();
+
+   // text_position - line (from 1) and column (from 0) in the generated output
+   struct text_position {
+      mb::u32 line;
+      mb::u32 column;
+   };
+   // position - end of the output written so far, only text written since the last call is scanned
+   [[nodiscard]] text_position position();
+   // position_at - position of an offset into the buffer
+   [[nodiscard]] text_position position_at(std::size_t offset);
+
+   // set_origin - origin of the code written from here on, called at the start of a line.
+   // With line directives, a #line directive is written, returning to no origin writes one
+   // pointing back at the output, named "<generated>" unless set_output_name was called.
+   // With a source map, an entry is recorded, within a layout group it is recorded once the line is laid out.
+   void set_origin(const source_origin &origin);
+   [[nodiscard]] const source_origin &origin() const;
+   // set_output_name - name of the generated file used by #line directives, "<generated>" by default
+   void set_output_name(std::string_view name);
+   // mapping - the source map recorded with origin_mode::source_map
+   [[nodiscard]] const source_map &mapping() const;
+
+   // set_memo - lets flat trees reuse text of repeated subtrees, null disables it, see render_memo
+   void set_memo(render_memo *memo);
+   [[nodiscard]] render_memo *memo() const;
 
    void line();
    void line(std::string_view sv);
+   // blank_line - cosmetic empty line between definitions, omitted in compact style
+   void blank_line();
 
 #if FMT_VERSION && FMT_VERSION < 80000
    template<typename... Args>
@@ -28,7 +169,7 @@ class writer {
    constexpr void line(fmt::format_string<Args...> sv, Args &&...args) {
 #endif
       put_indent();
-      write(sv, args...);
+      write(sv, std::forward<Args>(args)...);
       line();
    }
 
@@ -49,14 +190,15 @@ class writer {
    template<typename... Args>
    constexpr void write(fmt::format_string<Args...> sv, Args &&...args) {
 #endif
-      m_stream << fmt::format(sv, std::forward<Args>(args)...);
+      fmt::format_to(std::back_inserter(m_buffer), sv, std::forward<Args>(args)...);
+      flush_if_full();
    }
 
    template<typename... Args>
    void scope(std::string_view sv, Args... args) {
       put_indent();
       write(sv, args...);
-      write(" {\n");
+      open_brace();
       indent_in();
    }
 
@@ -64,7 +206,7 @@ class writer {
    void flat_scope(std::string_view sv, Args... args) {
       put_indent();
       write(sv, args...);
-      write(" {\n");
+      open_brace();
    }
 
    void descope();
@@ -80,7 +222,39 @@ class writer {
 
    void descope_flat();
 
+   // flush - passes the buffered contents to the sink
+   void flush();
+
+   // clear - drops the buffered contents, the indentation, the position and the source map,
+   // the buffer memory is kept for reuse
+   void clear();
+
+   // written - bytes written since construction or the last clear, flushed or not
+   [[nodiscard]] std::size_t written() const;
+   // view - contents not yet flushed, for a writer without a sink it is the whole output
+   [[nodiscard]] std::string_view view() const;
+   [[nodiscard]] std::string str() const;
+
+   // raw - flushes the buffer and returns the underlying stream,
+   // only valid for a writer constructed from std::ostream
    std::ostream &raw();
+
+ private:
+   void flush_if_full() {
+      if (m_layout_start != no_layout) {
+         if (m_group_depth == 0) {
+            complete_line();
+         }
+         return;
+      }
+      if (flush_due()) {
+         flush();
+      }
+   }
+
+   [[nodiscard]] bool flush_due() const {
+      return m_sink != nullptr && (m_stream != nullptr || m_buffer.size() >= flush_threshold);
+   }
 };
 
 }// namespace mb::codegen
@@ -0,0 +1,102 @@
+#include <mb/codegen/block.h>
+#include <utility>
+
+namespace mb::codegen {
+
+block::lazy_state::lazy_state(lazy_generator generator, memoization mode, mb::u64 key) : generator(std::move(generator)),
+                                                                                         mode(mode),
+                                                                                         key(key) {}
+
+block::block(node_vector<statement::ptr> statements) : m_statements(std::move(statements)) {}
+
+block::block(statement::generator statement_gen) : m_statements(statement::collect(statement_gen)) {}
+
+block::block(const block &other) : m_statements(copy_nodes(other.m_statements)),
+                                   m_lazy(other.m_lazy) {}
+
+block &block::operator=(const block &other) {
+   if (this != &other) {
+      m_statements = copy_nodes(other.m_statements);
+      m_lazy = other.m_lazy;
+   }
+   return *this;
+}
+
+block block::lazy(lazy_generator generator, memoization mode, mb::u64 key) {
+   block result;
+   // memoized statements are shared between copies of the block,
+   // so they are kept on the heap rather than in the context of any of them
+   context::scope heap(nullptr);
+   result.m_lazy = std::make_shared<lazy_state>(std::move(generator), mode, key);
+   return result;
+}
+
+block block::stream(stream_generator generator, mb::u64 key) {
+   auto result = lazy([generator](statement::collector &col) {
+      for (auto &stmt : generator()) {
+         col << std::move(stmt);
+      }
+   }, memoization::regenerate, key);
+   result.m_lazy->stream = std::move(generator);
+   return result;
+}
+
+bool block::is_lazy() const {
+   return m_lazy != nullptr;
+}
+
+const node_vector<statement::ptr> &block::memoized(lazy_state &state) {
+   std::call_once(state.generated, [&state] {
+      context::scope heap(nullptr);
+      state.statements = statement::collect(state.generator);
+   });
+   return state.statements;
+}
+
+const node_vector<statement::ptr> &block::statements() const {
+   if (m_lazy == nullptr)
+      return m_statements;
+   return memoized(*m_lazy);
+}
+
+void block::prepare(task_group &tasks) const {
+   if (m_lazy == nullptr || m_lazy->mode != memoization::memoize)
+      return;
+   tasks.run([lazy = m_lazy] {
+      (void) memoized(*lazy);
+   });
+}
+
+mb::u64 block::fingerprint() const {
+   if (m_lazy == nullptr)
+      return structural_hash().nodes(m_statements);
+   if (m_lazy->key == fingerprint_none)
+      return fingerprint_none;
+   return structural_hash().number(m_lazy->key);
+}
+
+void block::write(writer &w) const {
+   if (m_lazy == nullptr || m_lazy->mode == memoization::memoize) {
+      for (const auto &stmt : statements()) {
+         stmt->write_statement(w);
+      }
+      return;
+   }
+
+   if (m_lazy->stream) {
+      context::scope heap(nullptr);
+      for (const auto &stmt : m_lazy->stream()) {
+         stmt->write_statement(w);
+      }
+      return;
+   }
+
+   context scratch;
+   context::scope scope(scratch);
+   auto generated = statement::collect(m_lazy->generator);
+   for (const auto &stmt : generated) {
+      stmt->write_statement(w);
+   }
+}
+
+}// namespace mb::codegen
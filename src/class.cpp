@@ -3,18 +3,20 @@
 
 namespace mb::codegen {
 
-attribute::attribute(std::string type, std::string name, bool default_const) : type(std::move(type)),
-                                                                               name(std::move(name)),
-                                                                               default_constr(default_const) {}
+attribute::attribute(std::string_view type, std::string_view name, bool default_const) : type(type),
+                                                                                         name(name),
+                                                                                         default_constr(default_const) {}
 
 void class_spec::write_declaration(writer &w) const {
-   if (!m_class_constant.empty()) {
-      w.write("#ifndef {}\n#define {}\n", m_class_constant, m_class_constant);
+   const auto &state = *m_state;
+   if (!state.class_constant.empty()) {
+      w.write("#ifndef {}\n#define {}\n", state.class_constant, state.class_constant);
    }
    w.put_indent();
-   w.write("class {} {}\n", m_name, "{");
+   w.write("class {}", state.name);
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_private_attributes.begin(), m_private_attributes.end(), [&w](const attribute &attr) {
+   std::for_each(state.private_attributes.begin(), state.private_attributes.end(), [&w](const attribute &attr) {
       w.put_indent();
       if (attr.default_constr) {
          w.write("{} {}{};\n", attr.type, attr.name, "{}");
@@ -22,13 +24,13 @@ void class_spec::write_declaration(writer &w) const {
          w.write("{} {};\n", attr.type, attr.name);
       }
    });
-   std::for_each(m_private_members.begin(), m_private_members.end(), [&w](const class_member::ptr &attirb) {
+   std::for_each(state.private_members.begin(), state.private_members.end(), [&w](const class_member::ptr &attirb) {
       attirb->write_declaration(w);
    });
    w.indent_out();
    w.write(" public:\n");
    w.indent_in();
-   std::for_each(m_public_attributes.begin(), m_public_attributes.end(), [&w](const attribute &attr) {
+   std::for_each(state.public_attributes.begin(), state.public_attributes.end(), [&w](const attribute &attr) {
       w.put_indent();
       if (attr.default_constr) {
          w.write("{} {}{};\n", attr.type, attr.name, "{}");
@@ -36,121 +38,172 @@ void class_spec::write_declaration(writer &w) const {
          w.write("{} {};\n", attr.type, attr.name);
       }
    });
-   std::for_each(m_public_members.begin(), m_public_members.end(), [&w](const class_member::ptr &attirb) {
+   std::for_each(state.public_members.begin(), state.public_members.end(), [&w](const class_member::ptr &attirb) {
       attirb->write_declaration(w);
    });
    w.indent_out();
    w.put_indent();
    w.write("};\n");
-   if (!m_class_constant.empty()) {
-      w.write("#endif//{}\n", m_class_constant);
+   if (!state.class_constant.empty()) {
+      w.write("#endif//{}\n", state.class_constant);
    }
-   w.write("\n");
+   w.blank_line();
 }
 
 void class_spec::write_definition(writer &w) const {
-   std::for_each(m_public_members.begin(), m_public_members.end(), [&w](const class_member::ptr &attirb) {
+   const auto &state = *m_state;
+   std::for_each(state.public_members.begin(), state.public_members.end(), [&w](const class_member::ptr &attirb) {
       attirb->write_definition(w);
    });
-   std::for_each(m_private_members.begin(), m_private_members.end(), [&w](const class_member::ptr &attirb) {
+   std::for_each(state.private_members.begin(), state.private_members.end(), [&w](const class_member::ptr &attirb) {
       attirb->write_definition(w);
    });
 }
 
 definable::ptr class_spec::copy() const {
-   return std::make_unique<class_spec>(*this);
+   return make_node<class_spec>(*this);
+}
+
+flat_index class_spec::lower_definable(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto lower_members = [&b](const node_vector<attribute> &attributes, const node_vector<class_member::ptr> &members) {
+      auto list = b.list(attributes.size() + members.size());
+      std::size_t at{};
+      for (const auto &attr : attributes) {
+         auto attr_node = b.add(flat_kind::attribute, attr.default_constr ? flat_flag::default_constr : 0);
+         b.set(attr_node, 0, b.text(attr.type));
+         b.set(attr_node, 1, b.text(attr.name));
+         b.set_element(list, at++, attr_node);
+      }
+      for (const auto &member : members) {
+         b.set_element(list, at++, member->lower_member(b));
+      }
+      return list;
+   };
+   auto node = b.add(flat_kind::class_spec);
+   b.set(node, 0, b.text(state.name));
+   b.set(node, 1, b.text(state.class_constant));
+   b.set(node, 2, lower_members(state.private_attributes, state.private_members));
+   b.set(node, 3, lower_members(state.public_attributes, state.public_members));
+   return node;
+}
+
+mb::u64 class_spec::state::fingerprint() const {
+   structural_hash h(flat_kind::class_spec);
+   h.text(name).text(class_constant);
+   auto hash_members = [&h](const node_vector<attribute> &attributes, const node_vector<class_member::ptr> &members) {
+      h.number(attributes.size() + members.size());
+      for (const auto &attr : attributes) {
+         h.fingerprint(structural_hash(flat_kind::attribute, attr.default_constr ? flat_flag::default_constr : 0).text(attr.type).text(attr.name));
+      }
+      for (const auto &member : members) {
+         h.node(*member);
+      }
+   };
+   hash_members(private_attributes, private_members);
+   hash_members(public_attributes, public_members);
+   return h;
 }
 
-class_spec::class_spec(std::string name) : m_name(std::move(name)) {}
-
-class_spec::class_spec(std::string name, std::string constant) : m_name(std::move(name)),
-                                                                 m_class_constant(std::move(constant)) {}
+mb::u64 class_spec::fingerprint() const {
+   return m_state.fingerprint();
+}
 
-class_spec::class_spec(const class_spec &other) : m_name(other.m_name),
-                                                  m_public_members(other.m_public_members.size()),
-                                                  m_private_members(other.m_private_members.size()),
-                                                  m_public_attributes(other.m_public_attributes.size()),
-                                                  m_private_attributes(other.m_private_attributes.size()),
-                                                  m_class_constant(other.m_class_constant) {
-   std::transform(other.m_public_members.begin(), other.m_public_members.end(), m_public_members.begin(), [](const class_member::ptr &mem) {
-      return mem->copy();
-   });
-   std::transform(other.m_private_members.begin(), other.m_private_members.end(), m_private_members.begin(), [](const class_member::ptr &mem) {
-      return mem->copy();
-   });
-   std::copy(other.m_public_attributes.begin(), other.m_public_attributes.end(), m_public_attributes.begin());
-   std::copy(other.m_private_attributes.begin(), other.m_private_attributes.end(), m_private_attributes.begin());
+void class_spec::prepare(task_group &tasks) const {
+   for (const auto &member : m_state->private_members) {
+      member->prepare(tasks);
+   }
+   for (const auto &member : m_state->public_members) {
+      member->prepare(tasks);
+   }
 }
 
+void class_member::prepare(task_group & /*tasks*/) const {}
+
+class_spec::state::state(std::string_view name, std::string_view constant) : name(name),
+                                                                             class_constant(constant) {}
+
+class_spec::state::state(const state &other) : name(other.name),
+                                               public_members(copy_nodes(other.public_members)),
+                                               private_members(copy_nodes(other.private_members)),
+                                               public_attributes(other.public_attributes),
+                                               private_attributes(other.private_attributes),
+                                               class_constant(other.class_constant) {}
+
+class_spec::class_spec(std::string name) : m_state(std::in_place, name, std::string_view()) {}
+
+class_spec::class_spec(std::string name, std::string constant) : m_state(std::in_place, name, constant) {}
+
 void class_spec::add_public(const class_member &member) {
-   auto copied = member.copy();
-   copied->set_class_name(m_name);
-   m_public_members.emplace_back(std::move(copied));
+   add_public(member.copy());
 }
 
 void class_spec::add_private(const class_member &member) {
-   auto copied = member.copy();
-   copied->set_class_name(m_name);
-   m_private_members.emplace_back(std::move(copied));
+   add_private(member.copy());
+}
+
+void class_spec::add_public(class_member::ptr member) {
+   member->set_class_name(std::string(m_state->name.view()));
+   m_state.edit().public_members.emplace_back(std::move(member));
+}
+
+void class_spec::add_private(class_member::ptr member) {
+   member->set_class_name(std::string(m_state->name.view()));
+   m_state.edit().private_members.emplace_back(std::move(member));
 }
 
 void class_spec::add_public(std::string_view type, std::string_view name, bool default_value) {
-   m_public_attributes.emplace_back(std::string(type), std::string(name), default_value);
+   m_state.edit().public_attributes.emplace_back(type, name, default_value);
 }
 
 void class_spec::add_private(std::string_view type, std::string_view name, bool default_value) {
-   m_private_attributes.emplace_back(std::string(type), std::string(name), default_value);
+   m_state.edit().private_attributes.emplace_back(type, name, default_value);
 }
 
-method::method(const method &other) : m_return_type(other.m_return_type),
-                                      m_class_name(other.m_class_name),
-                                      m_name(other.m_name),
-                                      m_arguments(other.m_arguments),
-                                      m_const(other.m_const) {
-   m_statements.reserve(other.m_statements.size());
-   std::transform(other.m_statements.begin(), other.m_statements.end(), std::back_inserter(m_statements), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
-}
+method::state::state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, bool constant, block body) : return_type(return_type),
+                                                                                                                                                                       name(name),
+                                                                                                                                                                       arguments(arguments.begin(), arguments.end()),
+                                                                                                                                                                       body(std::move(body)),
+                                                                                                                                                                       is_const(constant) {}
+
+method::state::state(const state &other) : return_type(other.return_type),
+                                           class_name(other.class_name),
+                                           name(other.name),
+                                           arguments(other.arguments),
+                                           body(other.body),
+                                           is_const(other.is_const) {}
 
 method::method(std::string_view return_type,
                std::string_view name,
                std::vector<arg> arguments,
-               std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                            m_name(name),
-                                                                            m_arguments(std::move(arguments)),
-                                                                            m_statements([&statement_gen]() {
-                                                                               statement::collector col;
-                                                                               statement_gen(col);
-                                                                               return col.build();
-                                                                            }()),
-                                                                            m_const(false) {}
+               statement::generator statement_gen) : m_state(std::in_place, return_type, name, arguments, false, block(statement_gen)) {}
 
 method::method(std::string_view return_type,
                std::string_view name,
                std::vector<arg> arguments,
                bool constant,
-               std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                            m_name(name),
-                                                                            m_arguments(std::move(arguments)),
-                                                                            m_statements([&statement_gen]() {
-                                                                               statement::collector col;
-                                                                               statement_gen(col);
-                                                                               return col.build();
-                                                                            }()),
-                                                                            m_const(constant) {}
+               statement::generator statement_gen) : m_state(std::in_place, return_type, name, arguments, constant, block(statement_gen)) {}
+
+method::method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body) : m_state(std::in_place, return_type, name, arguments, false, std::move(body)) {}
+
+method::method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, bool constant, block body) : m_state(std::in_place, return_type, name, arguments, constant, std::move(body)) {}
 
 void method::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}(", m_return_type, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}(", state.return_type, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   if (m_const) {
+   if (state.is_const) {
       w.write(") const;\n");
    } else {
       w.write(");\n");
@@ -158,127 +211,214 @@ void method::write_declaration(writer &w) const {
 }
 
 void method::write_definition(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}::{}(", m_return_type, m_class_name, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}::{}(", state.return_type, state.class_name, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   if (m_const) {
-      w.write(") const {\n");
+   if (state.is_const) {
+      w.write(") const");
+      w.open_brace();
    } else {
-      w.write(") {\n");
+      w.write(")");
+      w.open_brace();
    }
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
-      stmt->write_statement(w);
-   });
+   state.body.write(w);
    w.indent_out();
    w.put_indent();
-   w.write("}\n\n");
+   w.write("}\n");
+   w.blank_line();
 }
 
 class_member::ptr method::copy() const {
-   return std::make_unique<method>(*this);
+   return make_node<method>(*this);
 }
 
-void method::set_class_name(std::string class_name) {
-   m_class_name = class_name;
+flat_index method::lower_member(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::method, state.is_const ? flat_flag::is_const : 0);
+   b.set(node, 0, b.text(state.return_type));
+   b.set(node, 1, b.text(state.class_name));
+   b.set(node, 2, b.text(state.name));
+   b.set(node, 3, b.arguments(state.arguments));
+   b.set(node, 4, b.statements(state.body.statements()));
+   return node;
 }
 
-constructor::constructor(std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen) : m_arguments(std::move(arguments)),
-                                                                                                                  m_statements([&statement_gen]() {
-                                                                                                                     statement::collector col;
-                                                                                                                     statement_gen(col);
-                                                                                                                     return col.build();
-                                                                                                                  }()) {}
+mb::u64 method::state::fingerprint() const {
+   return structural_hash(flat_kind::method, is_const ? flat_flag::is_const : 0).text(return_type).text(class_name).text(name).arguments(arguments).fingerprint(body.fingerprint());
+}
 
-constructor::constructor(const constructor &other) : m_class_name(other.m_class_name),
-                                                     m_arguments(other.m_arguments) {
-   m_statements.reserve(other.m_statements.size());
-   std::transform(other.m_statements.begin(), other.m_statements.end(), std::back_inserter(m_statements), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+mb::u64 method::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void method::prepare(task_group &tasks) const {
+   m_state->body.prepare(tasks);
+}
+
+void method::set_class_name(std::string class_name) {
+   if (m_state->class_name != symbol(class_name)) {
+      m_state.edit().class_name = symbol(class_name);
+   }
 }
 
+constructor::state::state(const std::vector<arg> &arguments, block body) : arguments(arguments.begin(), arguments.end()),
+                                                                                                       body(std::move(body)) {}
+
+constructor::state::state(const state &other) : class_name(other.class_name),
+                                                arguments(other.arguments),
+                                                body(other.body) {}
+
+constructor::constructor(std::vector<arg> arguments, statement::generator statement_gen) : m_state(std::in_place, arguments, block(statement_gen)) {}
+
+constructor::constructor(std::vector<arg> arguments, block body) : m_state(std::in_place, arguments, std::move(body)) {}
+
 void constructor::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{}(", m_class_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{}(", state.class_name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(");\n");
 }
 
 void constructor::write_definition(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{}::{}(", m_class_name, m_class_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{}::{}(", state.class_name, state.class_name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   w.write(") {\n");
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
-      stmt->write_statement(w);
-   });
+   state.body.write(w);
    w.indent_out();
    w.put_indent();
-   w.write("}\n\n");
+   w.write("}\n");
+   w.blank_line();
 }
 
 void constructor::set_class_name(std::string class_name) {
-   m_class_name = class_name;
+   if (m_state->class_name != symbol(class_name)) {
+      m_state.edit().class_name = symbol(class_name);
+   }
 }
 
 class_member::ptr constructor::copy() const {
-   return std::make_unique<constructor>(*this);
+   return make_node<constructor>(*this);
 }
 
-static_attribute::static_attribute(std::string_view type, std::string_view name, const expression &value) : m_type(type),
-                                                                                                            m_name(name),
-                                                                                                            m_value(value.copy()) {}
+flat_index constructor::lower_member(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::constructor);
+   b.set(node, 0, b.text(state.class_name));
+   b.set(node, 1, b.arguments(state.arguments));
+   b.set(node, 2, b.statements(state.body.statements()));
+   return node;
+}
 
-static_attribute::static_attribute(const static_attribute &other) : m_class_name(other.m_class_name),
-                                                                    m_type(other.m_type),
-                                                                    m_name(other.m_name),
-                                                                    m_value(other.m_value->copy()) {}
+mb::u64 constructor::state::fingerprint() const {
+   return structural_hash(flat_kind::constructor).text(class_name).arguments(arguments).fingerprint(body.fingerprint());
+}
+
+mb::u64 constructor::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void constructor::prepare(task_group &tasks) const {
+   m_state->body.prepare(tasks);
+}
+
+static_attribute::state::state(std::string_view type, std::string_view name, expression::ptr value) : type(type),
+                                                                                                       name(name),
+                                                                                                       value(std::move(value)) {}
+
+static_attribute::state::state(const state &other) : class_name(other.class_name),
+                                                     type(other.type),
+                                                     name(other.name),
+                                                     value(other.value->copy()) {}
+
+static_attribute::static_attribute(std::string_view type, std::string_view name, const expression &value) : m_state(std::in_place, type, name, value.copy()) {}
+
+static_attribute::static_attribute(std::string_view type, std::string_view name, expression::ptr value) : m_state(std::in_place, type, name, std::move(value)) {}
 
 void static_attribute::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("static {} {};\n", m_type, m_name);
+   w.write("static {} {};\n", state.type, state.name);
 }
 
 void static_attribute::write_definition(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}::{} {}", m_type, m_class_name, m_name, "{");
-   m_value->write_expression(w);
-   w.write("};\n\n");
+   w.write("{} {}::{} {}", state.type, state.class_name, state.name, "{");
+   state.value->write_expression(w);
+   w.write("};\n");
+   w.blank_line();
 }
 
 void static_attribute::set_class_name(std::string class_name) {
-   m_class_name = class_name;
+   if (m_state->class_name != symbol(class_name)) {
+      m_state.edit().class_name = symbol(class_name);
+   }
 }
 
 class_member::ptr static_attribute::copy() const {
-   return std::make_unique<static_attribute>(*this);
+   return make_node<static_attribute>(*this);
+}
+
+flat_index static_attribute::lower_member(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::static_attribute);
+   b.set(node, 0, b.text(state.class_name));
+   b.set(node, 1, b.text(state.type));
+   b.set(node, 2, b.text(state.name));
+   b.set(node, 3, state.value->lower_expression(b));
+   return node;
 }
 
-default_constructor::default_constructor(const default_constructor &other) : m_class_name(other.m_class_name) {}
+mb::u64 static_attribute::state::fingerprint() const {
+   return structural_hash(flat_kind::static_attribute).text(class_name).text(type).text(name).node(*value);
+}
+
+mb::u64 static_attribute::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+default_constructor::default_constructor() : m_state(std::in_place) {}
 
 void default_constructor::write_declaration(writer &w) const {
    w.put_indent();
-   w.write("{}() = default;\n", m_class_name);
+   w.write("{}() = default;\n", m_state->class_name);
 }
 
 void default_constructor::write_definition(writer & /*w*/) const {
@@ -286,151 +426,195 @@ void default_constructor::write_definition(writer & /*w*/) const {
 }
 
 void default_constructor::set_class_name(std::string class_name) {
-   m_class_name = class_name;
+   if (m_state->class_name != symbol(class_name)) {
+      m_state.edit().class_name = symbol(class_name);
+   }
 }
 
 class_member::ptr default_constructor::copy() const {
-   return std::make_unique<default_constructor>(*this);
+   return make_node<default_constructor>(*this);
+}
+
+flat_index default_constructor::lower_member(flat_builder &b) const {
+   auto node = b.add(flat_kind::default_constructor);
+   b.set(node, 0, b.text(m_state->class_name));
+   return node;
+}
+
+mb::u64 default_constructor::state::fingerprint() const {
+   return structural_hash(flat_kind::default_constructor).text(class_name);
 }
 
+mb::u64 default_constructor::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+static_method::state::state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, block body) : return_type(return_type),
+                                                                                                                                                               name(name),
+                                                                                                                                                               arguments(arguments.begin(), arguments.end()),
+                                                                                                                                                               body(std::move(body)) {}
+
+static_method::state::state(const state &other) : return_type(other.return_type),
+                                                  class_name(other.class_name),
+                                                  name(other.name),
+                                                  arguments(other.arguments),
+                                                  body(other.body) {}
+
 static_method::static_method(std::string_view return_type,
                              std::string_view name,
                              std::vector<arg> arguments,
-                             std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                                          m_name(name),
-                                                                                          m_arguments(std::move(arguments)),
-                                                                                          m_statements([&statement_gen]() {
-                                                                                             statement::collector col;
-                                                                                             statement_gen(col);
-                                                                                             return col.build();
-                                                                                          }()) {}
-
-static_method::static_method(const static_method &other) : m_return_type(other.m_return_type),
-                                                           m_class_name(other.m_class_name),
-                                                           m_name(other.m_name),
-                                                           m_arguments(other.m_arguments) {
-   m_statements.reserve(other.m_statements.size());
-   std::transform(other.m_statements.begin(), other.m_statements.end(), std::back_inserter(m_statements), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
-}
+                             statement::generator statement_gen) : m_state(std::in_place, return_type, name, arguments, block(statement_gen)) {}
+
+static_method::static_method(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body) : m_state(std::in_place, return_type, name, arguments, std::move(body)) {}
 
 void static_method::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("static {} {}(", m_return_type, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("static {} {}(", state.return_type, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(");\n");
 }
 
 void static_method::write_definition(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}::{}(", m_return_type, m_class_name, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}::{}(", state.return_type, state.class_name, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   w.write(") {\n");
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
-      stmt->write_statement(w);
-   });
+   state.body.write(w);
    w.indent_out();
    w.put_indent();
-   w.write("}\n\n");
+   w.write("}\n");
+   w.blank_line();
 }
 
 void static_method::set_class_name(std::string class_name) {
-   m_class_name = class_name;
+   if (m_state->class_name != symbol(class_name)) {
+      m_state.edit().class_name = symbol(class_name);
+   }
 }
 
 class_member::ptr static_method::copy() const {
-   return std::make_unique<static_method>(*this);
+   return make_node<static_method>(*this);
+}
+
+flat_index static_method::lower_member(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::static_method);
+   b.set(node, 0, b.text(state.return_type));
+   b.set(node, 1, b.text(state.class_name));
+   b.set(node, 2, b.text(state.name));
+   b.set(node, 3, b.arguments(state.arguments));
+   b.set(node, 4, b.statements(state.body.statements()));
+   return node;
+}
+
+mb::u64 static_method::state::fingerprint() const {
+   return structural_hash(flat_kind::static_method).text(return_type).text(class_name).text(name).arguments(arguments).fingerprint(body.fingerprint());
 }
 
+mb::u64 static_method::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void static_method::prepare(task_group &tasks) const {
+   m_state->body.prepare(tasks);
+}
+
+method_template::state::state(std::string_view return_type, std::string_view name, const std::vector<arg> &template_arguments, const std::vector<arg> &arguments, bool constant, node_vector<statement::ptr> statements) : return_type(return_type),
+                                                                                                                                                                                                                              name(name),
+                                                                                                                                                                                                                              template_arguments(template_arguments.begin(), template_arguments.end()),
+                                                                                                                                                                                                                              arguments(arguments.begin(), arguments.end()),
+                                                                                                                                                                                                                              statements(std::move(statements)),
+                                                                                                                                                                                                                              is_const(constant) {}
+
+method_template::state::state(const state &other) : return_type(other.return_type),
+                                                    name(other.name),
+                                                    template_arguments(other.template_arguments),
+                                                    arguments(other.arguments),
+                                                    statements(copy_nodes(other.statements)),
+                                                    is_const(other.is_const) {}
+
 method_template::method_template(std::string_view return_type,
                                  std::string_view name,
                                  std::vector<arg> template_arguments,
                                  std::vector<arg> arguments,
-                                 std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                                              m_name(name),
-                                                                                              m_template_arguments(std::move(template_arguments)),
-                                                                                              m_arguments(std::move(arguments)),
-                                                                                              m_statements([&statement_gen]() {
-                                                                                                 statement::collector col;
-                                                                                                 statement_gen(col);
-                                                                                                 return col.build();
-                                                                                              }()),
-                                                                                              m_const(false) {}
+                                 statement::generator statement_gen) : m_state(std::in_place, return_type, name, template_arguments, arguments, false, statement::collect(statement_gen)) {}
 
 method_template::method_template(std::string_view return_type,
                                  std::string_view name,
                                  std::vector<arg> template_arguments,
                                  std::vector<arg> arguments,
                                  bool constant,
-                                 std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                                              m_name(name),
-                                                                                              m_template_arguments(std::move(template_arguments)),
-                                                                                              m_arguments(std::move(arguments)),
-                                                                                              m_statements([&statement_gen]() {
-                                                                                                 statement::collector col;
-                                                                                                 statement_gen(col);
-                                                                                                 return col.build();
-                                                                                              }()),
-                                                                                              m_const(constant) {}
-
-method_template::method_template(const method_template &other) : m_return_type(other.m_return_type),
-                                                                 m_name(other.m_name),
-                                                                 m_template_arguments(other.m_template_arguments),
-                                                                 m_arguments(other.m_arguments),
-                                                                 m_const(other.m_const) {
-   m_statements.reserve(other.m_statements.size());
-   std::transform(other.m_statements.begin(), other.m_statements.end(), std::back_inserter(m_statements), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
-}
+                                 statement::generator statement_gen) : m_state(std::in_place, return_type, name, template_arguments, arguments, constant, statement::collect(statement_gen)) {}
 
 void method_template::write_declaration(writer &w) const {
-   w.write("\n");
+   const auto &state = *m_state;
+   w.blank_line();
    w.put_indent();
    w.write("template<");
-   if (!m_template_arguments.empty()) {
-      auto it_first = m_template_arguments.begin();
+   if (!state.template_arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.template_arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_template_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.template_arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(">\n");
    w.put_indent();
-   w.write("{} {}(", m_return_type, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}(", state.return_type, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   if (m_const) {
-      w.write(") const {\n");
+   if (state.is_const) {
+      w.write(") const");
+      w.open_brace();
    } else {
-      w.write(") {\n");
+      w.write(")");
+      w.open_brace();
    }
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
+   std::for_each(state.statements.begin(), state.statements.end(), [&w](const statement::ptr &stmt) {
       stmt->write_statement(w);
    });
    w.indent_out();
    w.put_indent();
-   w.write("}\n\n");
+   w.write("}\n");
+   w.blank_line();
 }
 
 void method_template::write_definition(writer &/*w*/) const {
@@ -442,7 +626,26 @@ void method_template::set_class_name(std::string /*class_name*/) {
 }
 
 class_member::ptr method_template::copy() const {
-   return std::make_unique<method_template>(*this);
+   return make_node<method_template>(*this);
+}
+
+flat_index method_template::lower_member(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::method_template, state.is_const ? flat_flag::is_const : 0);
+   b.set(node, 0, b.text(state.return_type));
+   b.set(node, 1, b.text(state.name));
+   b.set(node, 2, b.arguments(state.template_arguments));
+   b.set(node, 3, b.arguments(state.arguments));
+   b.set(node, 4, b.statements(state.statements));
+   return node;
+}
+
+mb::u64 method_template::state::fingerprint() const {
+   return structural_hash(flat_kind::method_template, is_const ? flat_flag::is_const : 0).text(return_type).text(name).arguments(template_arguments).arguments(arguments).nodes(statements);
+}
+
+mb::u64 method_template::fingerprint() const {
+   return m_state.fingerprint();
 }
 
 }// namespace mb::codegen
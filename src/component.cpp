@@ -1,9 +1,131 @@
+#include <algorithm>
+#include <fmt/format.h>
 #include <mb/codegen/component.h>
+#include <mb/codegen/instrument.h>
 #include <mb/codegen/writer.h>
+#include <stdexcept>
 #include <utility>
 
 namespace mb::codegen {
 
+namespace {
+
+// definable_label - first line of the text written for a definable, names it in instrumentation reports
+std::string_view definable_label(std::string_view text) {
+   while (text.starts_with("#line ")) {
+      text.remove_prefix(std::min(text.find('\n') + 1, text.size()));
+   }
+   text = text.substr(0, text.find('\n'));
+   text.remove_prefix(std::min(text.find_first_not_of(' '), text.size()));
+   if (text.ends_with(" {")) {
+      text.remove_suffix(2);
+   }
+   return text.empty() ? "definable" : text;
+}
+
+// cache_key - the declaration is rendered with the header style and the definition with the source style,
+// elements rendered with non default styles are cached apart
+mb::u64 cache_key(mb::u64 fingerprint, const writer_style &header, const writer_style &source) {
+   if (header == writer_style{} && source == writer_style{})
+      return fingerprint;
+   auto text = [](const writer_style &style) {
+      return fmt::format("{} {} {} {} {}", style.column_limit, style.indent_width, style.use_tabs, static_cast<int>(style.braces), style.compact);
+   };
+   return fingerprint ^ content_hash(fmt::format("{} / {}", text(header), text(source)));
+}
+
+// write_recorded - runs the write of one definable, reporting what it added to the writer
+template<typename F>
+void write_recorded(writer &w, F write) {
+   if (instrumentation::current() == nullptr) {
+      write();
+      return;
+   }
+   auto before = w.written();
+   auto offset = w.view().size();
+   write();
+   auto bytes = w.written() - before;
+   // the text may have been flushed already, then only its size is known
+   auto text = w.view().size() == offset + bytes ? w.view().substr(offset) : std::string_view();
+   instrumentation::definable_written(definable_label(text), bytes);
+}
+
+template<typename F>
+void write_elements(writer &w, thread_pool *pool, const node_vector<definable::ptr> &elements, F write_element) {
+   // origins depend on the position in the output, elements are rendered in place
+   if (pool == nullptr || w.style().origins != origin_mode::none) {
+      for (const auto &def : elements) {
+         write_recorded(w, [&] { write_element(*def, w); });
+      }
+      return;
+   }
+
+   std::vector<std::string> parts(elements.size());
+   task_group tasks(*pool);
+   for (std::size_t i = 0; i < elements.size(); ++i) {
+      tasks.run([&w, &parts, &elements, &write_element, i] {
+         writer part;
+         part.set_style(w.style());
+         write_element(*elements[i], part);
+         parts[i] = part.str();
+      });
+   }
+   tasks.wait();
+   for (const auto &part : parts) {
+      write_recorded(w, [&] { w.write(part); });
+   }
+}
+
+void write_includes(writer &w, const include_set &includes) {
+   std::for_each(includes.begin(), includes.end(), [&w](const include &inc) {
+      if (inc.local) {
+         w.write("#include \"{}\"\n", inc.path);
+      } else {
+         w.write("#include <{}>\n", inc.path);
+      }
+   });
+}
+
+void write_header_begin(writer &w, std::string_view ns, std::string_view header_constant, const include_set &includes) {
+   if (!header_constant.empty()) {
+      w.write("#ifndef {}\n#define {}\n", header_constant, header_constant);
+   } else {
+      w.write("#pragma once\n");
+   }
+   write_includes(w, includes);
+   w.blank_line();
+   if (!ns.empty()) {
+      w.write("namespace {} {}\n", ns, "{");
+      w.blank_line();
+   }
+}
+
+void write_header_end(writer &w, std::string_view ns, std::string_view header_constant) {
+   if (!ns.empty()) {
+      w.write("}\n");
+   }
+   if (!header_constant.empty()) {
+      w.write("#endif//{}\n", header_constant);
+   }
+}
+
+void write_source_begin(writer &w, std::string_view ns, const include_set &includes) {
+   write_includes(w, includes);
+   w.blank_line();
+   if (!ns.empty()) {
+      w.write("namespace {} {}\n", ns, "{");
+      w.blank_line();
+   }
+}
+
+void write_source_end(writer &w, std::string_view ns) {
+   if (!ns.empty()) {
+      w.write("}");
+   }
+}
+
+}// namespace
+
 component::component(std::string ns) : m_namespace(std::move(ns)) {}
 
 component::component(std::string ns, std::string header_constant) : m_namespace(std::move(ns)), m_header_constant(std::move(header_constant)) {}
@@ -12,6 +134,10 @@ void component::operator<<(const definable &def) {
    m_elements.emplace_back(def.copy());
 }
 
+void component::operator<<(definable::ptr def) {
+   m_elements.emplace_back(std::move(def));
+}
+
 void component::source_include(const std::string &inc) {
    m_source_includes.emplace(inc, false);
 }
@@ -28,59 +154,228 @@ void component::header_include_local(const std::string &inc) {
    m_header_includes.emplace(inc, true);
 }
 
+void component::set_style(const writer_style &style) {
+   m_style = style;
+}
+
+const writer_style &component::style() const {
+   return m_style;
+}
+
 void component::write_header(std::ostream &stream) {
-   writer w(stream);
+   writer w(std::make_unique<ostream_sink>(stream));
+   w.set_style(m_style);
+   write_header(w);
+}
 
-   if (!m_header_constant.empty()) {
-      w.write("#ifndef {}\n#define {}\n", m_header_constant, m_header_constant);
-   } else {
-      w.write("#pragma once\n");
+void component::write_source(std::ostream &stream) {
+   writer w(std::make_unique<ostream_sink>(stream));
+   w.set_style(m_style);
+   write_source(w);
+}
+
+void component::write_header(writer &w) {
+   write_header(w, nullptr);
+}
+
+void component::write_source(writer &w) {
+   write_source(w, nullptr);
+}
+
+void component::prepare(thread_pool &pool) const {
+   task_group tasks(pool);
+   for (const auto &def : m_elements) {
+      def->prepare(tasks);
    }
+   tasks.wait();
+}
 
-   std::for_each(m_header_includes.begin(), m_header_includes.end(), [&w](const include &inc) {
-      if (inc.local) {
-         w.write("#include \"{}\"\n", inc.path);
-      } else {
-         w.write("#include <{}>\n", inc.path);
-      }
+void component::write_header(writer &w, thread_pool &pool) {
+   write_header(w, &pool);
+}
+
+void component::write_source(writer &w, thread_pool &pool) {
+   prepare(pool);
+   write_source(w, &pool);
+}
+
+void component::write_header(writer &w, thread_pool *pool) {
+   instrumentation::phase_scope writing(instrumentation::phase::write);
+   write_header_begin(w, m_namespace, m_header_constant, m_header_includes);
+   write_elements(w, pool, m_elements, [](const definable &def, writer &out) {
+      def.write_declaration(out);
    });
+   write_header_end(w, m_namespace, m_header_constant);
+}
 
-   w.write("\n");
-   if (!m_namespace.empty()) {
-      w.write("namespace {} {}\n\n", m_namespace, "{");
-   }
-   std::for_each(m_elements.begin(), m_elements.end(), [&w](const definable::ptr &def) {
-      def->write_declaration(w);
+void component::write_source(writer &w, thread_pool *pool) {
+   instrumentation::phase_scope writing(instrumentation::phase::write);
+   write_source_begin(w, m_namespace, m_source_includes);
+   write_elements(w, pool, m_elements, [](const definable &def, writer &out) {
+      def.write_definition(out);
    });
-   if (!m_namespace.empty()) {
-      w.write("}\n");
-   }
+   write_source_end(w, m_namespace);
+}
 
-   if (!m_header_constant.empty()) {
-      w.write("#endif//{}\n", m_header_constant);
-   }
+bool component::write_header_file(const std::filesystem::path &path) {
+   writer w;
+   w.set_style(m_style);
+   w.set_output_name(path.generic_string());
+   write_header(w);
+   return write_if_changed(path, w.view());
 }
 
-void component::write_source(std::ostream &stream) {
-   writer w(stream);
+bool component::write_source_file(const std::filesystem::path &path) {
+   writer w;
+   w.set_style(m_style);
+   w.set_output_name(path.generic_string());
+   write_source(w);
+   return write_if_changed(path, w.view());
+}
 
-   std::for_each(m_source_includes.begin(), m_source_includes.end(), [&w](const include &inc) {
-      if (inc.local) {
-         w.write("#include \"{}\"\n", inc.path);
-      } else {
-         w.write("#include <{}>\n", inc.path);
-      }
-   });
+output_report component::write_files(const std::filesystem::path &header_path, const std::filesystem::path &source_path) {
+   output_report report;
+   report.add(header_path, write_header_file(header_path));
+   report.add(source_path, write_source_file(source_path));
+   return report;
+}
 
-   w.write("\n");
-   if (!m_namespace.empty()) {
-      w.write("namespace {} {}\n\n", m_namespace, "{");
+void component::write(writer &header, writer &source, render_cache &cache) {
+   instrumentation::phase_scope writing(instrumentation::phase::write);
+   write_header_begin(header, m_namespace, m_header_constant, m_header_includes);
+   write_source_begin(source, m_namespace, m_source_includes);
+   for (const auto &def : m_elements) {
+      auto fingerprint = def->fingerprint();
+      if (header.style().origins != origin_mode::none || fingerprint == fingerprint_none) {
+         write_recorded(header, [&] { def->write_declaration(header); });
+         write_recorded(source, [&] { def->write_definition(source); });
+         continue;
+      }
+      fingerprint = cache_key(fingerprint, header.style(), source.style());
+      if (const auto *cached = cache.find(fingerprint); cached != nullptr) {
+         write_recorded(header, [&] { header.write(cached->declaration); });
+         write_recorded(source, [&] { source.write(cached->definition); });
+         continue;
+      }
+      writer declaration, definition;
+      declaration.set_style(header.style());
+      definition.set_style(source.style());
+      def->write_declaration(declaration);
+      def->write_definition(definition);
+      write_recorded(header, [&] { header.write(declaration.view()); });
+      write_recorded(source, [&] { source.write(definition.view()); });
+      cache.store(fingerprint, render_cache::entry{declaration.str(), definition.str()});
    }
-   std::for_each(m_elements.begin(), m_elements.end(), [&w](const definable::ptr &def) {
-      def->write_definition(w);
-   });
-   if (!m_namespace.empty()) {
-      w.write("}");
+   write_header_end(header, m_namespace, m_header_constant);
+   write_source_end(source, m_namespace);
+}
+
+output_report component::write_files(const std::filesystem::path &header_path, const std::filesystem::path &source_path, render_cache &cache) {
+   writer header, source;
+   header.set_style(m_style);
+   source.set_style(m_style);
+   header.set_output_name(header_path.generic_string());
+   source.set_output_name(source_path.generic_string());
+   write(header, source, cache);
+   output_report report;
+   report.add(header_path, write_if_changed(header_path, header.view()));
+   report.add(source_path, write_if_changed(source_path, source.view()));
+   return report;
+}
+
+flat_tree component::lower() const {
+   flat_tree tree;
+   flat_builder b(tree);
+   auto lower_includes = [&b](const auto &includes) {
+      return b.list(includes, [&b](const include &inc) {
+         auto node = b.add(flat_kind::include, inc.local ? flat_flag::local : 0);
+         b.set(node, 0, b.text(inc.path));
+         return node;
+      });
+   };
+   auto node = b.add(flat_kind::component);
+   b.set(node, 0, b.text(m_namespace));
+   b.set(node, 1, b.text(m_header_constant));
+   b.set(node, 2, lower_includes(m_header_includes));
+   b.set(node, 3, lower_includes(m_source_includes));
+   b.set(node, 4, b.definables(m_elements));
+   b.set_root(node);
+   return tree;
+}
+
+size_report component::measure(const size_budget &budget) const {
+   return lower().measure(budget, m_style);
+}
+
+streaming_component::streaming_component(writer &header, writer &source, std::string ns) : m_header(header),
+                                                                                           m_source(source),
+                                                                                           m_namespace(std::move(ns)) {}
+
+streaming_component::streaming_component(writer &header, writer &source, std::string ns, std::string header_constant) : m_header(header),
+                                                                                                                         m_source(source),
+                                                                                                                         m_namespace(std::move(ns)),
+                                                                                                                         m_header_constant(std::move(header_constant)) {}
+
+streaming_component::~streaming_component() noexcept {
+   try {
+      finish();
+   } catch (...) {
+      // nothing can be done about it here, call finish explicitly to handle errors
    }
 }
-}// namespace mb::codegen
\ No newline at end of file
+
+include_set &streaming_component::includes(include_set &set) {
+   if (m_started)
+      throw std::logic_error("streaming component: includes have to be added before the first element");
+   return set;
+}
+
+void streaming_component::source_include(const std::string &inc) {
+   includes(m_source_includes).emplace(inc, false);
+}
+
+void streaming_component::source_include_local(const std::string &inc) {
+   includes(m_source_includes).emplace(inc, true);
+}
+
+void streaming_component::header_include(const std::string &inc) {
+   includes(m_header_includes).emplace(inc, false);
+}
+
+void streaming_component::header_include_local(const std::string &inc) {
+   includes(m_header_includes).emplace(inc, true);
+}
+
+void streaming_component::start() {
+   if (m_started)
+      return;
+   m_started = true;
+   write_header_begin(m_header, m_namespace, m_header_constant, m_header_includes);
+   write_source_begin(m_source, m_namespace, m_source_includes);
+}
+
+void streaming_component::operator<<(const definable &def) {
+   if (m_finished)
+      throw std::logic_error("streaming component: element added after finish");
+   start();
+   instrumentation::phase_scope writing(instrumentation::phase::write);
+   write_recorded(m_header, [&] { def.write_declaration(m_header); });
+   write_recorded(m_source, [&] { def.write_definition(m_source); });
+}
+
+void streaming_component::operator<<(definable::ptr def) {
+   *this << *def;
+}
+
+void streaming_component::finish() {
+   if (m_finished)
+      return;
+   start();
+   m_finished = true;
+   write_header_end(m_header, m_namespace, m_header_constant);
+   write_source_end(m_source, m_namespace);
+   m_header.flush();
+   m_source.flush();
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <mb/codegen/component_builder.h>
+#include <tuple>
+#include <utility>
+
+namespace mb::codegen {
+
+void component_builder::shard::add(mb::u64 sequence, std::string_view sort_key, definable::ptr def) {
+   m_elements.push_back(element{sequence, std::string(sort_key), std::move(def)});
+}
+
+void component_builder::shard::add(mb::u64 sequence, const definable &def) {
+   context::scope heap(nullptr);
+   add(sequence, std::string_view(), def.copy());
+}
+
+void component_builder::shard::add(mb::u64 sequence, definable::ptr def) {
+   add(sequence, std::string_view(), std::move(def));
+}
+
+void component_builder::shard::add(std::string_view sort_key, const definable &def) {
+   context::scope heap(nullptr);
+   add(0, sort_key, def.copy());
+}
+
+void component_builder::shard::add(std::string_view sort_key, definable::ptr def) {
+   add(0, sort_key, std::move(def));
+}
+
+void component_builder::shard::source_include(const std::string &inc) {
+   context::scope heap(nullptr);
+   m_source_includes.emplace_back(inc, false);
+}
+
+void component_builder::shard::source_include_local(const std::string &inc) {
+   context::scope heap(nullptr);
+   m_source_includes.emplace_back(inc, true);
+}
+
+void component_builder::shard::header_include(const std::string &inc) {
+   context::scope heap(nullptr);
+   m_header_includes.emplace_back(inc, false);
+}
+
+void component_builder::shard::header_include_local(const std::string &inc) {
+   context::scope heap(nullptr);
+   m_header_includes.emplace_back(inc, true);
+}
+
+component_builder::shard &component_builder::make_shard() {
+   std::lock_guard lock(m_mutex);
+   return m_shards.emplace_back();
+}
+
+void component_builder::merge_into(component &cmp) {
+   struct ordered {
+      mb::u64 sequence;
+      std::string_view sort_key;
+      mb::u64 fingerprint;
+      std::size_t shard;
+      std::size_t position;
+      shard::element *element;
+   };
+
+   std::lock_guard lock(m_mutex);
+   std::vector<ordered> order;
+   for (std::size_t s = 0; s < m_shards.size(); ++s) {
+      auto &elements = m_shards[s].m_elements;
+      for (std::size_t position = 0; position < elements.size(); ++position) {
+         order.push_back(ordered{elements[position].sequence, elements[position].sort_key, 0, s, position, &elements[position]});
+      }
+   }
+
+   std::sort(order.begin(), order.end(), [](const ordered &lhs, const ordered &rhs) {
+      return std::tie(lhs.sequence, lhs.sort_key) < std::tie(rhs.sequence, rhs.sort_key);
+   });
+   // ties are broken by the contents, fingerprints are computed only where there is a tie,
+   // elements with equal or unknown fingerprints keep the order of their shards and of their insertion
+   for (auto it = order.begin(); it != order.end();) {
+      auto last = std::find_if(it, order.end(), [it](const ordered &o) {
+         return o.sequence != it->sequence || o.sort_key != it->sort_key;
+      });
+      if (last - it > 1) {
+         std::for_each(it, last, [](ordered &o) {
+            o.fingerprint = o.element->def->fingerprint();
+         });
+         std::sort(it, last, [](const ordered &lhs, const ordered &rhs) {
+            return std::tie(lhs.fingerprint, lhs.shard, lhs.position) < std::tie(rhs.fingerprint, rhs.shard, rhs.position);
+         });
+      }
+      it = last;
+   }
+
+   for (auto &o : order) {
+      cmp << std::move(o.element->def);
+   }
+   for (auto &s : m_shards) {
+      for (const auto &inc : s.m_header_includes) {
+         if (inc.local) {
+            cmp.header_include_local(std::string(inc.path));
+         } else {
+            cmp.header_include(std::string(inc.path));
+         }
+      }
+      for (const auto &inc : s.m_source_includes) {
+         if (inc.local) {
+            cmp.source_include_local(std::string(inc.path));
+         } else {
+            cmp.source_include(std::string(inc.path));
+         }
+      }
+   }
+   m_shards.clear();
+}
+
+}// namespace mb::codegen
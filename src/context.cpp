@@ -0,0 +1,32 @@
+#include <mb/codegen/context.h>
+
+namespace mb::codegen {
+
+context::context() : m_resource(default_block_size) {}
+
+context::context(std::size_t initial_size) : m_resource(initial_size) {}
+
+context::~context() noexcept {
+   for (auto *record = m_destructors; record != nullptr; record = record->next) {
+      record->destroy(record->object);
+   }
+   if (s_current == this) {
+      s_current = nullptr;
+   }
+}
+
+std::pmr::memory_resource *context::resource() {
+   return &m_resource;
+}
+
+context::scope::scope(context &ctx) : scope(&ctx) {}
+
+context::scope::scope(context *ctx) : m_previous(s_current) {
+   s_current = ctx;
+}
+
+context::scope::~scope() noexcept {
+   s_current = m_previous;
+}
+
+}// namespace mb::codegen
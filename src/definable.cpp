@@ -3,104 +3,166 @@
 
 namespace mb::codegen {
 
-globalvar::globalvar(std::string_view type, std::string_view name, const expression &value) : m_type(type),
-                                                                                              m_name(name),
-                                                                                              m_value(value.copy()) {}
+void definable::prepare(task_group & /*tasks*/) const {}
+
+globalvar::state::state(std::string_view type, std::string_view name, expression::ptr value) : type(type),
+                                                                                               name(name),
+                                                                                               value(std::move(value)) {}
+
+globalvar::state::state(const state &other) : type(other.type),
+                                              name(other.name),
+                                              value(other.value->copy()) {}
+
+globalvar::globalvar(std::string_view type, std::string_view name, const expression &value) : m_state(std::in_place, type, name, value.copy()) {}
+
+globalvar::globalvar(std::string_view type, std::string_view name, expression::ptr value) : m_state(std::in_place, type, name, std::move(value)) {}
 
 void globalvar::write_declaration(writer &w) const {
-   w.line("extern {} {};", m_type, m_name);
+   w.line("extern {} {};", m_state->type, m_state->name);
 }
 
 void globalvar::write_definition(writer &w) const {
    w.put_indent();
-   w.write("{} {} = ", m_type, m_name);
-   m_value->write_expression(w);
+   w.write("{} {} = ", m_state->type, m_state->name);
+   m_state->value->write_expression(w);
    w.write(";\n");
 }
 
 definable::ptr globalvar::copy() const {
-   return std::make_unique<globalvar>(m_type, m_name, *m_value);
+   return make_node<globalvar>(*this);
+}
+
+flat_index globalvar::lower_definable(flat_builder &b) const {
+   auto node = b.add(flat_kind::globalvar);
+   b.set(node, 0, b.text(m_state->type));
+   b.set(node, 1, b.text(m_state->name));
+   b.set(node, 2, m_state->value->lower_expression(b));
+   return node;
+}
+
+mb::u64 globalvar::state::fingerprint() const {
+   return structural_hash(flat_kind::globalvar).text(type).text(name).node(*value);
+}
+
+mb::u64 globalvar::fingerprint() const {
+   return m_state.fingerprint();
 }
 
 void function::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}(", m_return_type, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}(", state.return_type, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(");\n");
 }
 
 void function::write_definition(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
-   w.write("{} {}(", m_return_type, m_name);
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   w.write("{} {}(", state.return_type, state.name);
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
-   w.write(") {\n");
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
-      stmt->write_statement(w);
-   });
+   state.body.write(w);
    w.indent_out();
    w.put_indent();
-   w.write("}\n\n");
+   w.write("}\n");
+   w.blank_line();
 }
 
 definable::ptr function::copy() const {
-   return std::make_unique<function>(*this);
+   return make_node<function>(*this);
 }
 
-function::function(const function &other) : m_return_type(other.m_return_type), m_name(other.m_name),
-                                            m_arguments(other.m_arguments) {
-   m_statements.reserve(other.m_statements.size());
-   std::transform(other.m_statements.begin(), other.m_statements.end(), std::back_inserter(m_statements),
-                  [](const statement::ptr &stmt) {
-                     return stmt->copy();
-                  });
+flat_index function::lower_definable(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::function);
+   b.set(node, 0, b.text(state.return_type));
+   b.set(node, 1, b.text(state.name));
+   b.set(node, 2, b.arguments(state.arguments));
+   b.set(node, 3, b.statements(state.body.statements()));
+   return node;
 }
 
+mb::u64 function::state::fingerprint() const {
+   return structural_hash(flat_kind::function).text(return_type).text(name).arguments(arguments).fingerprint(body.fingerprint());
+}
+
+mb::u64 function::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void function::prepare(task_group &tasks) const {
+   m_state->body.prepare(tasks);
+}
+
+function::state::state(std::string_view return_type, std::string_view name, const std::vector<arg> &arguments, block body) : return_type(return_type),
+                                                                                                                                                          name(name),
+                                                                                                                                                          arguments(arguments.begin(), arguments.end()),
+                                                                                                                                                          body(std::move(body)) {}
+
+function::state::state(const state &other) : return_type(other.return_type),
+                                             name(other.name),
+                                             arguments(other.arguments),
+                                             body(other.body) {}
+
 function::function(std::string_view return_type, std::string_view name, std::vector<arg> arguments,
-                   std::function<void(statement::collector &)> statement_gen) : m_return_type(return_type),
-                                                                                m_name(name),
-                                                                                m_arguments(std::move(arguments)),
-                                                                                m_statements([&statement_gen]() {
-                                                                                   statement::collector col;
-                                                                                   statement_gen(col);
-                                                                                   return col.build();
-                                                                                }()) {}
+                   statement::generator statement_gen) : m_state(std::in_place, return_type, name, arguments, block(statement_gen)) {}
+
+function::function(std::string_view return_type, std::string_view name, std::vector<arg> arguments, block body) : m_state(std::in_place, return_type, name, arguments, std::move(body)) {}
 
-arg::arg(std::string_view type, std::string_view name) : type(std::string{type}), name(std::string{name}) {}
+arg::arg(std::string_view type, std::string_view name) : type(type), name(name) {}
 
-template_arguments::template_arguments(std::vector<arg> arguments, const definable &def) : m_arguments(std::move(arguments)),
-                                                                                           m_definable(def.copy()) {
+template_arguments::state::state(const std::vector<arg> &arguments, definable::ptr inner) : arguments(arguments.begin(), arguments.end()),
+                                                                                            inner(std::move(inner)) {}
+
+template_arguments::state::state(const state &other) : arguments(other.arguments),
+                                                       inner(other.inner->copy()) {}
+
+template_arguments::template_arguments(std::vector<arg> arguments, const definable &def) : m_state(std::in_place, arguments, def.copy()) {
 }
 
-template_arguments::template_arguments(const template_arguments &other) : m_definable(other.m_definable->copy()) {
-   m_arguments.reserve(other.m_arguments.size());
-   std::copy(other.m_arguments.begin(), other.m_arguments.end(), std::back_inserter(m_arguments));
+template_arguments::template_arguments(std::vector<arg> arguments, definable::ptr def) : m_state(std::in_place, arguments, std::move(def)) {
 }
 
 void template_arguments::write_declaration(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
    w.write("template<");
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-         w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+         w.write(",");
+         w.soft_break();
+         w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(">\n");
-   m_definable->write_definition(w);
+   state.inner->write_definition(w);
 }
 
 void template_arguments::write_definition(writer &/*w*/) const {
@@ -108,7 +170,80 @@ void template_arguments::write_definition(writer &/*w*/) const {
 }
 
 definable::ptr template_arguments::copy() const {
-   return std::make_unique<template_arguments>(*this);
+   return make_node<template_arguments>(*this);
+}
+
+flat_index template_arguments::lower_definable(flat_builder &b) const {
+   auto node = b.add(flat_kind::template_arguments);
+   b.set(node, 0, b.arguments(m_state->arguments));
+   b.set(node, 1, m_state->inner->lower_definable(b));
+   return node;
+}
+
+mb::u64 template_arguments::state::fingerprint() const {
+   return structural_hash(flat_kind::template_arguments).arguments(arguments).node(*inner);
+}
+
+mb::u64 template_arguments::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void template_arguments::prepare(task_group &tasks) const {
+   m_state->inner->prepare(tasks);
+}
+
+located_definable::state::state(const source_origin &origin, definable::ptr inner) : file(origin.file),
+                                                                                   line(origin.line),
+                                                                                   inner(std::move(inner)) {}
+
+located_definable::state::state(const state &other) : file(other.file),
+                                                       line(other.line),
+                                                       inner(other.inner->copy()) {}
+
+located_definable::located_definable(const source_origin &origin, const definable &def) : m_state(std::in_place, origin, def.copy()) {}
+
+located_definable::located_definable(const source_origin &origin, definable::ptr def) : m_state(std::in_place, origin, std::move(def)) {}
+
+source_origin located_definable::origin() const {
+   return source_origin{m_state->file, m_state->line};
+}
+
+void located_definable::write_declaration(writer &w) const {
+   auto previous = w.origin();
+   w.set_origin(origin());
+   m_state->inner->write_declaration(w);
+   w.set_origin(previous);
+}
+
+void located_definable::write_definition(writer &w) const {
+   auto previous = w.origin();
+   w.set_origin(origin());
+   m_state->inner->write_definition(w);
+   w.set_origin(previous);
+}
+
+definable::ptr located_definable::copy() const {
+   return make_node<located_definable>(*this);
+}
+
+flat_index located_definable::lower_definable(flat_builder &b) const {
+   auto node = b.add(flat_kind::located_definable);
+   b.set(node, 0, b.text(m_state->file));
+   b.set(node, 1, m_state->line);
+   b.set(node, 2, m_state->inner->lower_definable(b));
+   return node;
+}
+
+mb::u64 located_definable::state::fingerprint() const {
+   return structural_hash(flat_kind::located_definable).text(file).number(line).node(*inner);
+}
+
+mb::u64 located_definable::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void located_definable::prepare(task_group &tasks) const {
+   m_state->inner->prepare(tasks);
 }
 
-}// namespace mb::codegen
\ No newline at end of file
+}// namespace mb::codegen
@@ -3,60 +3,125 @@
 
 namespace mb::codegen {
 
-call::call(const call &other) : m_function_name(other.m_function_name->copy()),
-                                m_arguments(other.m_arguments.size()) {
-   std::transform(other.m_arguments.begin(), other.m_arguments.end(), m_arguments.begin(), [](const expression::ptr &arg) {
-      return arg->copy();
-   });
-}
+call::state::state(expression::ptr function_name, node_vector<expression::ptr> arguments) : function_name(std::move(function_name)),
+                                                                                            arguments(std::move(arguments)) {}
+
+call::state::state(const state &other) : function_name(other.function_name->copy()),
+                                         arguments(copy_nodes(other.arguments)) {}
 
 void call::write_expression(writer &w) const {
-   m_function_name->write_expression(w);
+   m_state->function_name->write_expression(w);
    w.write("(");
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   const auto &arguments = m_state->arguments;
+   if (!arguments.empty()) {
+      w.begin_group();
+      auto it_first = arguments.begin();
       (*it_first)->write_expression(w);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const expression::ptr &ex) {
-         w.write(", ");
+      std::for_each(it_first + 1, arguments.end(), [&w](const expression::ptr &ex) {
+         w.write(",");
+         w.soft_break();
          ex->write_expression(w);
       });
+      w.end_group();
    }
    w.write(")");
 }
 
 expression::ptr call::copy() const {
-   return std::make_unique<call>(*this);
+   return make_node<call>(*this);
+}
+
+flat_index call::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::call);
+   b.set(node, 0, m_state->function_name->lower_expression(b));
+   b.set(node, 1, b.expressions(m_state->arguments));
+   return node;
+}
+
+mb::u64 call::state::fingerprint() const {
+   return structural_hash(flat_kind::call).node(*function_name).nodes(arguments);
+}
+
+mb::u64 call::fingerprint() const {
+   return m_state.fingerprint();
 }
 
-raw::raw(const std::string &contents) : m_contents(contents) {}
+raw::state::state(std::string_view contents) : contents(contents) {}
+
+raw::raw(const std::string &contents) : m_state(std::in_place, contents) {}
 
 void raw::write_expression(writer &w) const {
-   w.write(m_contents);
+   w.write(m_state->contents);
 }
 
 expression::ptr raw::copy() const {
-   return std::make_unique<raw>(m_contents);
+   return make_node<raw>(*this);
+}
+
+flat_index raw::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::raw);
+   b.set(node, 0, b.text(m_state->contents));
+   return node;
+}
+
+mb::u64 raw::state::fingerprint() const {
+   return structural_hash(flat_kind::raw).text(contents);
 }
 
-assign::assign(std::string_view variable, const expression &value) : m_variable(variable), m_value(value.copy()) {}
+mb::u64 raw::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+assign::state::state(std::string_view variable, expression::ptr value) : variable(variable),
+                                                                          value(std::move(value)) {}
+
+assign::state::state(const state &other) : variable(other.variable),
+                                           value(other.value->copy()) {}
+
+assign::assign(std::string_view variable, const expression &value) : m_state(std::in_place, variable, value.copy()) {}
+
+assign::assign(std::string_view variable, expression::ptr value) : m_state(std::in_place, variable, std::move(value)) {}
 
 void assign::write_expression(writer &w) const {
-   w.write("{} = ", m_variable);
-   m_value->write_expression(w);
+   w.write("{} = ", m_state->variable);
+   m_state->value->write_expression(w);
 }
 
 expression::ptr assign::copy() const {
-   return std::make_unique<assign>(m_variable, *m_value);
+   return make_node<assign>(*this);
+}
+
+flat_index assign::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::assign);
+   b.set(node, 0, b.text(m_state->variable));
+   b.set(node, 1, m_state->value->lower_expression(b));
+   return node;
+}
+
+mb::u64 assign::state::fingerprint() const {
+   return structural_hash(flat_kind::assign).text(variable).node(*value);
 }
 
+mb::u64 assign::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+items::state::state(const state &other) : items(copy_nodes(other.items)) {}
+
+items::items() : m_state(std::in_place) {}
+
 void items::add(const expression &expr) {
-   m_items.emplace_back(expr.copy());
+   m_state.edit().items.emplace_back(expr.copy());
+}
+
+void items::add(expression::ptr expr) {
+   m_state.edit().items.emplace_back(std::move(expr));
 }
 
 void items::write_expression(writer &w) const {
    w.write("\n");
    w.indent_in();
-   std::for_each(m_items.begin(), m_items.end(), [&w](const expression::ptr &expr) {
+   std::for_each(m_state->items.begin(), m_state->items.end(), [&w](const expression::ptr &expr) {
       w.put_indent();
       expr->write_expression(w);
       w.write(",\n");
@@ -64,99 +129,197 @@ void items::write_expression(writer &w) const {
    w.indent_out();
 }
 
-items::items(const items &other) : m_items(other.m_items.size()) {
-   std::transform(other.m_items.begin(), other.m_items.end(), m_items.begin(), [](const expression::ptr &expr) {
-      return expr->copy();
-   });
+expression::ptr items::copy() const {
+   return make_node<items>(*this);
 }
 
-expression::ptr items::copy() const {
-   return std::make_unique<items>(*this);
+flat_index items::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::items);
+   b.set(node, 0, b.expressions(m_state->items));
+   return node;
 }
 
-struct_constructor::struct_constructor(const struct_constructor &other) : m_items(other.m_items.size()) {
-   std::transform(other.m_items.begin(), other.m_items.end(), m_items.begin(), [](const expression::ptr &expr) {
-      return expr->copy();
-   });
+mb::u64 items::state::fingerprint() const {
+   return structural_hash(flat_kind::items).nodes(items);
+}
+
+mb::u64 items::fingerprint() const {
+   return m_state.fingerprint();
 }
 
+struct_constructor::state::state(const state &other) : items(copy_nodes(other.items)) {}
+
+struct_constructor::struct_constructor() : m_state(std::in_place) {}
+
 void struct_constructor::add(const expression &expr) {
-   m_items.emplace_back(expr.copy());
+   m_state.edit().items.emplace_back(expr.copy());
+}
+
+void struct_constructor::add(expression::ptr expr) {
+   m_state.edit().items.emplace_back(std::move(expr));
 }
 
 void struct_constructor::write_expression(writer &w) const {
+   const auto &items = m_state->items;
    w.write("{");
-   auto first = m_items.begin();
+   w.begin_group();
+   auto first = items.begin();
    (*first)->write_expression(w);
-   std::for_each(first + 1, m_items.end(), [&w](const expression::ptr &expr) {
-      w.write(", ");
+   std::for_each(first + 1, items.end(), [&w](const expression::ptr &expr) {
+      w.write(",");
+      w.soft_break();
       expr->write_expression(w);
    });
+   w.end_group();
    w.write("}");
 }
 
 expression::ptr struct_constructor::copy() const {
-   return std::make_unique<struct_constructor>(*this);
+   return make_node<struct_constructor>(*this);
 }
 
-method_call::method_call(const method_call &other) : m_object(other.m_object->copy()),
-                                                     m_method_name(other.m_method_name),
-                                                     m_arguments(other.m_arguments.size()) {
-   std::transform(other.m_arguments.begin(), other.m_arguments.end(), m_arguments.begin(), [](const expression::ptr &arg) {
-      return arg->copy();
-   });
+flat_index struct_constructor::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::struct_constructor);
+   b.set(node, 0, b.expressions(m_state->items));
+   return node;
 }
 
+mb::u64 struct_constructor::state::fingerprint() const {
+   return structural_hash(flat_kind::struct_constructor).nodes(items);
+}
+
+mb::u64 struct_constructor::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+method_call::state::state(expression::ptr object, std::string_view method_name, node_vector<expression::ptr> arguments) : object(std::move(object)),
+                                                                                                                          method_name(method_name),
+                                                                                                                          arguments(std::move(arguments)) {}
+
+method_call::state::state(const state &other) : object(other.object->copy()),
+                                                method_name(other.method_name),
+                                                arguments(copy_nodes(other.arguments)) {}
+
 void method_call::write_expression(writer &w) const {
-   if (auto *deref_val = dynamic_cast<deref *>(m_object.get()); deref_val != nullptr) {
-      deref_val->m_value->write_expression(w);
+   if (auto *deref_val = dynamic_cast<deref *>(m_state->object.get()); deref_val != nullptr) {
+      deref_val->value().write_expression(w);
       w.write("->");
    } else {
-      m_object->write_expression(w);
+      m_state->object->write_expression(w);
       w.write(".");
    }
 
-   w.write(m_method_name);
+   w.write(m_state->method_name);
    w.write("(");
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   const auto &arguments = m_state->arguments;
+   if (!arguments.empty()) {
+      w.begin_group();
+      auto it_first = arguments.begin();
       (*it_first)->write_expression(w);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const expression::ptr &ex) {
-         w.write(", ");
+      std::for_each(it_first + 1, arguments.end(), [&w](const expression::ptr &ex) {
+         w.write(",");
+         w.soft_break();
          ex->write_expression(w);
       });
+      w.end_group();
    }
    w.write(")");
 }
 
 expression::ptr method_call::copy() const {
-   return std::make_unique<method_call>(*this);
+   return make_node<method_call>(*this);
+}
+
+flat_index method_call::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::method_call);
+   b.set(node, 0, m_state->object->lower_expression(b));
+   b.set(node, 1, b.text(m_state->method_name));
+   b.set(node, 2, b.expressions(m_state->arguments));
+   return node;
+}
+
+mb::u64 method_call::state::fingerprint() const {
+   return structural_hash(flat_kind::method_call).node(*object).text(method_name).nodes(arguments);
 }
 
-deref::deref(const expression &value) : m_value(value.copy()) {}
+mb::u64 method_call::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+deref::state::state(expression::ptr value) : value(std::move(value)) {}
+
+deref::state::state(const state &other) : value(other.value->copy()) {}
+
+deref::deref(const expression &value) : m_state(std::in_place, value.copy()) {}
+
+deref::deref(expression::ptr value) : m_state(std::in_place, std::move(value)) {}
+
+const expression &deref::value() const {
+   return *m_state->value;
+}
 
 void deref::write_expression(writer &w) const {
    w.write("*");
-   m_value->write_expression(w);
+   m_state->value->write_expression(w);
 }
 
 expression::ptr deref::copy() const {
-   return std::make_unique<deref>(*m_value);
+   return make_node<deref>(*this);
+}
+
+flat_index deref::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::deref);
+   b.set(node, 0, m_state->value->lower_expression(b));
+   return node;
 }
 
-binary_operator::binary_operator(const expression &lhs, std::string_view op, const expression &rhs) : m_lhs(lhs.copy()),
-                                                                                                      m_operator(op),
-                                                                                                      m_rhs(rhs.copy()) {
+mb::u64 deref::state::fingerprint() const {
+   return structural_hash(flat_kind::deref).node(*value);
 }
 
+mb::u64 deref::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+binary_operator::state::state(expression::ptr lhs, std::string_view op, expression::ptr rhs) : lhs(std::move(lhs)),
+                                                                                                op(op),
+                                                                                                rhs(std::move(rhs)) {}
+
+binary_operator::state::state(const state &other) : lhs(other.lhs->copy()),
+                                                    op(other.op),
+                                                    rhs(other.rhs->copy()) {}
+
+binary_operator::binary_operator(const expression &lhs, std::string_view op, const expression &rhs) : m_state(std::in_place, lhs.copy(), op, rhs.copy()) {}
+
+binary_operator::binary_operator(expression::ptr lhs, std::string_view op, expression::ptr rhs) : m_state(std::in_place, std::move(lhs), op, std::move(rhs)) {}
+
 void binary_operator::write_expression(writer &w) const {
-   m_lhs->write_expression(w);
-   w.write(" {} ", m_operator);
-   m_rhs->write_expression(w);
+   w.begin_group();
+   m_state->lhs->write_expression(w);
+   w.write(" {}", m_state->op);
+   w.soft_break();
+   m_state->rhs->write_expression(w);
+   w.end_group();
 }
 
 expression::ptr binary_operator::copy() const {
-   return std::make_unique<binary_operator>(*m_lhs, m_operator, *m_rhs);
+   return make_node<binary_operator>(*this);
+}
+
+flat_index binary_operator::lower_expression(flat_builder &b) const {
+   auto node = b.add(flat_kind::binary_operator);
+   b.set(node, 0, m_state->lhs->lower_expression(b));
+   b.set(node, 1, b.text(m_state->op));
+   b.set(node, 2, m_state->rhs->lower_expression(b));
+   return node;
+}
+
+mb::u64 binary_operator::state::fingerprint() const {
+   return structural_hash(flat_kind::binary_operator).node(*lhs).text(op).node(*rhs);
+}
+
+mb::u64 binary_operator::fingerprint() const {
+   return m_state.fingerprint();
 }
 
 }// namespace mb::codegen
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <mb/codegen/file.h>
+#include <mb/codegen/sink.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace mb::codegen {
+
+namespace {
+
+constexpr mb::u64 g_hash_seed = 0x9e3779b97f4a7c15ull;
+constexpr mb::u64 g_hash_mul1 = 0xff51afd7ed558ccdull;
+constexpr mb::u64 g_hash_mul2 = 0xc4ceb9fe1a85ec53ull;
+
+constexpr mb::u64 rotl(mb::u64 value, int shift) {
+   return (value << shift) | (value >> (64 - shift));
+}
+
+constexpr mb::u64 finalize(mb::u64 h) {
+   h ^= h >> 33;
+   h *= g_hash_mul1;
+   h ^= h >> 33;
+   h *= g_hash_mul2;
+   h ^= h >> 33;
+   return h;
+}
+
+// file_descriptor - closes the descriptor on scope exit
+class file_descriptor {
+   int m_fd;
+
+ public:
+   explicit file_descriptor(int fd) : m_fd(fd) {}
+   file_descriptor(const file_descriptor &other) = delete;
+   file_descriptor &operator=(const file_descriptor &other) = delete;
+
+   ~file_descriptor() noexcept {
+      if (m_fd >= 0)
+         ::close(m_fd);
+   }
+
+   [[nodiscard]] int get() const {
+      return m_fd;
+   }
+
+   int release() {
+      auto fd = m_fd;
+      m_fd = -1;
+      return fd;
+   }
+};
+
+[[noreturn]] void throw_errno(std::string_view what, const std::filesystem::path &path) {
+   throw std::system_error(errno, std::generic_category(), fmt::format("{} {}", what, path.string()));
+}
+
+bool has_same_contents(const std::filesystem::path &path, std::string_view contents) {
+   file_descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+   if (fd.get() < 0)
+      return false;
+
+   struct stat st {};
+   if (::fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode))
+      return false;
+   if (static_cast<std::size_t>(st.st_size) != contents.size())
+      return false;
+   if (contents.empty())
+      return true;
+
+   auto *mapped = ::mmap(nullptr, contents.size(), PROT_READ, MAP_PRIVATE, fd.get(), 0);
+   if (mapped == MAP_FAILED)
+      return false;
+   auto same = std::memcmp(mapped, contents.data(), contents.size()) == 0;
+   ::munmap(mapped, contents.size());
+   return same;
+}
+
+}// namespace
+
+void output_report::add(const std::filesystem::path &path, bool was_written) {
+   if (was_written) {
+      written.emplace_back(path);
+   } else {
+      unchanged.emplace_back(path);
+   }
+}
+
+void output_report::merge(const output_report &other) {
+   written.insert(written.end(), other.written.begin(), other.written.end());
+   unchanged.insert(unchanged.end(), other.unchanged.begin(), other.unchanged.end());
+}
+
+mb::u64 content_hash(std::string_view contents) {
+   mb::u64 h = g_hash_seed ^ (contents.size() * g_hash_mul1);
+   auto *at = contents.data();
+   auto *end = at + contents.size();
+   for (; at + sizeof(mb::u64) <= end; at += sizeof(mb::u64)) {
+      mb::u64 word;
+      std::memcpy(&word, at, sizeof(word));
+      h = rotl(h ^ (word * g_hash_mul1), 31) * g_hash_mul2;
+   }
+   mb::u64 tail{};
+   if (at != end) {
+      std::memcpy(&tail, at, static_cast<std::size_t>(end - at));
+   }
+   h = rotl(h ^ (tail * g_hash_mul1), 31) * g_hash_mul2;
+   return finalize(h);
+}
+
+bool write_if_changed(const std::filesystem::path &path, std::string_view contents) {
+   if (has_same_contents(path, contents))
+      return false;
+
+   static std::atomic<mb::u64> s_tmp_counter{};
+   auto tmp_path = path;
+   tmp_path += fmt::format(".tmp.{}.{}", ::getpid(), s_tmp_counter.fetch_add(1));
+
+   {
+      file_descriptor fd(::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+      if (fd.get() < 0)
+         throw_errno("could not create", tmp_path);
+      try {
+         fd_sink(fd.get()).write(contents);
+      } catch (...) {
+         ::unlink(tmp_path.c_str());
+         throw;
+      }
+      if (::close(fd.release()) != 0) {
+         ::unlink(tmp_path.c_str());
+         throw_errno("could not write", tmp_path);
+      }
+   }
+
+   if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      ::unlink(tmp_path.c_str());
+      throw_errno("could not replace", path);
+   }
+   return true;
+}
+
+}// namespace mb::codegen
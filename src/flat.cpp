@@ -0,0 +1,1154 @@
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <mb/codegen/class.h>
+#include <mb/codegen/file.h>
+#include <mb/codegen/flat.h>
+
+namespace mb::codegen {
+
+namespace {
+
+// operand - meaning of a node operand, see flat_kind
+enum class operand : mb::u8 {
+   none,
+   node,     // node index, flat_none if absent
+   text,     // text index
+   nodes,    // list of node indices
+   arguments,// list of type and name text pairs
+   number,   // plain value
+};
+
+using operand_layout = std::array<operand, 5>;
+
+constexpr operand_layout layout(flat_kind kind) {
+   using enum operand;
+   switch (kind) {
+   case flat_kind::raw: return {text};
+   case flat_kind::call: return {node, nodes};
+   case flat_kind::method_call: return {node, text, nodes};
+   case flat_kind::assign: return {text, node};
+   case flat_kind::binary_operator: return {node, text, node};
+   case flat_kind::items: return {nodes};
+   case flat_kind::struct_constructor: return {nodes};
+   case flat_kind::deref: return {node};
+   case flat_kind::lambda: return {nodes, arguments, nodes};
+   case flat_kind::expr: return {node};
+   case flat_kind::if_statement: return {node, nodes, nodes};
+   case flat_kind::if_switch: return {nodes};
+   case flat_kind::if_case: return {node, nodes};
+   case flat_kind::switch_statement: return {node, nodes, nodes};
+   case flat_kind::switch_case: return {node, nodes};
+   case flat_kind::return_statement: return {node};
+   case flat_kind::for_statement: return {node, node, node, nodes};
+   case flat_kind::ranged_for: return {text, text, node, nodes};
+   case flat_kind::globalvar: return {text, text, node};
+   case flat_kind::function: return {text, text, arguments, nodes};
+   case flat_kind::template_arguments: return {arguments, node};
+   case flat_kind::class_spec: return {text, text, nodes, nodes};
+   case flat_kind::attribute: return {text, text};
+   case flat_kind::method: return {text, text, text, arguments, nodes};
+   case flat_kind::method_template: return {text, text, arguments, arguments, nodes};
+   case flat_kind::static_method: return {text, text, text, arguments, nodes};
+   case flat_kind::default_constructor: return {text};
+   case flat_kind::constructor: return {text, arguments, nodes};
+   case flat_kind::static_attribute: return {text, text, text, node};
+   case flat_kind::located_statement: return {text, number, node};
+   case flat_kind::located_definable: return {text, number, node};
+   case flat_kind::component: return {text, text, nodes, nodes, nodes};
+   case flat_kind::include: return {text};
+   default: return {};
+   }
+}
+
+constexpr std::size_t g_kind_count = static_cast<std::size_t>(flat_kind::foreign_member) + 1;
+
+// g_operand_counts - operands in the record of each kind, foreign nodes have their index into the foreign nodes
+constexpr auto g_operand_counts = [] {
+   std::array<mb::u8, g_kind_count> counts{};
+   for (std::size_t kind = 0; kind < g_kind_count; ++kind) {
+      auto operands = layout(static_cast<flat_kind>(kind));
+      counts[kind] = kind >= static_cast<std::size_t>(flat_kind::foreign_expression)
+                             ? 1
+                             : static_cast<mb::u8>(std::count_if(operands.begin(), operands.end(), [](operand op) { return op != operand::none; }));
+   }
+   return counts;
+}();
+
+constexpr std::size_t operand_count(flat_kind kind) {
+   return g_operand_counts[static_cast<std::size_t>(kind)];
+}
+
+// nested_only - kinds that only appear in the lists of their parent, see element_kind
+constexpr bool nested_only(flat_kind kind) {
+   return kind == flat_kind::if_case || kind == flat_kind::switch_case ||
+          kind == flat_kind::include || kind == flat_kind::component;
+}
+
+// element_kind - kind of every element of a node list operand, if the list is restricted to one
+constexpr std::optional<flat_kind> element_kind(flat_kind kind, std::size_t operand) {
+   if (kind == flat_kind::if_switch)
+      return flat_kind::if_case;
+   if (kind == flat_kind::switch_statement && operand == 1)
+      return flat_kind::switch_case;
+   if (kind == flat_kind::component && operand < 4)
+      return flat_kind::include;
+   return std::nullopt;
+}
+
+constexpr mb::u64 mix(mb::u64 h, mb::u64 value) {
+   h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+   return h;
+}
+
+template<typename F>
+mb::u64 rendered_hash(F render) {
+   // origins of nested located nodes are part of the hash
+   writer w;
+   w.set_style(writer_style{.origins = origin_mode::line_directives});
+   render(w);
+   return content_hash(w.view());
+}
+
+}// namespace
+
+render_memo::render_memo(std::size_t min_nodes) : m_min_nodes(min_nodes) {}
+
+std::size_t render_memo::min_nodes() const {
+   return m_min_nodes;
+}
+
+const std::string *render_memo::find(mb::u64 hash, mb::u32 indent, const writer_style &style) {
+   auto it = m_rendered.find(key{hash, indent, style});
+   if (it == m_rendered.end()) {
+      ++m_misses;
+      return nullptr;
+   }
+   ++m_hits;
+   return &it->second;
+}
+
+void render_memo::store(mb::u64 hash, mb::u32 indent, const writer_style &style, std::string text) {
+   m_rendered.insert_or_assign(key{hash, indent, style}, std::move(text));
+}
+
+std::size_t render_memo::size() const {
+   return m_rendered.size();
+}
+
+std::size_t render_memo::hits() const {
+   return m_hits;
+}
+
+std::size_t render_memo::misses() const {
+   return m_misses;
+}
+
+flat_builder::flat_builder(flat_tree &tree) : m_tree(tree) {}
+
+flat_index flat_builder::add(flat_kind kind, mb::u8 flags) {
+   auto &nodes = m_tree.m_storage.nodes;
+   auto index = static_cast<flat_index>(nodes.size());
+   nodes.push_back(static_cast<flat_index>(kind) | static_cast<flat_index>(flags) << 8);
+   nodes.resize(nodes.size() + operand_count(kind), 0);
+   ++m_tree.m_node_count;
+   m_tree.refresh_views();
+   return index;
+}
+
+void flat_builder::set(flat_index node, std::size_t operand, flat_index value) {
+   assert(operand < operand_count(m_tree.node(node).kind));
+   m_tree.m_storage.nodes[node + 1 + operand] = value;
+}
+
+void flat_builder::set_root(flat_index node) {
+   m_tree.m_root = node;
+}
+
+flat_index flat_builder::text(symbol value) {
+   auto [it, inserted] = m_symbols.try_emplace(value.data(), 0);
+   if (inserted) {
+      it->second = text(value.view());
+   }
+   return it->second;
+}
+
+flat_index flat_builder::text(std::string_view value) {
+   auto [it, inserted] = m_texts.try_emplace(std::hash<std::string_view>{}(value), 0);
+   if (!inserted && m_tree.text(it->second) == value)
+      return it->second;
+   auto &storage = m_tree.m_storage;
+   auto index = static_cast<flat_index>(storage.texts.size());
+   // a text whose hash collides with a stored one is stored as well and takes over the slot
+   it->second = index;
+   storage.texts.push_back(flat_text{static_cast<mb::u32>(storage.text_data.size()), static_cast<mb::u32>(value.size())});
+   storage.text_data.insert(storage.text_data.end(), value.begin(), value.end());
+   m_tree.refresh_views();
+   return index;
+}
+
+flat_index flat_builder::list(std::size_t size) {
+   auto &children = m_tree.m_storage.children;
+   auto index = static_cast<flat_index>(children.size());
+   children.push_back(static_cast<flat_index>(size));
+   children.resize(children.size() + size, flat_none);
+   m_tree.refresh_views();
+   return index;
+}
+
+void flat_builder::set_element(flat_index list, std::size_t at, flat_index value) {
+   m_tree.m_storage.children[list + 1 + at] = value;
+}
+
+flat_index flat_builder::foreign(const expression &expr) {
+   auto node = add(flat_kind::foreign_expression);
+   set(node, 0, static_cast<flat_index>(m_tree.m_foreign_expressions.size()));
+   m_tree.m_foreign_expressions.push_back(&expr);
+   return node;
+}
+
+flat_index flat_builder::foreign(const statement &stmt) {
+   auto node = add(flat_kind::foreign_statement);
+   set(node, 0, static_cast<flat_index>(m_tree.m_foreign_statements.size()));
+   m_tree.m_foreign_statements.push_back(&stmt);
+   return node;
+}
+
+flat_index flat_builder::foreign(const definable &def) {
+   auto node = add(flat_kind::foreign_definable);
+   set(node, 0, static_cast<flat_index>(m_tree.m_foreign_definables.size()));
+   m_tree.m_foreign_definables.push_back(&def);
+   return node;
+}
+
+flat_index flat_builder::foreign(const class_member &member) {
+   auto node = add(flat_kind::foreign_member);
+   set(node, 0, static_cast<flat_index>(m_tree.m_foreign_members.size()));
+   m_tree.m_foreign_members.push_back(&member);
+   return node;
+}
+
+flat_index expression::lower_expression(flat_builder &b) const {
+   return b.foreign(*this);
+}
+
+flat_index statement::lower_statement(flat_builder &b) const {
+   return b.foreign(*this);
+}
+
+flat_index definable::lower_definable(flat_builder &b) const {
+   return b.foreign(*this);
+}
+
+flat_index class_member::lower_member(flat_builder &b) const {
+   return b.foreign(*this);
+}
+
+void flat_tree::refresh_views() {
+   m_nodes = m_storage.nodes;
+   m_children = m_storage.children;
+   m_texts = m_storage.texts;
+   m_text_data = std::string_view(m_storage.text_data.data(), m_storage.text_data.size());
+}
+
+structural_hash::structural_hash() : m_value(0x9e3779b97f4a7c15ull) {}
+
+structural_hash::structural_hash(flat_kind kind, mb::u8 flags) : m_value(mix(static_cast<mb::u64>(kind), flags)) {}
+
+structural_hash &structural_hash::number(mb::u64 value) {
+   m_value = mix(m_value, value);
+   return *this;
+}
+
+structural_hash &structural_hash::text(std::string_view value) {
+   m_value = mix(m_value, content_hash(value));
+   return *this;
+}
+
+structural_hash &structural_hash::fingerprint(mb::u64 value) {
+   m_known = m_known && value != fingerprint_none;
+   m_value = mix(m_value, value);
+   return *this;
+}
+
+mb::u64 structural_hash::value() const {
+   if (!m_known)
+      return fingerprint_none;
+   return m_value > fingerprint_stale ? m_value : m_value + fingerprint_stale + 1;
+}
+
+mb::u64 expression::fingerprint() const {
+   return structural_hash(flat_kind::foreign_expression).number(rendered_hash([this](writer &w) { write_expression(w); }));
+}
+
+mb::u64 statement::fingerprint() const {
+   return structural_hash(flat_kind::foreign_statement).number(rendered_hash([this](writer &w) { write_statement(w); }));
+}
+
+mb::u64 definable::fingerprint() const {
+   return structural_hash(flat_kind::foreign_definable).number(rendered_hash([this](writer &w) {
+      write_declaration(w);
+      write_definition(w);
+   }));
+}
+
+mb::u64 class_member::fingerprint() const {
+   return structural_hash(flat_kind::foreign_member).number(rendered_hash([this](writer &w) {
+      write_declaration(w);
+      write_definition(w);
+   }));
+}
+
+mb::u64 flat_tree::hash_list(flat_index list) const {
+   auto count = m_children[list];
+   mb::u64 h = count;
+   for (flat_index i = 1; i <= count; ++i) {
+      h = mix(h, hash(m_children[list + i]));
+   }
+   return h;
+}
+
+mb::u64 flat_tree::hash(flat_index index) const {
+   if (index == flat_none)
+      return 0;
+   if (m_hashes.size() == m_nodes.size())
+      return m_hashes[index];
+   return compute_hash(index);
+}
+
+void flat_tree::index_hashes() {
+   std::vector<flat_index> records;
+   records.reserve(m_node_count);
+   for (std::size_t index = 0; index < m_nodes.size(); index += 1 + operand_count(node(static_cast<flat_index>(index)).kind)) {
+      records.push_back(static_cast<flat_index>(index));
+   }
+
+   // children are always added after their parent, so walking backwards visits them first
+   m_hashes.assign(m_nodes.size(), 0);
+   m_sizes.assign(m_nodes.size(), 1);
+   for (auto record = records.rbegin(); record != records.rend(); ++record) {
+      auto index = *record;
+      m_hashes[index] = compute_hash(index);
+
+      auto node = this->node(index);
+      auto operands = layout(node.kind);
+      for (std::size_t i = 0; i < operands.size(); ++i) {
+         if (operands[i] == operand::node && node.operands[i] != flat_none) {
+            m_sizes[index] += m_sizes[node.operands[i]];
+         } else if (operands[i] == operand::nodes) {
+            auto list = node.operands[i];
+            for (flat_index at = 1; at <= m_children[list]; ++at) {
+               m_sizes[index] += m_sizes[m_children[list + at]];
+            }
+         }
+      }
+   }
+}
+
+std::string_view flat_tree::check_operands() const {
+   auto words = static_cast<mb::u64>(m_nodes.size());
+   auto children_count = static_cast<mb::u64>(m_children.size());
+   auto text_count = static_cast<mb::u64>(m_texts.size());
+
+   // records have to fill the node array exactly, node operands may only refer to the start of a record
+   std::vector<bool> starts(m_nodes.size());
+   std::size_t node_count{};
+   mb::u64 index{};
+   while (index < words) {
+      auto kind = node(static_cast<flat_index>(index)).kind;
+      if (kind >= flat_kind::foreign_expression)
+         return "unknown node kind";
+      starts[index] = true;
+      ++node_count;
+      index += 1 + operand_count(kind);
+   }
+   if (index != words)
+      return "truncated node record";
+   if (node_count != m_node_count)
+      return "node count mismatch";
+   if (m_root != flat_none && (m_root >= words || !starts[m_root]))
+      return "root out of range";
+
+   // children are always added after their parent, which also rules out cycles
+   auto check_child = [&](flat_index parent, flat_index child, std::optional<flat_kind> expected) -> std::string_view {
+      if (child <= parent || child >= words || !starts[child])
+         return "node out of range";
+      auto kind = node(child).kind;
+      if (expected.has_value() ? kind != *expected : nested_only(kind))
+         return "unexpected node kind";
+      return {};
+   };
+   auto check_list = [&](flat_index list, mb::u64 per_element) -> std::string_view {
+      if (list >= children_count || list + per_element * m_children[list] >= children_count)
+         return "list out of range";
+      return {};
+   };
+
+   for (flat_index index = 0; index < words; index += 1 + operand_count(node(index).kind)) {
+      auto node = this->node(index);
+      const auto *op = node.operands;
+      auto operands = layout(node.kind);
+      for (std::size_t i = 0; i < operands.size(); ++i) {
+         std::string_view error;
+         switch (operands[i]) {
+         case operand::none:
+         case operand::number:
+            break;
+         case operand::node:
+            if (op[i] != flat_none || node.kind != flat_kind::return_statement) {
+               error = check_child(index, op[i], std::nullopt);
+            }
+            break;
+         case operand::text:
+            if (op[i] >= text_count) {
+               error = "text out of range";
+            }
+            break;
+         case operand::nodes:
+            error = check_list(op[i], 1);
+            for (flat_index at = 1; error.empty() && at <= m_children[op[i]]; ++at) {
+               error = check_child(index, m_children[op[i] + at], element_kind(node.kind, i));
+            }
+            break;
+         case operand::arguments:
+            error = check_list(op[i], 2);
+            for (flat_index at = 1; error.empty() && at <= 2 * m_children[op[i]]; ++at) {
+               if (m_children[op[i] + at] >= text_count) {
+                  error = "text out of range";
+               }
+            }
+            break;
+         }
+         if (!error.empty())
+            return error;
+      }
+   }
+   return {};
+}
+
+mb::u64 flat_tree::compute_hash(flat_index index) const {
+   auto node = this->node(index);
+   const auto *op = node.operands;
+   mb::u64 h = mix(static_cast<mb::u64>(node.kind), node.flags);
+   switch (node.kind) {
+   case flat_kind::foreign_expression:
+      return mix(h, m_foreign_expressions[op[0]]->fingerprint());
+   case flat_kind::foreign_statement:
+      return mix(h, m_foreign_statements[op[0]]->fingerprint());
+   case flat_kind::foreign_definable:
+      return mix(h, m_foreign_definables[op[0]]->fingerprint());
+   case flat_kind::foreign_member:
+      return mix(h, m_foreign_members[op[0]]->fingerprint());
+   default:
+      break;
+   }
+
+   auto operands = layout(node.kind);
+   for (std::size_t i = 0; i < operands.size(); ++i) {
+      switch (operands[i]) {
+      case operand::none:
+         break;
+      case operand::number:
+         h = mix(h, op[i]);
+         break;
+      case operand::node:
+         h = mix(h, hash(op[i]));
+         break;
+      case operand::text:
+         h = mix(h, content_hash(text(op[i])));
+         break;
+      case operand::nodes:
+         h = mix(h, hash_list(op[i]));
+         break;
+      case operand::arguments: {
+         auto count = m_children[op[i]];
+         h = mix(h, count);
+         for (flat_index at = 1; at <= 2 * count; ++at) {
+            h = mix(h, content_hash(text(m_children[op[i] + at])));
+         }
+         break;
+      }
+      }
+   }
+   return h;
+}
+
+void flat_tree::write_expression(writer &w, flat_index index) const {
+   write_node(w, index, false);
+}
+
+void flat_tree::write_statement(writer &w, flat_index index) const {
+   write_node(w, index, false);
+}
+
+void flat_tree::write_declaration(writer &w, flat_index index) const {
+   write_node(w, index, false);
+}
+
+void flat_tree::write_definition(writer &w, flat_index index) const {
+   write_node(w, index, true);
+}
+
+void flat_tree::write_nodes(writer &w, flat_index list, bool definition) const {
+   auto count = m_children[list];
+   for (flat_index i = 1; i <= count; ++i) {
+      write_node(w, m_children[list + i], definition);
+   }
+}
+
+void flat_tree::write_separated(writer &w, flat_index list) const {
+   auto count = m_children[list];
+   if (count == 0)
+      return;
+   w.begin_group();
+   for (flat_index i = 1; i <= count; ++i) {
+      if (i != 1) {
+         w.write(",");
+         w.soft_break();
+      }
+      write_node(w, m_children[list + i], false);
+   }
+   w.end_group();
+}
+
+void flat_tree::write_arguments(writer &w, flat_index list) const {
+   auto count = m_children[list];
+   if (count == 0)
+      return;
+   w.begin_group();
+   for (flat_index i = 0; i < count; ++i) {
+      if (i != 0) {
+         w.write(",");
+         w.soft_break();
+      }
+      w.write("{} {}", text(m_children[list + 1 + 2 * i]), text(m_children[list + 2 + 2 * i]));
+   }
+   w.end_group();
+}
+
+void flat_tree::write_includes(writer &w, flat_index list) const {
+   auto count = m_children[list];
+   for (flat_index i = 1; i <= count; ++i) {
+      auto inc = this->node(m_children[list + i]);
+      if (inc.flags & flat_flag::local) {
+         w.write("#include \"{}\"\n", text(inc.operands[0]));
+      } else {
+         w.write("#include <{}>\n", text(inc.operands[0]));
+      }
+   }
+}
+
+void flat_tree::write_block(writer &w, flat_index list) const {
+   w.indent_in();
+   write_nodes(w, list, false);
+   w.indent_out();
+   w.put_indent();
+}
+
+void flat_tree::write_node(writer &w, flat_index index, bool definition) const {
+   auto *memo = w.memo();
+   // expressions start mid line, their layout depends on the column when lines are broken
+   auto kind = node(index).kind;
+   if (memo == nullptr || m_hashes.size() != m_nodes.size() || kind > flat_kind::ranged_for ||
+       (kind < flat_kind::expr && w.style().column_limit != 0) || w.style().origins != origin_mode::none ||
+       m_sizes[index] < memo->min_nodes()) {
+      render_node(w, index, definition);
+      return;
+   }
+
+   auto indent = w.indent();
+   if (const auto *text = memo->find(m_hashes[index], indent, w.style()); text != nullptr) {
+      w.write(*text);
+      return;
+   }
+   writer part;
+   part.set_indent(indent);
+   part.set_style(w.style());
+   part.set_memo(memo);
+   render_node(part, index, definition);
+   w.write(part.view());
+   memo->store(m_hashes[index], indent, w.style(), part.str());
+}
+
+void flat_tree::render_node(writer &w, flat_index index, bool definition) const {
+   auto node = this->node(index);
+   const auto *op = node.operands;
+   switch (node.kind) {
+   case flat_kind::raw:
+      w.write(text(op[0]));
+      break;
+   case flat_kind::call:
+      write_node(w, op[0], false);
+      w.write("(");
+      write_separated(w, op[1]);
+      w.write(")");
+      break;
+   case flat_kind::method_call:
+      if (auto object = this->node(op[0]); object.kind == flat_kind::deref) {
+         write_node(w, object.operands[0], false);
+         w.write("->");
+      } else {
+         write_node(w, op[0], false);
+         w.write(".");
+      }
+      w.write(text(op[1]));
+      w.write("(");
+      write_separated(w, op[2]);
+      w.write(")");
+      break;
+   case flat_kind::assign:
+      w.write("{} = ", text(op[0]));
+      write_node(w, op[1], false);
+      break;
+   case flat_kind::binary_operator:
+      w.begin_group();
+      write_node(w, op[0], false);
+      w.write(" {}", text(op[1]));
+      w.soft_break();
+      write_node(w, op[2], false);
+      w.end_group();
+      break;
+   case flat_kind::items: {
+      w.write("\n");
+      w.indent_in();
+      auto count = m_children[op[0]];
+      for (flat_index i = 1; i <= count; ++i) {
+         w.put_indent();
+         write_node(w, m_children[op[0] + i], false);
+         w.write(",\n");
+      }
+      w.indent_out();
+      break;
+   }
+   case flat_kind::struct_constructor:
+      w.write("{");
+      write_separated(w, op[0]);
+      w.write("}");
+      break;
+   case flat_kind::deref:
+      w.write("*");
+      write_node(w, op[0], false);
+      break;
+   case flat_kind::lambda:
+      w.write("[");
+      write_separated(w, op[0]);
+      w.write("](");
+      write_arguments(w, op[1]);
+      w.write(") {\n");
+      write_block(w, op[2]);
+      w.write("}");
+      break;
+   case flat_kind::expr:
+      w.put_indent();
+      write_node(w, op[0], false);
+      w.write(";\n");
+      break;
+   case flat_kind::if_statement: {
+      auto has_then = m_children[op[1]] != 0;
+      auto has_else = m_children[op[2]] != 0;
+      if (!has_then && !has_else)
+         break;
+      w.put_indent();
+      w.write("if ");
+      if (node.flags & flat_flag::is_constexpr) {
+         w.write("constexpr ");
+      }
+      if (!has_then) {
+         w.write("(!");
+         write_node(w, op[0], false);
+         w.write(")");
+         w.open_brace();
+         write_block(w, op[2]);
+         w.write("}\n");
+         break;
+      }
+      w.write("(");
+      write_node(w, op[0], false);
+      w.write(")");
+      w.open_brace();
+      write_block(w, op[1]);
+      w.write("}");
+      if (has_else) {
+         w.open_else();
+         w.open_brace();
+         write_block(w, op[2]);
+         w.write("}\n");
+      } else {
+         w.write("\n");
+      }
+      break;
+   }
+   case flat_kind::if_switch: {
+      auto count = m_children[op[0]];
+      for (flat_index i = 1; i <= count; ++i) {
+         auto if_case = this->node(m_children[op[0] + i]);
+         if (i == 1) {
+            w.put_indent();
+            w.write("if (");
+         } else {
+            w.open_else();
+            w.write(" if (");
+         }
+         write_node(w, if_case.operands[0], false);
+         w.write(")");
+         w.open_brace();
+         write_block(w, if_case.operands[1]);
+         w.write("}");
+      }
+      w.write("\n");
+      break;
+   }
+   case flat_kind::switch_statement: {
+      if (m_children[op[1]] == 0)
+         break;
+      w.put_indent();
+      w.write("switch (");
+      write_node(w, op[0], false);
+      w.write(")");
+      w.open_brace();
+      auto count = m_children[op[1]];
+      for (flat_index i = 1; i <= count; ++i) {
+         auto switch_case = this->node(m_children[op[1] + i]);
+         auto scoped = (switch_case.flags & flat_flag::scoped) != 0;
+         w.put_indent();
+         w.write("case ");
+         write_node(w, switch_case.operands[0], false);
+         w.write(scoped ? ": {\n" : ":\n");
+         w.indent_in();
+         write_nodes(w, switch_case.operands[1], false);
+         w.indent_out();
+         if (scoped) {
+            w.put_indent();
+            w.write("}\n");
+         }
+      }
+      if (m_children[op[2]] != 0) {
+         auto scoped = (node.flags & flat_flag::scoped) != 0;
+         w.put_indent();
+         w.write(scoped ? "default: {\n" : "default: \n");
+         w.indent_in();
+         write_nodes(w, op[2], false);
+         w.indent_out();
+         if (scoped) {
+            w.put_indent();
+            w.write("}\n");
+         }
+      }
+      w.put_indent();
+      w.write("}\n");
+      break;
+   }
+   case flat_kind::return_statement:
+      w.put_indent();
+      w.write("return");
+      if (op[0] != flat_none) {
+         w.write(" ");
+         write_node(w, op[0], false);
+      }
+      w.write(";\n");
+      break;
+   case flat_kind::for_statement:
+      w.put_indent();
+      w.write("for (");
+      write_node(w, op[0], false);
+      w.write("; ");
+      write_node(w, op[1], false);
+      w.write("; ");
+      write_node(w, op[2], false);
+      w.write(")");
+      w.open_brace();
+      write_block(w, op[3]);
+      w.write("}\n");
+      break;
+   case flat_kind::ranged_for:
+      w.put_indent();
+      w.write("for ({} {} : ", text(op[0]), text(op[1]));
+      write_node(w, op[2], false);
+      w.write(")");
+      w.open_brace();
+      write_block(w, op[3]);
+      w.write("}\n");
+      break;
+   case flat_kind::globalvar:
+      if (definition) {
+         w.put_indent();
+         w.write("{} {} = ", text(op[0]), text(op[1]));
+         write_node(w, op[2], false);
+         w.write(";\n");
+      } else {
+         w.line("extern {} {};", text(op[0]), text(op[1]));
+      }
+      break;
+   case flat_kind::function:
+      w.put_indent();
+      w.write("{} {}(", text(op[0]), text(op[1]));
+      write_arguments(w, op[2]);
+      if (definition) {
+         w.write(")");
+         w.open_brace();
+         write_block(w, op[3]);
+         w.write("}\n");
+         w.blank_line();
+      } else {
+         w.write(");\n");
+      }
+      break;
+   case flat_kind::template_arguments:
+      if (definition)
+         break;
+      w.put_indent();
+      w.write("template<");
+      write_arguments(w, op[0]);
+      w.write(">\n");
+      write_node(w, op[1], true);
+      break;
+   case flat_kind::class_spec: {
+      if (definition) {
+         write_nodes(w, op[3], true);
+         write_nodes(w, op[2], true);
+         break;
+      }
+      auto constant = text(op[1]);
+      if (!constant.empty()) {
+         w.write("#ifndef {}\n#define {}\n", constant, constant);
+      }
+      w.put_indent();
+      w.write("class {}", text(op[0]));
+      w.open_brace();
+      w.indent_in();
+      write_nodes(w, op[2], false);
+      w.indent_out();
+      w.write(" public:\n");
+      w.indent_in();
+      write_nodes(w, op[3], false);
+      w.indent_out();
+      w.put_indent();
+      w.write("};\n");
+      if (!constant.empty()) {
+         w.write("#endif//{}\n", constant);
+      }
+      w.blank_line();
+      break;
+   }
+   case flat_kind::attribute:
+      if (definition)
+         break;
+      w.put_indent();
+      if (node.flags & flat_flag::default_constr) {
+         w.write("{} {}{};\n", text(op[0]), text(op[1]), "{}");
+      } else {
+         w.write("{} {};\n", text(op[0]), text(op[1]));
+      }
+      break;
+   case flat_kind::method:
+      w.put_indent();
+      if (definition) {
+         w.write("{} {}::{}(", text(op[0]), text(op[1]), text(op[2]));
+      } else {
+         w.write("{} {}(", text(op[0]), text(op[2]));
+      }
+      write_arguments(w, op[3]);
+      w.write(node.flags & flat_flag::is_const ? ") const" : ")");
+      if (definition) {
+         w.open_brace();
+         write_block(w, op[4]);
+         w.write("}\n");
+         w.blank_line();
+      } else {
+         w.write(";\n");
+      }
+      break;
+   case flat_kind::method_template:
+      if (definition)
+         break;
+      w.blank_line();
+      w.put_indent();
+      w.write("template<");
+      write_arguments(w, op[2]);
+      w.write(">\n");
+      w.put_indent();
+      w.write("{} {}(", text(op[0]), text(op[1]));
+      write_arguments(w, op[3]);
+      w.write(node.flags & flat_flag::is_const ? ") const" : ")");
+      w.open_brace();
+      write_block(w, op[4]);
+      w.write("}\n");
+      w.blank_line();
+      break;
+   case flat_kind::static_method:
+      w.put_indent();
+      if (definition) {
+         w.write("{} {}::{}(", text(op[0]), text(op[1]), text(op[2]));
+         write_arguments(w, op[3]);
+         w.write(")");
+         w.open_brace();
+         write_block(w, op[4]);
+         w.write("}\n");
+         w.blank_line();
+      } else {
+         w.write("static {} {}(", text(op[0]), text(op[2]));
+         write_arguments(w, op[3]);
+         w.write(");\n");
+      }
+      break;
+   case flat_kind::default_constructor:
+      if (definition)
+         break;
+      w.put_indent();
+      w.write("{}() = default;\n", text(op[0]));
+      break;
+   case flat_kind::constructor:
+      w.put_indent();
+      if (definition) {
+         w.write("{}::{}(", text(op[0]), text(op[0]));
+         write_arguments(w, op[1]);
+         w.write(")");
+         w.open_brace();
+         write_block(w, op[2]);
+         w.write("}\n");
+         w.blank_line();
+      } else {
+         w.write("{}(", text(op[0]));
+         write_arguments(w, op[1]);
+         w.write(");\n");
+      }
+      break;
+   case flat_kind::static_attribute:
+      w.put_indent();
+      if (definition) {
+         w.write("{} {}::{} {}", text(op[1]), text(op[0]), text(op[2]), "{");
+         write_node(w, op[3], false);
+         w.write("};\n");
+         w.blank_line();
+      } else {
+         w.write("static {} {};\n", text(op[1]), text(op[2]));
+      }
+      break;
+   case flat_kind::located_statement:
+   case flat_kind::located_definable: {
+      auto previous = w.origin();
+      w.set_origin(source_origin{text(op[0]), op[1]});
+      write_node(w, op[2], definition);
+      w.set_origin(previous);
+      break;
+   }
+   case flat_kind::component:
+      assert(false && "components are written with write_header and write_source");
+      break;
+   case flat_kind::if_case:
+   case flat_kind::switch_case:
+      assert(false && "cases are written by their enclosing if or switch statement");
+      break;
+   case flat_kind::include:
+      break;
+   case flat_kind::foreign_expression:
+      m_foreign_expressions[op[0]]->write_expression(w);
+      break;
+   case flat_kind::foreign_statement:
+      m_foreign_statements[op[0]]->write_statement(w);
+      break;
+   case flat_kind::foreign_definable:
+      if (definition) {
+         m_foreign_definables[op[0]]->write_definition(w);
+      } else {
+         m_foreign_definables[op[0]]->write_declaration(w);
+      }
+      break;
+   case flat_kind::foreign_member:
+      if (definition) {
+         m_foreign_members[op[0]]->write_definition(w);
+      } else {
+         m_foreign_members[op[0]]->write_declaration(w);
+      }
+      break;
+   }
+}
+
+void flat_tree::write_header(writer &w) const {
+   assert(m_root != flat_none && node(m_root).kind == flat_kind::component);
+   const auto *op = node(m_root).operands;
+   auto ns = text(op[0]);
+   auto header_constant = text(op[1]);
+
+   if (!header_constant.empty()) {
+      w.write("#ifndef {}\n#define {}\n", header_constant, header_constant);
+   } else {
+      w.write("#pragma once\n");
+   }
+   write_includes(w, op[2]);
+
+   w.blank_line();
+   if (!ns.empty()) {
+      w.write("namespace {} {}\n", ns, "{");
+      w.blank_line();
+   }
+   write_nodes(w, op[4], false);
+   if (!ns.empty()) {
+      w.write("}\n");
+   }
+
+   if (!header_constant.empty()) {
+      w.write("#endif//{}\n", header_constant);
+   }
+}
+
+void flat_tree::write_source(writer &w) const {
+   assert(m_root != flat_none && node(m_root).kind == flat_kind::component);
+   const auto *op = node(m_root).operands;
+   auto ns = text(op[0]);
+
+   write_includes(w, op[3]);
+
+   w.blank_line();
+   if (!ns.empty()) {
+      w.write("namespace {} {}\n", ns, "{");
+      w.blank_line();
+   }
+   write_nodes(w, op[4], true);
+   if (!ns.empty()) {
+      w.write("}");
+   }
+}
+
+std::string flat_tree::size_label(flat_index index) const {
+   auto node = this->node(index);
+   const auto *op = node.operands;
+   switch (node.kind) {
+   case flat_kind::globalvar: return fmt::format("globalvar {}", text(op[1]));
+   case flat_kind::function: return fmt::format("function {}", text(op[1]));
+   case flat_kind::template_arguments: return fmt::format("template {}", size_label(op[1]));
+   case flat_kind::class_spec: return fmt::format("class {}", text(op[0]));
+   case flat_kind::attribute: return fmt::format("attribute {}", text(op[1]));
+   case flat_kind::method: return fmt::format("method {}::{}", text(op[1]), text(op[2]));
+   case flat_kind::method_template: return fmt::format("method_template {}", text(op[1]));
+   case flat_kind::static_method: return fmt::format("static_method {}::{}", text(op[1]), text(op[2]));
+   case flat_kind::default_constructor: return fmt::format("default_constructor {}", text(op[0]));
+   case flat_kind::constructor: return fmt::format("constructor {}", text(op[0]));
+   case flat_kind::static_attribute: return fmt::format("static_attribute {}::{}", text(op[0]), text(op[2]));
+   case flat_kind::foreign_member: return "member";
+   default: return "definable";
+   }
+}
+
+std::size_t flat_tree::count_statements(flat_index index) const {
+   if (index == flat_none)
+      return 0;
+   auto node = this->node(index);
+   // cases are parts of their statement rather than statements of their own
+   std::size_t count = (node.kind >= flat_kind::expr && node.kind <= flat_kind::ranged_for &&
+                        node.kind != flat_kind::if_case && node.kind != flat_kind::switch_case) ||
+                       node.kind == flat_kind::foreign_statement;
+   auto operands = layout(node.kind);
+   for (std::size_t i = 0; i < operands.size(); ++i) {
+      if (operands[i] == operand::node) {
+         count += count_statements(node.operands[i]);
+      } else if (operands[i] == operand::nodes) {
+         count += count_statement_list(node.operands[i]);
+      }
+   }
+   return count;
+}
+
+std::size_t flat_tree::count_statement_list(flat_index list) const {
+   std::size_t count{};
+   for (flat_index i = 1; i <= m_children[list]; ++i) {
+      count += count_statements(m_children[list + i]);
+   }
+   return count;
+}
+
+void flat_tree::count_emitted(code_size &size, flat_index index, bool definition) const {
+   auto node = this->node(index);
+   const auto *op = node.operands;
+   switch (node.kind) {
+   case flat_kind::function:
+      if (definition)
+         size.statements += count_statement_list(op[3]);
+      break;
+   case flat_kind::template_arguments:
+      if (!definition) {
+         ++size.templates;
+         count_emitted(size, op[1], true);
+      }
+      break;
+   case flat_kind::class_spec:
+      for (auto list : {op[2], op[3]}) {
+         for (flat_index i = 1; i <= m_children[list]; ++i) {
+            count_emitted(size, m_children[list + i], definition);
+         }
+      }
+      break;
+   case flat_kind::method:
+   case flat_kind::static_method:
+      if (definition)
+         size.statements += count_statement_list(op[4]);
+      break;
+   case flat_kind::method_template:
+      if (!definition) {
+         ++size.templates;
+         size.statements += count_statement_list(op[4]);
+      }
+      break;
+   case flat_kind::constructor:
+      if (definition)
+         size.statements += count_statement_list(op[2]);
+      break;
+   default:
+      break;
+   }
+}
+
+code_size flat_tree::measure_node(const writer_style &style, flat_index index, bool definition, mb::u32 indent) const {
+   writer w;
+   w.set_style(style);
+   w.set_indent(indent);
+   write_node(w, index, definition);
+   auto text = w.view();
+   code_size size{text.size(), static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n'))};
+   count_emitted(size, index, definition);
+   return size;
+}
+
+void flat_tree::measure_entry(size_report &report, const size_budget &budget, const writer_style &style, flat_index index, std::size_t depth, mb::u32 indent, bool header_definition) const {
+   if (node(index).kind == flat_kind::located_definable) {
+      measure_entry(report, budget, style, node(index).operands[2], depth, indent, header_definition);
+      return;
+   }
+   // a definable wrapped in template_arguments is emitted whole into the header
+   size_entry entry;
+   entry.label = size_label(index);
+   entry.depth = depth;
+   entry.header = measure_node(style, index, header_definition, indent);
+   if (!header_definition) {
+      entry.source = measure_node(style, index, true, 0);
+   }
+   entry.over_budget = budget.exceeded_by(entry.total());
+   report.entries.push_back(std::move(entry));
+
+   auto node = this->node(index);
+   const auto *op = node.operands;
+   if (node.kind == flat_kind::class_spec) {
+      for (auto list : {op[2], op[3]}) {
+         for (flat_index i = 1; i <= m_children[list]; ++i) {
+            measure_entry(report, budget, style, m_children[list + i], depth + 1, indent + 1, header_definition);
+         }
+      }
+   } else if (node.kind == flat_kind::template_arguments && !header_definition) {
+      measure_entry(report, budget, style, op[1], depth + 1, indent, true);
+   }
+}
+
+size_report flat_tree::measure(const size_budget &budget, const writer_style &style) const {
+   assert(m_root != flat_none && node(m_root).kind == flat_kind::component);
+   size_report report;
+   auto elements = node(m_root).operands[4];
+   for (flat_index i = 1; i <= m_children[elements]; ++i) {
+      auto at = report.entries.size();
+      measure_entry(report, budget, style, m_children[elements + i], 0, 0, false);
+      report.header += report.entries[at].header;
+      report.source += report.entries[at].source;
+   }
+   return report;
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,164 @@
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <mb/codegen/file.h>
+#include <mb/codegen/flat.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+
+namespace mb::codegen {
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<flat_text> && std::is_standard_layout_v<flat_text>);
+
+constexpr std::array<char, 4> g_magic{'M', 'B', 'F', 'T'};
+constexpr mb::u32 g_byte_order = 0x01020304;
+constexpr std::size_t g_section_alignment = 8;
+
+// file_header - start of a saved tree, followed by the node, children, text and text data sections,
+// each section starts at a multiple of g_section_alignment, the node section holds node_words words of node records
+struct file_header {
+   std::array<char, 4> magic;
+   mb::u32 version;
+   mb::u32 byte_order;
+   flat_index root;
+   mb::u64 node_count;
+   mb::u64 node_words;
+   mb::u64 children_count;
+   mb::u64 text_count;
+   mb::u64 text_bytes;
+};
+
+constexpr std::size_t aligned(std::size_t offset) {
+   return (offset + g_section_alignment - 1) / g_section_alignment * g_section_alignment;
+}
+
+struct layout {
+   std::size_t nodes;
+   std::size_t children;
+   std::size_t texts;
+   std::size_t text_data;
+   std::size_t end;
+
+   explicit layout(const file_header &header) {
+      nodes = aligned(sizeof(file_header));
+      children = aligned(nodes + header.node_words * sizeof(flat_index));
+      texts = aligned(children + header.children_count * sizeof(flat_index));
+      text_data = aligned(texts + header.text_count * sizeof(flat_text));
+      end = text_data + header.text_bytes;
+   }
+};
+
+template<typename T>
+void put_section(std::string &image, std::size_t offset, std::span<const T> values) {
+   if (!values.empty()) {
+      std::memcpy(image.data() + offset, values.data(), values.size_bytes());
+   }
+}
+
+[[noreturn]] void invalid_image(std::string_view reason) {
+   throw std::runtime_error(fmt::format("invalid flat tree image: {}", reason));
+}
+
+}// namespace
+
+std::string flat_tree::serialize() const {
+   if (!m_foreign_expressions.empty() || !m_foreign_statements.empty() ||
+       !m_foreign_definables.empty() || !m_foreign_members.empty()) {
+      throw std::invalid_argument("flat tree with foreign nodes cannot be serialized");
+   }
+
+   file_header header{g_magic, format_version, g_byte_order, m_root,
+                      m_node_count, m_nodes.size(), m_children.size(), m_texts.size(), m_text_data.size()};
+   layout at(header);
+   std::string image(at.end, '\0');
+   std::memcpy(image.data(), &header, sizeof(header));
+   put_section(image, at.nodes, m_nodes);
+   put_section(image, at.children, m_children);
+   put_section(image, at.texts, m_texts);
+   put_section(image, at.text_data, std::span<const char>(m_text_data.data(), m_text_data.size()));
+   return image;
+}
+
+bool flat_tree::save(const std::filesystem::path &path) const {
+   return write_if_changed(path, serialize());
+}
+
+flat_tree flat_tree::view(std::string_view image) {
+   if (image.size() < sizeof(file_header))
+      invalid_image("truncated header");
+   if (reinterpret_cast<std::uintptr_t>(image.data()) % g_section_alignment != 0)
+      invalid_image("misaligned data");
+
+   file_header header{};
+   std::memcpy(&header, image.data(), sizeof(header));
+   if (header.magic != g_magic)
+      invalid_image("bad magic");
+   if (header.byte_order != g_byte_order)
+      invalid_image("different byte order");
+   if (header.version != format_version)
+      invalid_image(fmt::format("version {}, expected {}", header.version, format_version));
+
+   // counts are checked one by one first so the section offsets cannot overflow
+   for (auto count : {header.node_count, header.node_words, header.children_count, header.text_count, header.text_bytes}) {
+      if (count > image.size())
+         invalid_image("truncated sections");
+   }
+   layout at(header);
+   if (at.end > image.size())
+      invalid_image("truncated sections");
+
+   flat_tree tree;
+   tree.m_root = header.root;
+   tree.m_nodes = {reinterpret_cast<const flat_index *>(image.data() + at.nodes), header.node_words};
+   tree.m_node_count = header.node_count;
+   tree.m_children = {reinterpret_cast<const flat_index *>(image.data() + at.children), header.children_count};
+   tree.m_texts = {reinterpret_cast<const flat_text *>(image.data() + at.texts), header.text_count};
+   tree.m_text_data = image.substr(at.text_data, header.text_bytes);
+   for (const auto &t : tree.m_texts) {
+      if (static_cast<mb::u64>(t.offset) + t.size > header.text_bytes)
+         invalid_image("text out of range");
+   }
+   if (auto error = tree.check_operands(); !error.empty())
+      invalid_image(error);
+   return tree;
+}
+
+flat_tree flat_tree::map(const std::filesystem::path &path) {
+   auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+      throw std::system_error(errno, std::generic_category(), fmt::format("could not open {}", path.string()));
+
+   struct stat st {};
+   if (::fstat(fd, &st) != 0) {
+      auto error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), fmt::format("could not stat {}", path.string()));
+   }
+   auto size = static_cast<std::size_t>(st.st_size);
+   if (size == 0) {
+      ::close(fd);
+      invalid_image("empty file");
+   }
+
+   auto *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   auto error = errno;
+   ::close(fd);
+   if (mapped == MAP_FAILED)
+      throw std::system_error(error, std::generic_category(), fmt::format("could not map {}", path.string()));
+
+   std::shared_ptr<const void> mapping(mapped, [size](const void *ptr) {
+      ::munmap(const_cast<void *>(ptr), size);
+   });
+   auto tree = view(std::string_view(static_cast<const char *>(mapped), size));
+   tree.m_mapping = std::move(mapping);
+   return tree;
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <fmt/format.h>
+#include <mb/codegen/instrument.h>
+#include <utility>
+
+namespace mb::codegen {
+
+namespace {
+
+constexpr std::array<std::string_view, 3> g_phase_names{"other", "generate", "write"};
+
+std::vector<const instrumentation::definable_stats *> largest_first(const std::vector<instrumentation::definable_stats> &definables) {
+   std::vector<const instrumentation::definable_stats *> result;
+   result.reserve(definables.size());
+   for (const auto &def : definables) {
+      result.push_back(&def);
+   }
+   std::stable_sort(result.begin(), result.end(), [](const auto *lhs, const auto *rhs) {
+      return lhs->bytes > rhs->bytes;
+   });
+   return result;
+}
+
+std::string json_string(std::string_view value) {
+   std::string result = "\"";
+   for (auto c : value) {
+      switch (c) {
+      case '"': result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n"; break;
+      case '\t': result += "\\t"; break;
+      default:
+         if (static_cast<unsigned char>(c) < 0x20) {
+            result += fmt::format("\\u{:04x}", static_cast<int>(c));
+         } else {
+            result.push_back(c);
+         }
+      }
+   }
+   result.push_back('"');
+   return result;
+}
+
+}// namespace
+
+instrumentation::instrumentation(std::string name) : m_name(std::move(name)) {}
+
+instrumentation::scope::scope(instrumentation &target) : m_previous(s_current) {
+   if constexpr (instrumentation_enabled) {
+      s_current = &target;
+      target.m_phase_start = std::chrono::steady_clock::now();
+   }
+}
+
+instrumentation::scope::~scope() noexcept {
+   if constexpr (instrumentation_enabled) {
+      s_current->switch_phase(phase::other);
+      s_current = m_previous;
+   }
+}
+
+void instrumentation::switch_phase(phase next) {
+   auto now = std::chrono::steady_clock::now();
+   m_times[static_cast<std::size_t>(m_phase)] += now - m_phase_start;
+   m_phase = next;
+   m_phase_start = now;
+}
+
+void instrumentation::count_node(std::string_view type, bool copy, std::size_t bytes) {
+   auto &counters = m_nodes[type];
+   if (copy) {
+      ++counters.copies;
+   } else {
+      ++counters.constructed;
+   }
+   ++m_node_allocations;
+   m_node_bytes += bytes;
+}
+
+void instrumentation::definable_written(std::string_view label, std::size_t bytes) {
+   if constexpr (instrumentation_enabled) {
+      if (s_current != nullptr) {
+         s_current->m_definables.push_back(definable_stats{std::string(label), bytes});
+      }
+   }
+}
+
+const std::string &instrumentation::name() const {
+   return m_name;
+}
+
+const std::map<std::string_view, instrumentation::node_counters, std::less<>> &instrumentation::nodes() const {
+   return m_nodes;
+}
+
+const std::vector<instrumentation::definable_stats> &instrumentation::definables() const {
+   return m_definables;
+}
+
+std::size_t instrumentation::node_allocations() const {
+   return m_node_allocations;
+}
+
+std::size_t instrumentation::node_bytes() const {
+   return m_node_bytes;
+}
+
+std::chrono::nanoseconds instrumentation::time(phase p) const {
+   return m_times[static_cast<std::size_t>(p)];
+}
+
+std::string instrumentation::text() const {
+   auto ms = [](std::chrono::nanoseconds t) {
+      return std::chrono::duration<double, std::milli>(t).count();
+   };
+
+   std::string out = fmt::format("instrumentation {}\n", m_name);
+   out += fmt::format("generate {:.3f} ms, write {:.3f} ms\n", ms(time(phase::generate)), ms(time(phase::write)));
+   out += fmt::format("node allocations {} ({} bytes)\n", m_node_allocations, m_node_bytes);
+   out += fmt::format("{:<24} {:>12} {:>12}\n", "node", "constructed", "copies");
+   for (const auto &[type, counters] : m_nodes) {
+      out += fmt::format("{:<24} {:>12} {:>12}\n", type, counters.constructed, counters.copies);
+   }
+   out += fmt::format("{:<60} {:>12}\n", "definable", "bytes");
+   for (const auto *def : largest_first(m_definables)) {
+      out += fmt::format("{:<60} {:>12}\n", def->label, def->bytes);
+   }
+   return out;
+}
+
+std::string instrumentation::json() const {
+   std::string out = fmt::format("{{\"name\":{},\"time_ns\":{{", json_string(m_name));
+   for (std::size_t p = 1; p < g_phase_names.size(); ++p) {
+      out += fmt::format("{}\"{}\":{}", p > 1 ? "," : "", g_phase_names[p], m_times[p].count());
+   }
+   out += fmt::format("}},\"node_allocations\":{},\"node_bytes\":{},\"nodes\":{{", m_node_allocations, m_node_bytes);
+   bool first = true;
+   for (const auto &[type, counters] : m_nodes) {
+      out += fmt::format("{}{}:{{\"constructed\":{},\"copies\":{}}}", first ? "" : ",", json_string(type), counters.constructed, counters.copies);
+      first = false;
+   }
+   out += "},\"definables\":[";
+   first = true;
+   for (const auto *def : largest_first(m_definables)) {
+      out += fmt::format("{}{{\"label\":{},\"bytes\":{}}}", first ? "" : ",", json_string(def->label), def->bytes);
+      first = false;
+   }
+   out += "]}";
+   return out;
+}
+
+}// namespace mb::codegen
@@ -4,57 +4,79 @@
 
 namespace mb::codegen {
 
-lambda::lambda(std::vector<arg> arguments, std::function<void(statement::collector &)> statement_gen) : m_arguments(std::move(arguments)),
-                                                                                                        m_statements([&statement_gen]() {
-                                                                                                           statement::collector col;
-                                                                                                           statement_gen(col);
-                                                                                                           return col.build();
-                                                                                                        }()) {}
-lambda::lambda(const lambda &other) : m_captures(other.m_captures.size()),
-                                      m_arguments(other.m_arguments),
-                                      m_statements(other.m_statements.size()) {
-   std::transform(other.m_captures.begin(), other.m_captures.end(), m_captures.begin(), [](const expression::ptr &cap) {
-      return cap->copy();
-   });
-   std::transform(other.m_statements.begin(), other.m_statements.end(), m_statements.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
-}
+lambda::state::state(node_vector<expression::ptr> captures, const std::vector<arg> &arguments, block body) : captures(std::move(captures)),
+                                                                                                             arguments(arguments.begin(), arguments.end()),
+                                                                                                             body(std::move(body)) {}
+
+lambda::state::state(const state &other) : captures(copy_nodes(other.captures)),
+                                           arguments(other.arguments),
+                                           body(other.body) {}
+
+lambda::lambda(std::vector<arg> arguments, statement::generator statement_gen) : m_state(std::in_place, node_vector<expression::ptr>(), arguments, block(statement_gen)) {}
+
+lambda::lambda(std::vector<arg> arguments, block body) : m_state(std::in_place, node_vector<expression::ptr>(), arguments, std::move(body)) {}
 
 void lambda::add_capture(const expression& cap) {
-   m_captures.emplace_back(cap.copy());
+   m_state.edit().captures.emplace_back(cap.copy());
+}
+
+void lambda::add_capture(expression::ptr cap) {
+   m_state.edit().captures.emplace_back(std::move(cap));
 }
 
 void lambda::write_expression(writer &w) const {
+   const auto &state = *m_state;
    w.write("[");
-   if (!m_captures.empty()) {
-      auto it_first_cap = m_captures.begin();
+   if (!state.captures.empty()) {
+      w.begin_group();
+      auto it_first_cap = state.captures.begin();
       (*it_first_cap)->write_expression(w);
-      std::for_each(it_first_cap+1, m_captures.end(), [&w](const expression::ptr &cap) {
-        w.write(", ");
+      std::for_each(it_first_cap+1, state.captures.end(), [&w](const expression::ptr &cap) {
+        w.write(",");
+        w.soft_break();
         cap->write_expression(w);
       });
+      w.end_group();
    }
    w.write("](");
-   if (!m_arguments.empty()) {
-      auto it_first = m_arguments.begin();
+   if (!state.arguments.empty()) {
+      w.begin_group();
+      auto it_first = state.arguments.begin();
       w.write("{} {}", it_first->type, it_first->name);
-      std::for_each(it_first + 1, m_arguments.end(), [&w](const arg &arg) {
-        w.write(", {} {}", arg.type, arg.name);
+      std::for_each(it_first + 1, state.arguments.end(), [&w](const arg &arg) {
+        w.write(",");
+        w.soft_break();
+        w.write("{} {}", arg.type, arg.name);
       });
+      w.end_group();
    }
    w.write(") {\n");
    w.indent_in();
-   std::for_each(m_statements.begin(), m_statements.end(), [&w](const statement::ptr &stmt) {
-     stmt->write_statement(w);
-   });
+   state.body.write(w);
    w.indent_out();
    w.put_indent();
    w.write("}");
 }
 
 expression::ptr lambda::copy() const {
-   return std::make_unique<lambda>(*this);
+   return make_node<lambda>(*this);
+}
+
+flat_index lambda::lower_expression(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::lambda);
+   b.set(node, 0, b.expressions(state.captures));
+   b.set(node, 1, b.arguments(state.arguments));
+   b.set(node, 2, b.statements(state.body.statements()));
+   return node;
+}
+
+mb::u64 lambda::state::fingerprint() const {
+   return structural_hash(flat_kind::lambda).nodes(captures).arguments(arguments).fingerprint(body.fingerprint());
+}
+
+mb::u64 lambda::fingerprint() const {
+   return m_state.fingerprint();
 }
 
-}// namespace mb::codegen
\ No newline at end of file
+}// namespace mb::codegen
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <fmt/format.h>
+#include <mb/codegen/origin.h>
+
+namespace mb::codegen {
+
+void source_map::add(mb::u32 line, mb::u32 column, const source_origin &origin) {
+   auto file = no_file;
+   if (!origin.empty()) {
+      auto [it, added] = m_file_index.try_emplace(std::string(origin.file), static_cast<mb::u32>(m_files.size()));
+      if (added) {
+         m_files.push_back(it->first);
+      }
+      file = it->second;
+   }
+   // a later origin at the same position replaces the earlier one, which covers no code
+   if (!m_entries.empty() && m_entries.back().line == line && m_entries.back().column == column) {
+      m_entries.pop_back();
+   }
+   m_entries.push_back(entry{line, column, file, origin.line});
+}
+
+void source_map::clear() {
+   m_files.clear();
+   m_file_index.clear();
+   m_entries.clear();
+}
+
+const std::vector<std::string> &source_map::files() const {
+   return m_files;
+}
+
+const std::vector<source_map::entry> &source_map::entries() const {
+   return m_entries;
+}
+
+source_origin source_map::find(mb::u32 line, mb::u32 column) const {
+   auto it = std::upper_bound(m_entries.begin(), m_entries.end(), std::pair{line, column}, [](const auto &at, const entry &e) {
+      return at < std::pair{e.line, e.column};
+   });
+   if (it == m_entries.begin())
+      return {};
+   --it;
+   if (it->file == no_file)
+      return {};
+   return source_origin{m_files[it->file], it->origin_line};
+}
+
+std::string source_map::text() const {
+   std::string out;
+   for (const auto &file : m_files) {
+      out += fmt::format("file {}\n", file);
+   }
+   for (const auto &e : m_entries) {
+      if (e.file == no_file) {
+         out += fmt::format("{}:{} -\n", e.line, e.column);
+      } else {
+         out += fmt::format("{}:{} {}:{}\n", e.line, e.column, e.file, e.origin_line);
+      }
+   }
+   return out;
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <charconv>
+#include <fmt/format.h>
+#include <mb/codegen/project.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mb::codegen {
+
+namespace {
+
+struct batch_result {
+   output_report files;
+   std::size_t bytes{};
+};
+
+// thread_writer - writer buffer reused by every batch running on the thread,
+// styled and named for the file it is about to write
+writer &thread_writer(const writer_style &style, const std::filesystem::path &path) {
+   thread_local writer w;
+   w.clear();
+   w.set_style(style);
+   w.set_output_name(path.generic_string());
+   return w;
+}
+
+template<typename Entries>
+batch_result write_batch(const Entries &entries, std::size_t begin, std::size_t end) {
+   batch_result result;
+   for (auto at = begin; at < end; ++at) {
+      auto &e = *entries[at];
+      std::optional<component> built;
+      auto &cmp = e.cmp ? *e.cmp : built.emplace(e.build());
+
+      auto &header = thread_writer(cmp.style(), e.header_path);
+      cmp.write_header(header);
+      result.bytes += header.view().size();
+      result.files.add(e.header_path, write_if_changed(e.header_path, header.view()));
+
+      auto &source = thread_writer(cmp.style(), e.source_path);
+      cmp.write_source(source);
+      result.bytes += source.view().size();
+      result.files.add(e.source_path, write_if_changed(e.source_path, source.view()));
+   }
+   return result;
+}
+
+bool parse_number(std::string_view text, mb::u32 &value) {
+   auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+   return error == std::errc() && end == text.data() + text.size();
+}
+
+}// namespace
+
+project_shard project_shard::parse(std::string_view spec) {
+   project_shard shard;
+   auto slash = spec.find('/');
+   if (slash == std::string_view::npos || !parse_number(spec.substr(0, slash), shard.index) ||
+       !parse_number(spec.substr(slash + 1), shard.count) || shard.count == 0 || shard.index >= shard.count)
+      throw std::invalid_argument(fmt::format("invalid shard \"{}\", expected index/count", spec));
+   return shard;
+}
+
+bool project_shard::owns(const std::filesystem::path &header_path) const {
+   if (count <= 1)
+      return true;
+   return content_hash(header_path.filename().string()) % count == index;
+}
+
+project::project(std::size_t batch_size) : m_batch_size(std::max<std::size_t>(1, batch_size)) {}
+
+component &project::add(component cmp, std::filesystem::path header_path, std::filesystem::path source_path) {
+   return *m_entries.emplace_back(entry{std::move(cmp), {}, std::move(header_path), std::move(source_path)}).cmp;
+}
+
+void project::add_lazy(std::function<component()> build, std::filesystem::path header_path, std::filesystem::path source_path) {
+   m_entries.emplace_back(entry{std::nullopt, std::move(build), std::move(header_path), std::move(source_path)});
+}
+
+std::size_t project::size() const {
+   return m_entries.size();
+}
+
+std::vector<project::entry *> project::select(project_shard shard) {
+   std::vector<entry *> selected;
+   for (auto &e : m_entries) {
+      if (shard.owns(e.header_path)) {
+         selected.push_back(&e);
+      }
+   }
+   return selected;
+}
+
+project_report project::write(thread_pool &pool) {
+   return write(project_shard{}, pool);
+}
+
+project_report project::write() {
+   return write(project_shard{});
+}
+
+project_report project::write(project_shard shard, thread_pool &pool) {
+   auto start = std::chrono::steady_clock::now();
+
+   auto entries = select(shard);
+   auto batch_count = (entries.size() + m_batch_size - 1) / m_batch_size;
+   std::vector<batch_result> results(batch_count);
+   {
+      task_group tasks(pool);
+      for (std::size_t batch = 0; batch < batch_count; ++batch) {
+         tasks.run([this, &entries, &results, batch] {
+            auto begin = batch * m_batch_size;
+            results[batch] = write_batch(entries, begin, std::min(begin + m_batch_size, entries.size()));
+         });
+      }
+      tasks.wait();
+   }
+
+   project_report report;
+   report.component_count = entries.size();
+   for (const auto &result : results) {
+      report.files.merge(result.files);
+      report.bytes += result.bytes;
+   }
+   report.file_count = report.files.written.size() + report.files.unchanged.size();
+   report.wall_time = std::chrono::steady_clock::now() - start;
+   return report;
+}
+
+project_report project::write(project_shard shard) {
+   auto start = std::chrono::steady_clock::now();
+   auto entries = select(shard);
+   auto result = write_batch(entries, 0, entries.size());
+
+   project_report report;
+   report.files = std::move(result.files);
+   report.component_count = entries.size();
+   report.file_count = report.files.written.size() + report.files.unchanged.size();
+   report.bytes = result.bytes;
+   report.wall_time = std::chrono::steady_clock::now() - start;
+   return report;
+}
+
+bool project::write_aggregate(const std::filesystem::path &path) const {
+   auto base = path.parent_path();
+   std::string contents = "#pragma once\n";
+   for (const auto &e : m_entries) {
+      contents += fmt::format("#include \"{}\"\n", e.header_path.lexically_relative(base).generic_string());
+   }
+   return write_if_changed(path, contents);
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mb/codegen/file.h>
+#include <mb/codegen/render_cache.h>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mb::codegen {
+
+namespace {
+
+constexpr std::string_view g_magic = "MBRC";
+
+template<typename T>
+void put(std::string &out, T value) {
+   char bytes[sizeof(T)];
+   std::memcpy(bytes, &value, sizeof(T));
+   out.append(bytes, sizeof(T));
+}
+
+// reader - bounds checked cursor over the cache file
+class reader {
+   std::string_view m_data;
+
+ public:
+   explicit reader(std::string_view data) : m_data(data) {}
+
+   template<typename T>
+   bool get(T &value) {
+      if (m_data.size() < sizeof(T))
+         return false;
+      std::memcpy(&value, m_data.data(), sizeof(T));
+      m_data.remove_prefix(sizeof(T));
+      return true;
+   }
+
+   bool get(std::string &value, std::size_t size) {
+      if (m_data.size() < size)
+         return false;
+      value.assign(m_data.substr(0, size));
+      m_data.remove_prefix(size);
+      return true;
+   }
+
+   [[nodiscard]] bool done() const {
+      return m_data.empty();
+   }
+};
+
+}// namespace
+
+bool render_cache::load(const std::filesystem::path &path) {
+   m_entries.clear();
+
+   std::ifstream file(path, std::ios::binary);
+   if (!file)
+      return false;
+   std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+   reader in(data);
+   std::string magic;
+   mb::u32 version{};
+   mb::u64 count{};
+   if (!in.get(magic, g_magic.size()) || magic != g_magic || !in.get(version) || version != format_version || !in.get(count))
+      return false;
+
+   for (mb::u64 i = 0; i < count; ++i) {
+      mb::u64 fingerprint{};
+      mb::u32 declaration_size{};
+      mb::u32 definition_size{};
+      entry contents;
+      if (!in.get(fingerprint) || !in.get(declaration_size) || !in.get(definition_size) ||
+          !in.get(contents.declaration, declaration_size) || !in.get(contents.definition, definition_size)) {
+         m_entries.clear();
+         return false;
+      }
+      m_entries.insert_or_assign(fingerprint, slot{std::move(contents)});
+   }
+   if (!in.done()) {
+      m_entries.clear();
+      return false;
+   }
+   return true;
+}
+
+bool render_cache::save(const std::filesystem::path &path) const {
+   std::string out(g_magic);
+   put(out, format_version);
+   auto count_at = out.size();
+   put(out, mb::u64{});
+
+   // entries are sorted so an unchanged cache is not rewritten
+   std::vector<mb::u64> used;
+   for (const auto &[fingerprint, s] : m_entries) {
+      if (s.used) {
+         used.push_back(fingerprint);
+      }
+   }
+   std::sort(used.begin(), used.end());
+
+   for (auto fingerprint : used) {
+      const auto &contents = m_entries.at(fingerprint).contents;
+      put(out, fingerprint);
+      put(out, static_cast<mb::u32>(contents.declaration.size()));
+      put(out, static_cast<mb::u32>(contents.definition.size()));
+      out.append(contents.declaration);
+      out.append(contents.definition);
+   }
+   auto count = static_cast<mb::u64>(used.size());
+   std::memcpy(out.data() + count_at, &count, sizeof(count));
+   return write_if_changed(path, out);
+}
+
+const render_cache::entry *render_cache::find(mb::u64 fingerprint) {
+   auto it = m_entries.find(fingerprint);
+   if (it == m_entries.end()) {
+      ++m_misses;
+      return nullptr;
+   }
+   ++m_hits;
+   it->second.used = true;
+   return &it->second.contents;
+}
+
+void render_cache::store(mb::u64 fingerprint, entry contents) {
+   m_entries.insert_or_assign(fingerprint, slot{std::move(contents), true});
+}
+
+std::size_t render_cache::size() const {
+   return m_entries.size();
+}
+
+std::size_t render_cache::hits() const {
+   return m_hits;
+}
+
+std::size_t render_cache::misses() const {
+   return m_misses;
+}
+
+double render_cache::hit_rate() const {
+   auto lookups = m_hits + m_misses;
+   if (lookups == 0)
+      return 0.0;
+   return static_cast<double>(m_hits) / static_cast<double>(lookups);
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,39 @@
+#include <cerrno>
+#include <mb/codegen/sink.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace mb::codegen {
+
+ostream_sink::ostream_sink(std::ostream &stream) : m_stream(stream) {}
+
+void ostream_sink::write(std::string_view data) {
+   m_stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+std::ostream &ostream_sink::stream() const {
+   return m_stream;
+}
+
+fd_sink::fd_sink(int fd) : m_fd(fd) {}
+
+void fd_sink::write(std::string_view data) {
+   while (!data.empty()) {
+      auto written = ::write(m_fd, data.data(), data.size());
+      if (written < 0) {
+         if (errno == EINTR)
+            continue;
+         throw std::system_error(errno, std::generic_category(), "fd_sink: write failed");
+      }
+      data.remove_prefix(static_cast<std::size_t>(written));
+   }
+}
+
+callback_sink::callback_sink(std::function<void(std::string_view)> callback) : m_callback(std::move(callback)) {}
+
+void callback_sink::write(std::string_view data) {
+   m_callback(data);
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,62 @@
+#include <fmt/format.h>
+#include <mb/codegen/size_report.h>
+
+namespace mb::codegen {
+
+namespace {
+
+bool exceeds(std::size_t limit, std::size_t value) {
+   return limit != 0 && value > limit;
+}
+
+}// namespace
+
+code_size &code_size::operator+=(const code_size &other) {
+   bytes += other.bytes;
+   lines += other.lines;
+   statements += other.statements;
+   templates += other.templates;
+   return *this;
+}
+
+code_size operator+(code_size lhs, const code_size &rhs) {
+   lhs += rhs;
+   return lhs;
+}
+
+bool size_budget::exceeded_by(const code_size &size) const {
+   return exceeds(bytes, size.bytes) || exceeds(lines, size.lines) ||
+          exceeds(statements, size.statements) || exceeds(templates, size.templates);
+}
+
+code_size size_entry::total() const {
+   return header + source;
+}
+
+std::vector<const size_entry *> size_report::over_budget() const {
+   std::vector<const size_entry *> result;
+   for (const auto &entry : entries) {
+      if (entry.over_budget) {
+         result.push_back(&entry);
+      }
+   }
+   return result;
+}
+
+std::string size_report::text() const {
+   auto row = [](std::string_view label, const code_size &h, const code_size &s) {
+      return fmt::format("{:<48} {:>10} {:>8} {:>10} {:>8} {:>10} {:>9}\n", label,
+                         h.bytes, h.lines, s.bytes, s.lines, h.statements + s.statements, h.templates + s.templates);
+   };
+
+   std::string out = fmt::format("{:<48} {:>10} {:>8} {:>10} {:>8} {:>10} {:>9}\n", "element",
+                                 "hdr bytes", "hdr lines", "src bytes", "src lines", "statements", "templates");
+   for (const auto &entry : entries) {
+      auto label = fmt::format("{}{}{}", entry.over_budget ? "! " : "  ", std::string(2 * entry.depth, ' '), entry.label);
+      out += row(label, entry.header, entry.source);
+   }
+   out += row("  total", header, source);
+   return out;
+}
+
+}// namespace mb::codegen
@@ -4,16 +4,43 @@
 
 namespace mb::codegen {
 
-expr::expr(const expression &expr) : m_expr(expr.copy()) {}
+node_vector<statement::ptr> statement::collect(statement::generator statement_gen) {
+   instrumentation::phase_scope generating(instrumentation::phase::generate);
+   statement::collector col;
+   statement_gen(col);
+   return col.build();
+}
+
+expr::state::state(expression::ptr expr) : expr(std::move(expr)) {}
+
+expr::state::state(const state &other) : expr(other.expr->copy()) {}
+
+expr::expr(const expression &expr) : m_state(std::in_place, expr.copy()) {}
+
+expr::expr(expression::ptr expr) : m_state(std::in_place, std::move(expr)) {}
 
 void expr::write_statement(writer &w) const {
    w.put_indent();
-   m_expr->write_expression(w);
+   m_state->expr->write_expression(w);
    w.write(";\n");
 }
 
 statement::ptr expr::copy() const {
-   return std::make_unique<expr>(*m_expr);
+   return make_node<expr>(*this);
+}
+
+flat_index expr::lower_statement(flat_builder &b) const {
+   auto node = b.add(flat_kind::expr);
+   b.set(node, 0, m_state->expr->lower_expression(b));
+   return node;
+}
+
+mb::u64 expr::state::fingerprint() const {
+   return structural_hash(flat_kind::expr).node(*expr);
+}
+
+mb::u64 expr::fingerprint() const {
+   return m_state.fingerprint();
 }
 
 statement::collector &statement::collector::operator<<(const statement &stmt) {
@@ -21,59 +48,62 @@ statement::collector &statement::collector::operator<<(const statement &stmt) {
    return *this;
 }
 
-
 statement::collector &statement::collector::operator<<(const expression &expre) {
-   m_statements.emplace_back(expr(expre).copy());
+   m_statements.emplace_back(make_node<expr>(expre));
    return *this;
 }
 
-std::vector<statement::ptr> statement::collector::build() {
+statement::collector &statement::collector::operator<<(statement::ptr stmt) {
+   m_statements.emplace_back(std::move(stmt));
+   return *this;
+}
+
+statement::collector &statement::collector::operator<<(expression::ptr expre) {
+   m_statements.emplace_back(make_node<expr>(std::move(expre)));
+   return *this;
+}
+
+node_vector<statement::ptr> statement::collector::build() {
    return std::move(m_statements);
 }
 
-if_statement::if_statement(const expression &condition, std::function<void(statement::collector &)> if_then) : m_condition(condition.copy()),
-                                                                                                               m_if_then([&if_then]() {
-                                                                                                                  statement::collector col;
-                                                                                                                  if_then(col);
-                                                                                                                  return col.build();
-                                                                                                               }()) {}
-
-if_statement::if_statement(const expression &condition, std::function<void(statement::collector &)> if_then, std::function<void(statement::collector &)> if_else) : m_condition(condition.copy()),
-                                                                                                                                                                    m_if_then([&if_then]() {
-                                                                                                                                                                       statement::collector col;
-                                                                                                                                                                       if_then(col);
-                                                                                                                                                                       return col.build();
-                                                                                                                                                                    }()),
-                                                                                                                                                                    m_if_else([&if_else]() {
-                                                                                                                                                                       statement::collector col;
-                                                                                                                                                                       if_else(col);
-                                                                                                                                                                       return col.build();
-                                                                                                                                                                    }()) {}
-if_statement::if_statement(const if_statement &other) : m_condition(other.m_condition->copy()),
-                                                        m_if_then(other.m_if_then.size()),
-                                                        m_if_else(other.m_if_else.size()),
-                                                        m_constexpr(other.m_constexpr) {
-   std::transform(other.m_if_then.begin(), other.m_if_then.end(), m_if_then.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
-   std::transform(other.m_if_else.begin(), other.m_if_else.end(), m_if_else.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+if_statement::state::state(expression::ptr condition, node_vector<statement::ptr> if_then, node_vector<statement::ptr> if_else) : condition(std::move(condition)),
+                                                                                                                                  if_then(std::move(if_then)),
+                                                                                                                                  if_else(std::move(if_else)) {}
+
+if_statement::state::state(const state &other) : condition(other.condition->copy()),
+                                                 if_then(copy_nodes(other.if_then)),
+                                                 if_else(copy_nodes(other.if_else)),
+                                                 is_constexpr(other.is_constexpr) {}
+
+if_statement::if_statement(const expression &condition, statement::generator if_then) : if_statement(condition.copy(), if_then) {}
+
+if_statement::if_statement(const expression &condition, statement::generator if_then, statement::generator if_else) : if_statement(condition.copy(), if_then, if_else) {}
+
+if_statement::if_statement(expression::ptr condition, statement::generator if_then) : m_state(std::in_place, std::move(condition), collect(if_then), node_vector<statement::ptr>()) {}
+
+if_statement::if_statement(expression::ptr condition, statement::generator if_then, statement::generator if_else) : m_state(std::in_place, std::move(condition), collect(if_then), collect(if_else)) {}
+
+if_statement &if_statement::with_constexpr() {
+   m_state.edit().is_constexpr = true;
+   return *this;
 }
 
 void if_statement::write_statement(writer &w) const {
-   if (m_if_then.empty()) {
-      if (!m_if_else.empty()) {
+   const auto &state = *m_state;
+   if (state.if_then.empty()) {
+      if (!state.if_else.empty()) {
          w.put_indent();
          w.write("if ");
-         if (m_constexpr) {
+         if (state.is_constexpr) {
             w.write("constexpr ");
          }
          w.write("(!");
-         m_condition->write_expression(w);
-         w.write(") {\n");
+         state.condition->write_expression(w);
+         w.write(")");
+         w.open_brace();
          w.indent_in();
-         std::for_each(m_if_else.begin(), m_if_else.end(), [&w](const statement::ptr &stmt) {
+         std::for_each(state.if_else.begin(), state.if_else.end(), [&w](const statement::ptr &stmt) {
             stmt->write_statement(w);
          });
          w.indent_out();
@@ -84,23 +114,25 @@ void if_statement::write_statement(writer &w) const {
    }
    w.put_indent();
    w.write("if ");
-   if (m_constexpr) {
+   if (state.is_constexpr) {
       w.write("constexpr ");
    }
    w.write("(");
-   m_condition->write_expression(w);
-   w.write(") {\n");
+   state.condition->write_expression(w);
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_if_then.begin(), m_if_then.end(), [&w](const statement::ptr &stmt) {
+   std::for_each(state.if_then.begin(), state.if_then.end(), [&w](const statement::ptr &stmt) {
       stmt->write_statement(w);
    });
    w.indent_out();
    w.put_indent();
    w.write("}");
-   if (!m_if_else.empty()) {
-      w.write(" else {\n");
+   if (!state.if_else.empty()) {
+      w.open_else();
+      w.open_brace();
       w.indent_in();
-      std::for_each(m_if_else.begin(), m_if_else.end(), [&w](const statement::ptr &stmt) {
+      std::for_each(state.if_else.begin(), state.if_else.end(), [&w](const statement::ptr &stmt) {
          stmt->write_statement(w);
       });
       w.indent_out();
@@ -112,47 +144,66 @@ void if_statement::write_statement(writer &w) const {
 }
 
 statement::ptr if_statement::copy() const {
-   return std::make_unique<if_statement>(*this);
+   return make_node<if_statement>(*this);
 }
 
-switch_statement::switch_statement(const expression &value) : m_value(value.copy()) {}
+flat_index if_statement::lower_statement(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::if_statement, state.is_constexpr ? flat_flag::is_constexpr : 0);
+   b.set(node, 0, state.condition->lower_expression(b));
+   b.set(node, 1, b.statements(state.if_then));
+   b.set(node, 2, b.statements(state.if_else));
+   return node;
+}
 
-switch_statement::switch_statement(const switch_statement &other) : m_value(other.m_value->copy()),
-                                                                    m_cases(other.m_cases),
-                                                                    m_default_case(other.m_default_case.size()),
-                                                                    m_default_case_scope(other.m_default_case_scope) {
-   std::transform(other.m_default_case.begin(), other.m_default_case.end(), m_default_case.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+mb::u64 if_statement::state::fingerprint() const {
+   return structural_hash(flat_kind::if_statement, is_constexpr ? flat_flag::is_constexpr : 0).node(*condition).nodes(if_then).nodes(if_else);
 }
 
-void switch_statement::add(const expression &case_expr, std::function<void(statement::collector &)> statements) {
-   m_cases.emplace_back(case_statement(case_expr, [&statements]() {
-      statement::collector col;
-      statements(col);
-      return col.build();
-   }()));
+mb::u64 if_statement::fingerprint() const {
+   return m_state.fingerprint();
 }
 
-void switch_statement::add_noscope(const expression &case_expr, std::function<void(statement::collector &)> statements) {
-   m_cases.emplace_back(case_statement(
-           case_expr, [&statements]() {
-              statement::collector col;
-              statements(col);
-              return col.build();
-           }(),
-           false));
+switch_statement::state::state(expression::ptr value) : value(std::move(value)) {}
+
+switch_statement::state::state(const state &other) : value(other.value->copy()),
+                                                     cases(other.cases),
+                                                     default_case(copy_nodes(other.default_case)),
+                                                     default_case_scope(other.default_case_scope) {}
+
+switch_statement::switch_statement(const expression &value) : m_state(std::in_place, value.copy()) {}
+
+switch_statement::switch_statement(expression::ptr value) : m_state(std::in_place, std::move(value)) {}
+
+void switch_statement::add(const expression &case_expr, statement::generator statements) {
+   add(case_expr.copy(), statements);
+}
+
+void switch_statement::add(expression::ptr case_expr, statement::generator statements) {
+   auto block = collect(statements);
+   m_state.edit().cases.emplace_back(case_statement(std::move(case_expr), std::move(block), true));
+}
+
+void switch_statement::add_noscope(const expression &case_expr, statement::generator statements) {
+   add_noscope(case_expr.copy(), statements);
+}
+
+void switch_statement::add_noscope(expression::ptr case_expr, statement::generator statements) {
+   auto block = collect(statements);
+   m_state.edit().cases.emplace_back(case_statement(std::move(case_expr), std::move(block), false));
 }
 
 void switch_statement::write_statement(writer &w) const {
-   if (m_cases.empty()) {
+   const auto &state = *m_state;
+   if (state.cases.empty()) {
       return;
    }
    w.put_indent();
    w.write("switch (");
-   m_value->write_expression(w);
-   w.write(") {\n");
-   std::for_each(m_cases.begin(), m_cases.end(), [&w](const case_statement &stmt) {
+   state.value->write_expression(w);
+   w.write(")");
+   w.open_brace();
+   std::for_each(state.cases.begin(), state.cases.end(), [&w](const case_statement &stmt) {
       w.put_indent();
       w.write("case ");
       stmt.m_case->write_expression(w);
@@ -171,19 +222,19 @@ void switch_statement::write_statement(writer &w) const {
          w.write("}\n");
       }
    });
-   if (!m_default_case.empty()) {
+   if (!state.default_case.empty()) {
       w.put_indent();
-      if (m_default_case_scope) {
+      if (state.default_case_scope) {
          w.write("default: {\n");
       } else {
          w.write("default: \n");
       }
       w.indent_in();
-      std::for_each(m_default_case.begin(), m_default_case.end(), [&w](const statement::ptr &stmt) {
+      std::for_each(state.default_case.begin(), state.default_case.end(), [&w](const statement::ptr &stmt) {
          stmt->write_statement(w);
       });
       w.indent_out();
-      if (m_default_case_scope) {
+      if (state.default_case_scope) {
          w.put_indent();
          w.write("}\n");
       }
@@ -193,83 +244,119 @@ void switch_statement::write_statement(writer &w) const {
 }
 
 statement::ptr switch_statement::copy() const {
-   return std::make_unique<switch_statement>(*this);
+   return make_node<switch_statement>(*this);
 }
 
-void switch_statement::add_default(std::function<void(statement::collector &)> statements) {
-   m_default_case = [&statements]() {
-      statement::collector col;
-      statements(col);
-      return col.build();
-   }();
+flat_index switch_statement::lower_statement(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::switch_statement, state.default_case_scope ? flat_flag::scoped : 0);
+   b.set(node, 0, state.value->lower_expression(b));
+   b.set(node, 1, b.list(state.cases, [&b](const case_statement &stmt) {
+      auto case_node = b.add(flat_kind::switch_case, stmt.m_scope ? flat_flag::scoped : 0);
+      b.set(case_node, 0, stmt.m_case->lower_expression(b));
+      b.set(case_node, 1, b.statements(stmt.m_statements));
+      return case_node;
+   }));
+   b.set(node, 2, b.statements(state.default_case));
+   return node;
 }
 
-void switch_statement::add_default_noscope(std::function<void(statement::collector &)> statements) {
-   m_default_case_scope = false;
-   add_default(std::move(statements));
+mb::u64 switch_statement::state::fingerprint() const {
+   structural_hash h(flat_kind::switch_statement, default_case_scope ? flat_flag::scoped : 0);
+   h.node(*value).number(cases.size());
+   for (const auto &stmt : cases) {
+      h.fingerprint(structural_hash(flat_kind::switch_case, stmt.m_scope ? flat_flag::scoped : 0).node(*stmt.m_case).nodes(stmt.m_statements));
+   }
+   return h.nodes(default_case);
 }
 
-switch_statement::case_statement::case_statement(const switch_statement::case_statement &other) : m_case(other.m_case->copy()),
-                                                                                                  m_statements(other.m_statements.size()),
-                                                                                                  m_scope(other.m_scope) {
-   std::transform(other.m_statements.begin(), other.m_statements.end(), m_statements.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+mb::u64 switch_statement::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+void switch_statement::add_default(statement::generator statements) {
+   auto block = collect(statements);
+   m_state.edit().default_case = std::move(block);
 }
 
-switch_statement::case_statement::case_statement(const expression &case_expr, std::vector<statement::ptr> statements) : m_case(case_expr.copy()),
-                                                                                                                        m_statements(std::move(statements)) {}
+void switch_statement::add_default_noscope(statement::generator statements) {
+   m_state.edit().default_case_scope = false;
+   add_default(statements);
+}
+
+switch_statement::case_statement::case_statement(const switch_statement::case_statement &other) : m_case(other.m_case->copy()),
+                                                                                                  m_statements(copy_nodes(other.m_statements)),
+                                                                                                  m_scope(other.m_scope) {}
+
+switch_statement::case_statement::case_statement(expression::ptr case_expr, node_vector<statement::ptr> statements, bool scope) : m_case(std::move(case_expr)),
+                                                                                                                                  m_statements(std::move(statements)),
+                                                                                                                                  m_scope(scope) {}
+
+return_statement::state::state(expression::ptr value) : value(std::move(value)) {}
+
+return_statement::state::state(const state &other) : value(other.value == nullptr ? nullptr : other.value->copy()) {}
 
-switch_statement::case_statement::case_statement(const expression &case_expr, std::vector<statement::ptr> statements, bool scope) : m_case(case_expr.copy()),
-                                                                                                                                    m_statements(std::move(statements)),
-                                                                                                                                    m_scope(scope) {}
+return_statement::return_statement() : m_state(std::in_place, nullptr) {}
 
-return_statement::return_statement(const expression &expre) : m_value(expre.copy()) {}
+return_statement::return_statement(const expression &expre) : m_state(std::in_place, expre.copy()) {}
 
-return_statement::return_statement(const return_statement &other) : m_value(other.m_value == nullptr ? nullptr : other.m_value->copy()) {}
+return_statement::return_statement(expression::ptr expre) : m_state(std::in_place, std::move(expre)) {}
 
 void return_statement::write_statement(writer &w) const {
    w.put_indent();
    w.write("return");
-   if (m_value != nullptr) {
+   if (m_state->value != nullptr) {
       w.write(" ");
-      m_value->write_expression(w);
+      m_state->value->write_expression(w);
    }
    w.write(";\n");
 }
 
 statement::ptr return_statement::copy() const {
-   return std::make_unique<return_statement>(*this);
-}
-
-for_statement::for_statement(const expression &start, const expression &condition, const expression &progress, std::function<void(statement::collector &)> body) : m_start(start.copy()),
-                                                                                                                                                                   m_condition(condition.copy()),
-                                                                                                                                                                   m_progress(progress.copy()),
-                                                                                                                                                                   m_body([&body]() {
-                                                                                                                                                                      statement::collector col;
-                                                                                                                                                                      body(col);
-                                                                                                                                                                      return col.build();
-                                                                                                                                                                   }()) {}
-for_statement::for_statement(const for_statement &other) : m_start(other.m_start->copy()),
-                                                           m_condition(other.m_condition->copy()),
-                                                           m_progress(other.m_progress->copy()),
-                                                           m_body(other.m_body.size()) {
-   std::transform(other.m_body.begin(), other.m_body.end(), m_body.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+   return make_node<return_statement>(*this);
+}
+
+flat_index return_statement::lower_statement(flat_builder &b) const {
+   auto node = b.add(flat_kind::return_statement);
+   b.set(node, 0, m_state->value != nullptr ? m_state->value->lower_expression(b) : flat_none);
+   return node;
+}
+
+mb::u64 return_statement::state::fingerprint() const {
+   return structural_hash(flat_kind::return_statement).optional(value);
+}
+
+mb::u64 return_statement::fingerprint() const {
+   return m_state.fingerprint();
 }
 
+for_statement::state::state(expression::ptr start, expression::ptr condition, expression::ptr progress, node_vector<statement::ptr> body) : start(std::move(start)),
+                                                                                                                                            condition(std::move(condition)),
+                                                                                                                                            progress(std::move(progress)),
+                                                                                                                                            body(std::move(body)) {}
+
+for_statement::state::state(const state &other) : start(other.start->copy()),
+                                                  condition(other.condition->copy()),
+                                                  progress(other.progress->copy()),
+                                                  body(copy_nodes(other.body)) {}
+
+for_statement::for_statement(const expression &start, const expression &condition, const expression &progress, statement::generator body) : for_statement(start.copy(), condition.copy(), progress.copy(), body) {}
+
+for_statement::for_statement(expression::ptr start, expression::ptr condition, expression::ptr progress, statement::generator body) : m_state(std::in_place, std::move(start), std::move(condition), std::move(progress), collect(body)) {}
+
 void for_statement::write_statement(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
    w.write("for (");
-   m_start->write_expression(w);
+   state.start->write_expression(w);
    w.write("; ");
-   m_condition->write_expression(w);
+   state.condition->write_expression(w);
    w.write("; ");
-   m_progress->write_expression(w);
-   w.write(") {\n");
+   state.progress->write_expression(w);
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_body.begin(), m_body.end(), [&w](const statement::ptr &stmt) {
+   std::for_each(state.body.begin(), state.body.end(), [&w](const statement::ptr &stmt) {
       stmt->write_statement(w);
    });
    w.indent_out();
@@ -278,39 +365,54 @@ void for_statement::write_statement(writer &w) const {
 }
 
 statement::ptr for_statement::copy() const {
-   return std::make_unique<for_statement>(*this);
+   return make_node<for_statement>(*this);
 }
 
-ranged_for_statement::ranged_for_statement(const ranged_for_statement &other) : m_item_type(other.m_item_type),
-                                                                             m_value_name(other.m_value_name),
-                                                                             m_range(other.m_range->copy()),
-                                                                             m_body(other.m_body.size()) {
-   std::transform(other.m_body.begin(), other.m_body.end(), m_body.begin(), [](const statement::ptr &stmt) {
-      return stmt->copy();
-   });
+flat_index for_statement::lower_statement(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::for_statement);
+   b.set(node, 0, state.start->lower_expression(b));
+   b.set(node, 1, state.condition->lower_expression(b));
+   b.set(node, 2, state.progress->lower_expression(b));
+   b.set(node, 3, b.statements(state.body));
+   return node;
+}
+
+mb::u64 for_statement::state::fingerprint() const {
+   return structural_hash(flat_kind::for_statement).node(*start).node(*condition).node(*progress).nodes(body);
 }
 
-ranged_for_statement::ranged_for_statement(std::string_view item_type, std::string_view value_name, const expression &range, std::function<void(statement::collector &)> body) : m_item_type(std::string{item_type}),
-                                                                                                                                                                               m_value_name(std::string{value_name}),
-                                                                                                                                                                               m_range(range.copy()),
-                                                                                                                                                                               m_body([&body]() {
-                                                                                                                                                                                  statement::collector col;
-                                                                                                                                                                                  body(col);
-                                                                                                                                                                                  return col.build();
-                                                                                                                                                                               }()) {
+mb::u64 for_statement::fingerprint() const {
+   return m_state.fingerprint();
 }
 
+ranged_for_statement::state::state(std::string_view item_type, std::string_view value_name, expression::ptr range, node_vector<statement::ptr> body) : item_type(item_type),
+                                                                                                                                                       value_name(value_name),
+                                                                                                                                                       range(std::move(range)),
+                                                                                                                                                       body(std::move(body)) {}
+
+ranged_for_statement::state::state(const state &other) : item_type(other.item_type),
+                                                         value_name(other.value_name),
+                                                         range(other.range->copy()),
+                                                         body(copy_nodes(other.body)) {}
+
+ranged_for_statement::ranged_for_statement(std::string_view item_type, std::string_view value_name, const expression &range, statement::generator body) : ranged_for_statement(item_type, value_name, range.copy(), body) {}
+
+ranged_for_statement::ranged_for_statement(std::string_view item_type, std::string_view value_name, expression::ptr range, statement::generator body) : m_state(std::in_place, item_type, value_name, std::move(range), collect(body)) {}
+
 void ranged_for_statement::write_statement(writer &w) const {
+   const auto &state = *m_state;
    w.put_indent();
    w.write("for (");
-   w.write(m_item_type);
+   w.write(state.item_type);
    w.write(" ");
-   w.write(m_value_name);
+   w.write(state.value_name);
    w.write(" : ");
-   m_range->write_expression(w);
-   w.write(") {\n");
+   state.range->write_expression(w);
+   w.write(")");
+   w.open_brace();
    w.indent_in();
-   std::for_each(m_body.begin(), m_body.end(), [&w](const statement::ptr &stmt) {
+   std::for_each(state.body.begin(), state.body.end(), [&w](const statement::ptr &stmt) {
       stmt->write_statement(w);
    });
    w.indent_out();
@@ -319,38 +421,61 @@ void ranged_for_statement::write_statement(writer &w) const {
 }
 
 statement::ptr ranged_for_statement::copy() const {
-   return std::make_unique<ranged_for_statement>(*this);
+   return make_node<ranged_for_statement>(*this);
+}
+
+flat_index ranged_for_statement::lower_statement(flat_builder &b) const {
+   const auto &state = *m_state;
+   auto node = b.add(flat_kind::ranged_for);
+   b.set(node, 0, b.text(state.item_type));
+   b.set(node, 1, b.text(state.value_name));
+   b.set(node, 2, state.range->lower_expression(b));
+   b.set(node, 3, b.statements(state.body));
+   return node;
 }
 
-if_switch_statement::if_switch_statement(const if_switch_statement &other) {
-   m_cases.reserve(other.m_cases.size());
-   for (const auto &[condition, block]: other.m_cases) {
-      std::vector<statement::ptr> new_block(block.size());
-      std::transform(block.begin(), block.end(), new_block.begin(), [](const statement::ptr &stmt) {return stmt->copy(); });
-      m_cases.emplace_back(if_case{condition->copy(), std::move(new_block)});
+mb::u64 ranged_for_statement::state::fingerprint() const {
+   return structural_hash(flat_kind::ranged_for).text(item_type).text(value_name).node(*range).nodes(body);
+}
+
+mb::u64 ranged_for_statement::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+if_switch_statement::state::state(const state &other) {
+   cases.reserve(other.cases.size());
+   for (const auto &[condition, block] : other.cases) {
+      cases.emplace_back(if_case{condition->copy(), copy_nodes(block)});
    }
 }
 
-void if_switch_statement::add_case(const expression &condition, std::function<void(statement::collector &)> block) {
-   statement::collector col;
-   block(col);
-   m_cases.emplace_back(if_case{condition.copy(), col.build()});
+if_switch_statement::if_switch_statement() : m_state(std::in_place) {}
+
+void if_switch_statement::add_case(const expression &condition, statement::generator block) {
+   add_case(condition.copy(), block);
+}
+
+void if_switch_statement::add_case(expression::ptr condition, statement::generator block) {
+   auto statements = collect(block);
+   m_state.edit().cases.emplace_back(if_case{std::move(condition), std::move(statements)});
 }
 
 void if_switch_statement::write_statement(writer &w) const {
    bool first = true;
-   for (const auto &[condition, block]: m_cases) {
+   for (const auto &[condition, block] : m_state->cases) {
       if (first) {
          first = false;
          w.put_indent();
          w.write("if (");
       } else {
-         w.write(" else if (");
+         w.open_else();
+         w.write(" if (");
       }
       condition->write_expression(w);
-      w.write(") {\n");
+      w.write(")");
+      w.open_brace();
       w.indent_in();
-      for(const auto &stmt: block) {
+      for (const auto &stmt : block) {
          stmt->write_statement(w);
       }
       w.indent_out();
@@ -362,7 +487,74 @@ void if_switch_statement::write_statement(writer &w) const {
 }
 
 statement::ptr if_switch_statement::copy() const {
-   return std::make_unique<if_switch_statement>(*this);
+   return make_node<if_switch_statement>(*this);
+}
+
+flat_index if_switch_statement::lower_statement(flat_builder &b) const {
+   auto node = b.add(flat_kind::if_switch);
+   b.set(node, 0, b.list(m_state->cases, [&b](const if_case &c) {
+      auto case_node = b.add(flat_kind::if_case);
+      b.set(case_node, 0, c.condition->lower_expression(b));
+      b.set(case_node, 1, b.statements(c.block));
+      return case_node;
+   }));
+   return node;
+}
+
+mb::u64 if_switch_statement::state::fingerprint() const {
+   structural_hash h(flat_kind::if_switch);
+   h.number(cases.size());
+   for (const auto &c : cases) {
+      h.fingerprint(structural_hash(flat_kind::if_case).node(*c.condition).nodes(c.block));
+   }
+   return h;
+}
+
+mb::u64 if_switch_statement::fingerprint() const {
+   return m_state.fingerprint();
+}
+
+located_statement::state::state(const source_origin &origin, statement::ptr inner) : file(origin.file),
+                                                                                 line(origin.line),
+                                                                                 inner(std::move(inner)) {}
+
+located_statement::state::state(const state &other) : file(other.file),
+                                                      line(other.line),
+                                                      inner(other.inner->copy()) {}
+
+located_statement::located_statement(const source_origin &origin, const statement &stmt) : m_state(std::in_place, origin, stmt.copy()) {}
+
+located_statement::located_statement(const source_origin &origin, statement::ptr stmt) : m_state(std::in_place, origin, std::move(stmt)) {}
+
+source_origin located_statement::origin() const {
+   return source_origin{m_state->file, m_state->line};
+}
+
+void located_statement::write_statement(writer &w) const {
+   auto previous = w.origin();
+   w.set_origin(origin());
+   m_state->inner->write_statement(w);
+   w.set_origin(previous);
+}
+
+statement::ptr located_statement::copy() const {
+   return make_node<located_statement>(*this);
+}
+
+flat_index located_statement::lower_statement(flat_builder &b) const {
+   auto node = b.add(flat_kind::located_statement);
+   b.set(node, 0, b.text(m_state->file));
+   b.set(node, 1, m_state->line);
+   b.set(node, 2, m_state->inner->lower_statement(b));
+   return node;
+}
+
+mb::u64 located_statement::state::fingerprint() const {
+   return structural_hash(flat_kind::located_statement).text(file).number(line).node(*inner);
+}
+
+mb::u64 located_statement::fingerprint() const {
+   return m_state.fingerprint();
 }
 
-}// namespace mb::codegen
\ No newline at end of file
+}// namespace mb::codegen
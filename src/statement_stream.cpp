@@ -0,0 +1,63 @@
+#include <mb/codegen/statement_stream.h>
+
+namespace mb::codegen {
+
+std::suspend_always statement_stream::promise_type::yield_value(statement::ptr stmt) {
+   current = std::move(stmt);
+   return {};
+}
+
+std::suspend_always statement_stream::promise_type::yield_value(expression::ptr expre) {
+   current = make_node<expr>(std::move(expre));
+   return {};
+}
+
+statement_stream::statement_stream(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+statement_stream::statement_stream(statement_stream &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+statement_stream &statement_stream::operator=(statement_stream &&other) noexcept {
+   if (this != &other) {
+      if (m_handle) {
+         m_handle.destroy();
+      }
+      m_handle = std::exchange(other.m_handle, nullptr);
+   }
+   return *this;
+}
+
+statement_stream::~statement_stream() noexcept {
+   if (m_handle) {
+      m_handle.destroy();
+   }
+}
+
+bool statement_stream::advance() {
+   if (!m_handle || m_handle.done())
+      return false;
+   auto &promise = m_handle.promise();
+   promise.current.reset();
+   m_handle.resume();
+   if (promise.error != nullptr) {
+      std::rethrow_exception(std::exchange(promise.error, nullptr));
+   }
+   return !m_handle.done();
+}
+
+statement_stream::iterator statement_stream::begin() {
+   if (!advance())
+      return end();
+   return iterator(*this);
+}
+
+statement_stream::iterator statement_stream::end() {
+   return iterator();
+}
+
+statement::ptr statement_stream::next() {
+   if (!advance())
+      return nullptr;
+   return std::move(m_handle.promise().current);
+}
+
+}// namespace mb::codegen
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <array>
+#include <memory_resource>
+#include <mb/codegen/symbol.h>
+#include <mutex>
+#include <unordered_set>
+
+namespace mb::codegen {
+
+namespace {
+
+constexpr std::size_t g_shard_count = 16;
+
+// symbol_shard - part of the intern table, strings are distributed between shards
+// by hash so that threads interning different strings rarely contend
+struct symbol_shard {
+   std::mutex mutex;
+   std::pmr::monotonic_buffer_resource storage;
+   std::unordered_set<std::string_view> strings;
+};
+
+std::array<symbol_shard, g_shard_count> &symbol_shards() {
+   static std::array<symbol_shard, g_shard_count> s_shards;
+   return s_shards;
+}
+
+std::string_view intern(std::string_view value) {
+   auto hash = std::hash<std::string_view>()(value);
+   auto &shard = symbol_shards()[hash % g_shard_count];
+
+   std::lock_guard<std::mutex> lock(shard.mutex);
+   if (auto it = shard.strings.find(value); it != shard.strings.end()) {
+      return *it;
+   }
+   auto *memory = static_cast<char *>(shard.storage.allocate(value.size(), alignof(char)));
+   std::copy(value.begin(), value.end(), memory);
+   std::string_view stored(memory, value.size());
+   shard.strings.emplace(stored);
+   return stored;
+}
+
+}// namespace
+
+symbol::symbol(std::string_view value) : m_value(value.empty() ? std::string_view() : intern(value)) {}
+
+std::size_t symbol::interned_count() {
+   std::size_t count{};
+   for (auto &shard : symbol_shards()) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      count += shard.strings.size();
+   }
+   return count;
+}
+
+}// namespace mb::codegen
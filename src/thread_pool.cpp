@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <chrono>
+#include <mb/codegen/thread_pool.h>
+#include <utility>
+
+namespace mb::codegen {
+
+thread_pool::thread_pool(std::size_t thread_count) {
+   if (thread_count == 0) {
+      thread_count = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+   }
+   m_queues.reserve(thread_count);
+   for (std::size_t i = 0; i < thread_count; ++i) {
+      m_queues.emplace_back(std::make_unique<queue>());
+   }
+   m_threads.reserve(thread_count);
+   for (std::size_t i = 0; i < thread_count; ++i) {
+      m_threads.emplace_back([this, i] { work(i); });
+   }
+}
+
+thread_pool::~thread_pool() noexcept {
+   {
+      std::lock_guard lock(m_wake_mutex);
+      m_stopping = true;
+   }
+   m_wake.notify_all();
+   for (auto &thread : m_threads) {
+      thread.join();
+   }
+}
+
+void thread_pool::submit(task t) {
+   auto index = s_pool == this ? s_queue : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+   {
+      std::lock_guard lock(m_queues[index]->mutex);
+      m_queues[index]->tasks.emplace_back(std::move(t));
+   }
+   m_pending.fetch_add(1);
+   {
+      std::lock_guard lock(m_wake_mutex);
+   }
+   m_wake.notify_one();
+}
+
+bool thread_pool::take(std::size_t home, task &out) {
+   if (m_pending.load() == 0)
+      return false;
+
+   {
+      auto &own = *m_queues[home];
+      std::lock_guard lock(own.mutex);
+      if (!own.tasks.empty()) {
+         out = std::move(own.tasks.back());
+         own.tasks.pop_back();
+         m_pending.fetch_sub(1);
+         return true;
+      }
+   }
+
+   for (std::size_t i = 1; i < m_queues.size(); ++i) {
+      auto &victim = *m_queues[(home + i) % m_queues.size()];
+      std::lock_guard lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+         out = std::move(victim.tasks.front());
+         victim.tasks.pop_front();
+         m_pending.fetch_sub(1);
+         return true;
+      }
+   }
+   return false;
+}
+
+bool thread_pool::run_one() {
+   task t;
+   if (!take(s_pool == this ? s_queue : 0, t))
+      return false;
+   t();
+   return true;
+}
+
+void thread_pool::work(std::size_t index) {
+   s_pool = this;
+   s_queue = index;
+   task t;
+   for (;;) {
+      if (take(index, t)) {
+         t();
+         t = nullptr;
+         continue;
+      }
+      std::unique_lock lock(m_wake_mutex);
+      m_wake.wait(lock, [this] { return m_stopping || m_pending.load() > 0; });
+      if (m_stopping)
+         return;
+   }
+}
+
+std::size_t thread_pool::thread_count() const {
+   return m_threads.size();
+}
+
+task_group::task_group(thread_pool &pool) : m_pool(pool) {}
+
+task_group::~task_group() noexcept {
+   // tasks reference the group, it cannot go away before they finish
+   while (m_remaining.load() != 0) {
+      if (!m_pool.run_one()) {
+         std::this_thread::yield();
+      }
+   }
+   // the last task may still be holding the mutex
+   std::lock_guard lock(m_mutex);
+}
+
+void task_group::run(std::function<void()> fn) {
+   m_remaining.fetch_add(1);
+   m_pool.submit([this, fn = std::move(fn)] {
+      try {
+         fn();
+      } catch (...) {
+         std::lock_guard lock(m_mutex);
+         if (m_error == nullptr) {
+            m_error = std::current_exception();
+         }
+      }
+      std::lock_guard lock(m_mutex);
+      if (m_remaining.fetch_sub(1) == 1) {
+         m_done.notify_all();
+      }
+   });
+}
+
+void task_group::wait() {
+   while (m_remaining.load() != 0) {
+      if (m_pool.run_one())
+         continue;
+      // the remaining tasks are running on other threads, they may themselves be waiting
+      // on tasks submitted later, so the wait is short and the queues are checked again
+      std::unique_lock lock(m_mutex);
+      m_done.wait_for(lock, std::chrono::microseconds(200), [this] { return m_remaining.load() == 0; });
+   }
+   std::exception_ptr error;
+   {
+      std::lock_guard lock(m_mutex);
+      error = std::exchange(m_error, nullptr);
+   }
+   if (error != nullptr) {
+      std::rethrow_exception(error);
+   }
+}
+
+thread_pool &task_group::pool() const {
+   return m_pool;
+}
+
+}// namespace mb::codegen
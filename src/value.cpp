@@ -0,0 +1,325 @@
+#include <mb/codegen/value.h>
+#include <utility>
+
+namespace mb::codegen {
+
+namespace {
+
+void write_separated(writer &w, const node_vector<expression_value> &values) {
+   if (values.empty())
+      return;
+   w.begin_group();
+   auto it_first = values.begin();
+   it_first->write_expression(w);
+   std::for_each(it_first + 1, values.end(), [&w](const expression_value &value) {
+      w.write(",");
+      w.soft_break();
+      value.write_expression(w);
+   });
+   w.end_group();
+}
+
+void write_block(writer &w, const node_vector<statement_value> &statements) {
+   w.indent_in();
+   for (const auto &stmt : statements) {
+      stmt.write_statement(w);
+   }
+   w.indent_out();
+   w.put_indent();
+}
+
+struct expression_writer {
+   writer &w;
+
+   void operator()(const raw_value &value) const {
+      w.write(value.contents);
+   }
+
+   void operator()(const call_value &value) const {
+      value.function->write_expression(w);
+      w.write("(");
+      write_separated(w, value.arguments);
+      w.write(")");
+   }
+
+   void operator()(const method_call_value &value) const {
+      if (const auto *deref_val = value.object->get_if<deref_value>(); deref_val != nullptr) {
+         deref_val->value->write_expression(w);
+         w.write("->");
+      } else {
+         value.object->write_expression(w);
+         w.write(".");
+      }
+      w.write(value.method_name);
+      w.write("(");
+      write_separated(w, value.arguments);
+      w.write(")");
+   }
+
+   void operator()(const assign_value &value) const {
+      w.write("{} = ", value.variable);
+      value.value->write_expression(w);
+   }
+
+   void operator()(const binary_operator_value &value) const {
+      w.begin_group();
+      value.lhs->write_expression(w);
+      w.write(" {}", value.op);
+      w.soft_break();
+      value.rhs->write_expression(w);
+      w.end_group();
+   }
+
+   void operator()(const items_value &value) const {
+      w.write("\n");
+      w.indent_in();
+      for (const auto &item : value.items) {
+         w.put_indent();
+         item.write_expression(w);
+         w.write(",\n");
+      }
+      w.indent_out();
+   }
+
+   void operator()(const struct_constructor_value &value) const {
+      w.write("{");
+      write_separated(w, value.items);
+      w.write("}");
+   }
+
+   void operator()(const deref_value &value) const {
+      w.write("*");
+      value.value->write_expression(w);
+   }
+
+   void operator()(const lambda_value &value) const {
+      w.write("[");
+      write_separated(w, value.captures);
+      w.write("](");
+      if (!value.arguments.empty()) {
+         w.begin_group();
+         auto it_first = value.arguments.begin();
+         w.write("{} {}", it_first->type, it_first->name);
+         std::for_each(it_first + 1, value.arguments.end(), [this](const arg &arg) {
+            w.write(",");
+            w.soft_break();
+            w.write("{} {}", arg.type, arg.name);
+         });
+         w.end_group();
+      }
+      w.write(") {\n");
+      write_block(w, value.statements);
+      w.write("}");
+   }
+
+   void operator()(const any_expression &value) const {
+      value.node->write_expression(w);
+   }
+};
+
+struct statement_writer {
+   writer &w;
+
+   void operator()(const expr_value &value) const {
+      w.put_indent();
+      value.expr.write_expression(w);
+      w.write(";\n");
+   }
+
+   void operator()(const if_value &value) const {
+      if (value.if_then.empty() && value.if_else.empty())
+         return;
+      w.put_indent();
+      w.write("if ");
+      if (value.is_constexpr) {
+         w.write("constexpr ");
+      }
+      if (value.if_then.empty()) {
+         w.write("(!");
+         value.condition.write_expression(w);
+         w.write(")");
+         w.open_brace();
+         write_block(w, value.if_else);
+         w.write("}\n");
+         return;
+      }
+      w.write("(");
+      value.condition.write_expression(w);
+      w.write(")");
+      w.open_brace();
+      write_block(w, value.if_then);
+      w.write("}");
+      if (!value.if_else.empty()) {
+         w.open_else();
+         w.open_brace();
+         write_block(w, value.if_else);
+         w.write("}\n");
+      } else {
+         w.write("\n");
+      }
+   }
+
+   void operator()(const if_switch_value &value) const {
+      bool first = true;
+      for (const auto &[condition, block] : value.cases) {
+         if (first) {
+            first = false;
+            w.put_indent();
+            w.write("if (");
+         } else {
+            w.open_else();
+            w.write(" if (");
+         }
+         condition.write_expression(w);
+         w.write(")");
+         w.open_brace();
+         write_block(w, block);
+         w.write("}");
+      }
+      w.write("\n");
+   }
+
+   void operator()(const switch_value &value) const {
+      if (value.cases.empty())
+         return;
+      w.put_indent();
+      w.write("switch (");
+      value.value.write_expression(w);
+      w.write(")");
+      w.open_brace();
+      for (const auto &c : value.cases) {
+         w.put_indent();
+         w.write("case ");
+         c.value.write_expression(w);
+         w.write(c.scope ? ": {\n" : ":\n");
+         w.indent_in();
+         for (const auto &stmt : c.statements) {
+            stmt.write_statement(w);
+         }
+         w.indent_out();
+         if (c.scope) {
+            w.put_indent();
+            w.write("}\n");
+         }
+      }
+      if (!value.default_case.empty()) {
+         w.put_indent();
+         w.write(value.default_case_scope ? "default: {\n" : "default: \n");
+         w.indent_in();
+         for (const auto &stmt : value.default_case) {
+            stmt.write_statement(w);
+         }
+         w.indent_out();
+         if (value.default_case_scope) {
+            w.put_indent();
+            w.write("}\n");
+         }
+      }
+      w.put_indent();
+      w.write("}\n");
+   }
+
+   void operator()(const return_value &value) const {
+      w.put_indent();
+      w.write("return");
+      if (value.value.has_value()) {
+         w.write(" ");
+         value.value->write_expression(w);
+      }
+      w.write(";\n");
+   }
+
+   void operator()(const for_value &value) const {
+      w.put_indent();
+      w.write("for (");
+      value.start.write_expression(w);
+      w.write("; ");
+      value.condition.write_expression(w);
+      w.write("; ");
+      value.progress.write_expression(w);
+      w.write(")");
+      w.open_brace();
+      write_block(w, value.body);
+      w.write("}\n");
+   }
+
+   void operator()(const ranged_for_value &value) const {
+      w.put_indent();
+      w.write("for ({} {} : ", value.item_type, value.value_name);
+      value.range.write_expression(w);
+      w.write(")");
+      w.open_brace();
+      write_block(w, value.body);
+      w.write("}\n");
+   }
+
+   void operator()(const any_statement &value) const {
+      value.node->write_statement(w);
+   }
+};
+
+}// namespace
+
+any_expression::any_expression(expression::ptr node) : node(std::move(node)) {}
+
+any_expression::any_expression(const expression &node) : node(node.copy()) {}
+
+any_expression::any_expression(const any_expression &other) : node(other.node->copy()) {}
+
+any_expression &any_expression::operator=(const any_expression &other) {
+   if (this != &other) {
+      node = other.node->copy();
+   }
+   return *this;
+}
+
+void expression_value::write_expression(writer &w) const {
+   std::visit(expression_writer{w}, m_value);
+}
+
+any_statement::any_statement(statement::ptr node) : node(std::move(node)) {}
+
+any_statement::any_statement(const statement &node) : node(node.copy()) {}
+
+any_statement::any_statement(const any_statement &other) : node(other.node->copy()) {}
+
+any_statement &any_statement::operator=(const any_statement &other) {
+   if (this != &other) {
+      node = other.node->copy();
+   }
+   return *this;
+}
+
+void statement_value::write_statement(writer &w) const {
+   std::visit(statement_writer{w}, m_value);
+}
+
+value_expression::value_expression(expression_value value) : m_value(std::move(value)) {}
+
+const expression_value &value_expression::value() const {
+   return m_value;
+}
+
+void value_expression::write_expression(writer &w) const {
+   m_value.write_expression(w);
+}
+
+expression::ptr value_expression::copy() const {
+   return make_node<value_expression>(*this);
+}
+
+value_statement::value_statement(statement_value value) : m_value(std::move(value)) {}
+
+const statement_value &value_statement::value() const {
+   return m_value;
+}
+
+void value_statement::write_statement(writer &w) const {
+   m_value.write_statement(w);
+}
+
+statement::ptr value_statement::copy() const {
+   return make_node<value_statement>(*this);
+}
+
+}// namespace mb::codegen
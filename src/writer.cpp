@@ -1,8 +1,57 @@
+#include <algorithm>
+#include <cassert>
 #include <mb/codegen/writer.h>
 
 namespace mb::codegen {
 
-writer::writer(std::ostream &stream) : m_stream(stream) {}
+namespace {
+
+constexpr std::string_view g_indent_spaces = "                                                                                                ";
+constexpr std::string_view g_indent_tabs = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+template<typename Buffer>
+void append_repeated(Buffer &buffer, std::string_view fill, std::size_t count) {
+    while (count > fill.size()) {
+        buffer.append(fill);
+        count -= fill.size();
+    }
+    buffer.append(fill.substr(0, count));
+}
+
+// g_default_output_name - file named by #line directives returning to the output when no output name is set
+constexpr std::string_view g_default_output_name = "<generated>";
+
+// escaped - file name as a string literal of a #line directive
+std::string escaped(std::string_view file) {
+    std::string result;
+    result.reserve(file.size());
+    for (auto c : file) {
+        if (c == '\\' || c == '"') {
+            result.push_back('\\');
+        }
+        result.push_back(c);
+    }
+    return result;
+}
+
+}// namespace
+
+writer::writer(std::ostream &stream) : m_owned_sink(std::make_unique<ostream_sink>(stream)),
+                                       m_sink(m_owned_sink.get()),
+                                       m_stream(&stream) {}
+
+writer::writer(sink &s) : m_sink(&s) {}
+
+writer::writer(std::unique_ptr<sink> s) : m_owned_sink(std::move(s)),
+                                          m_sink(m_owned_sink.get()) {}
+
+writer::~writer() noexcept {
+    try {
+        flush();
+    } catch (...) {
+        // nothing can be done about it here, call flush explicitly to handle errors
+    }
+}
 
 void writer::indent_in() {
     ++m_indent;
@@ -15,16 +64,274 @@ void writer::indent_out() {
 }
 
 std::ostream &writer::raw() {
-    return m_stream;
+    assert(m_stream != nullptr);
+    flush();
+    return *m_stream;
 }
 
 void writer::line() {
-    m_stream << "\n";
+    m_buffer.push_back('\n');
+    flush_if_full();
+}
+
+void writer::blank_line() {
+    if (!m_style.compact) {
+        line();
+    }
 }
 
 void writer::put_indent() {
-    for (mb::u32 i = 0; i < m_indent; ++i)
-        m_stream << "   ";
+    if (m_style.compact)
+        return;
+    if (m_style.use_tabs) {
+        append_repeated(m_buffer, g_indent_tabs, m_indent);
+        return;
+    }
+    append_repeated(m_buffer, g_indent_spaces, m_indent * m_style.indent_width);
+}
+
+void writer::set_style(const writer_style &style) {
+    m_style = style;
+}
+
+const writer_style &writer::style() const {
+    return m_style;
+}
+
+void writer::begin_group() {
+    if (m_style.column_limit == 0 || m_style.compact)
+        return;
+    if (m_layout_start == no_layout) {
+        std::string_view written(m_buffer.data(), m_buffer.size());
+        auto line_start = written.rfind('\n');
+        m_layout_start = m_buffer.size();
+        m_layout_column = width(line_start == std::string_view::npos ? written : written.substr(line_start + 1));
+        m_layout_indent = m_indent;
+    }
+    ++m_group_depth;
+    m_marks.push_back(layout_mark{m_buffer.size(), 0, mark_kind::begin});
+}
+
+void writer::end_group() {
+    if (m_group_depth == 0)
+        return;
+    m_marks.push_back(layout_mark{m_buffer.size(), 0, mark_kind::end});
+    if (--m_group_depth == 0) {
+        // new lines written within the groups do not end the line being laid out
+        m_layout_scanned = m_buffer.size();
+    }
+}
+
+void writer::soft_break(std::string_view flat_text) {
+    if (m_group_depth == 0) {
+        write(flat_text);
+        return;
+    }
+    m_marks.push_back(layout_mark{m_buffer.size(), flat_text.size(), mark_kind::soft_break});
+    m_buffer.append(flat_text);
+}
+
+void writer::open_brace() {
+    if (m_style.compact) {
+        write("{\n");
+        return;
+    }
+    if (m_style.braces == brace_style::allman) {
+        line();
+        put_indent();
+        write("{\n");
+        return;
+    }
+    write(" {\n");
+}
+
+void writer::open_else() {
+    if (m_style.compact) {
+        write("else");
+        return;
+    }
+    if (m_style.braces == brace_style::allman) {
+        line();
+        put_indent();
+        write("else");
+        return;
+    }
+    write(" else");
+}
+
+mb::u32 writer::width(std::string_view text) const {
+    auto tabs = static_cast<std::size_t>(std::count(text.begin(), text.end(), '\t'));
+    return static_cast<mb::u32>(text.size() + tabs * (m_style.indent_width - 1));
+}
+
+void writer::complete_line() {
+    std::string_view written(m_buffer.data(), m_buffer.size());
+    auto end = written.find('\n', m_layout_scanned);
+    if (end == std::string_view::npos) {
+        m_layout_scanned = m_buffer.size();
+        return;
+    }
+    layout_line(end);
+    if (flush_due()) {
+        flush();
+    }
+}
+
+// layout_line - Oppen style layout of the line between the layout start and end.
+// Positions are offsets of the items in the line printed flat, the stop of a group or a soft break
+// is the position of the next point where the line could end after the group or the break,
+// so whether something fits is known without looking ahead while printing.
+void writer::layout_line(std::size_t end) {
+    enum class item_kind : mb::u8 {
+        text,
+        new_line,
+        begin,
+        end,
+        soft_break,
+        origin,
+    };
+    struct item {
+        item_kind kind;
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    std::string_view written(m_buffer.data(), m_buffer.size());
+    std::vector<item> items;
+    items.reserve(2 * m_marks.size() + 1);
+    auto add_text = [&items, written](std::size_t from, std::size_t to) {
+        while (from < to) {
+            auto new_line = std::min(written.find('\n', from), to);
+            if (new_line > from) {
+                items.push_back(item{item_kind::text, from, new_line - from});
+            }
+            if (new_line == to)
+                break;
+            items.push_back(item{item_kind::new_line, new_line, 1});
+            from = new_line + 1;
+        }
+    };
+    auto at = m_layout_start;
+    for (const auto &mark : m_marks) {
+        add_text(at, mark.offset);
+        switch (mark.kind) {
+        case mark_kind::begin: items.push_back(item{item_kind::begin, mark.offset, 0}); break;
+        case mark_kind::end: items.push_back(item{item_kind::end, mark.offset, 0}); break;
+        case mark_kind::soft_break: items.push_back(item{item_kind::soft_break, mark.offset, mark.length}); break;
+        case mark_kind::origin: items.push_back(item{item_kind::origin, mark.offset, 0}); break;
+        }
+        at = mark.offset + mark.length;
+    }
+    add_text(at, end);
+
+    auto count = items.size();
+    std::vector<std::size_t> position(count + 1);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto advance = items[i].kind == item_kind::text || items[i].kind == item_kind::soft_break ? width(written.substr(items[i].offset, items[i].length)) : 0;
+        position[i + 1] = position[i] + advance;
+    }
+
+    std::vector<std::size_t> stop(count);
+    std::vector<std::size_t> stops{position[count]};
+    for (auto i = count; i-- > 0;) {
+        switch (items[i].kind) {
+        case item_kind::end:
+            stops.push_back(stops.back());
+            break;
+        case item_kind::begin:
+            stops.pop_back();
+            stop[i] = stops.back();
+            break;
+        case item_kind::soft_break:
+            stop[i] = stops.back();
+            stops.back() = position[i];
+            break;
+        case item_kind::new_line:
+            // a new line ends the line at every level
+            std::fill(stops.begin(), stops.end(), position[i]);
+            break;
+        case item_kind::text:
+        case item_kind::origin:
+            break;
+        }
+    }
+
+    struct open_group {
+        bool broken;
+        std::size_t column;
+    };
+    std::vector<open_group> groups;
+    std::vector<std::size_t> origins;
+    std::string out;
+    out.reserve(end - m_layout_start + m_marks.size());
+    std::size_t column = m_layout_column;
+    auto fits = [this, &column, &position, &stop](std::size_t i) {
+        return column + (stop[i] - position[i]) <= m_style.column_limit;
+    };
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto &it = items[i];
+        auto text = written.substr(it.offset, it.length);
+        switch (it.kind) {
+        case item_kind::text:
+            out.append(text);
+            column += width(text);
+            break;
+        case item_kind::new_line:
+            out.push_back('\n');
+            column = 0;
+            break;
+        case item_kind::begin: {
+            auto within_flat = !groups.empty() && !groups.back().broken;
+            groups.push_back(open_group{!within_flat && !fits(i), column});
+            break;
+        }
+        case item_kind::end:
+            groups.pop_back();
+            break;
+        case item_kind::origin:
+            origins.push_back(out.size());
+            break;
+        case item_kind::soft_break:
+            if (!groups.back().broken || fits(i)) {
+                out.append(text);
+                column += width(text);
+                break;
+            }
+            column = groups.back().column;
+            out.push_back('\n');
+            if (m_style.use_tabs) {
+                auto tabs = std::min<std::size_t>(m_layout_indent, column / m_style.indent_width);
+                append_repeated(out, g_indent_tabs, tabs);
+                append_repeated(out, g_indent_spaces, column - tabs * m_style.indent_width);
+            } else {
+                append_repeated(out, g_indent_spaces, column);
+            }
+            break;
+        }
+    }
+
+    if (m_position_scanned > m_layout_start) {
+        auto counted = written.substr(m_layout_start, m_position_scanned - m_layout_start);
+        m_line -= static_cast<mb::u32>(std::count(counted.begin(), counted.end(), '\n'));
+        m_position_scanned = m_layout_start;
+    }
+    std::string rest(written.substr(end));
+    m_buffer.resize(m_layout_start);
+    m_buffer.append(out);
+    m_buffer.append(rest);
+    map_layout_origins(m_layout_start, origins);
+    m_marks.clear();
+    m_layout_start = no_layout;
+}
+
+// map_layout_origins - adds the origins set within the layout at their offsets from the start
+void writer::map_layout_origins(std::size_t start, const std::vector<std::size_t> &offsets) {
+    assert(offsets.size() == m_layout_origins.size());
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+        auto at = position_at(start + offsets[i]);
+        m_source_map.add(at.line, at.column, m_layout_origins[i]);
+    }
+    m_layout_origins.clear();
 }
 
 void writer::descope_flat() {
@@ -44,7 +351,143 @@ void writer::descope() {
 }
 
 void writer::write(std::string_view sv) {
-    m_stream << sv;
+    m_buffer.append(sv);
+    flush_if_full();
+}
+
+void writer::flush() {
+    if (m_layout_start != no_layout) {
+        if (m_group_depth == 0) {
+            layout_line(m_buffer.size());
+        } else {
+            // groups left open cannot be laid out, their text is kept as written
+            std::vector<std::size_t> origins;
+            for (const auto &mark : m_marks) {
+                if (mark.kind == mark_kind::origin) {
+                    origins.push_back(mark.offset - m_layout_start);
+                }
+            }
+            map_layout_origins(m_layout_start, origins);
+            m_marks.clear();
+            m_layout_start = no_layout;
+            m_group_depth = 0;
+        }
+    }
+    if (m_sink == nullptr || m_buffer.size() == 0)
+        return;
+    m_flushed_column = position().column;
+    m_position_scanned = 0;
+    m_sink->write(std::string_view(m_buffer.data(), m_buffer.size()));
+    m_flushed += m_buffer.size();
+    m_buffer.clear();
+}
+
+writer::text_position writer::position() {
+    return position_at(m_buffer.size());
+}
+
+writer::text_position writer::position_at(std::size_t offset) {
+    std::string_view written(m_buffer.data(), offset);
+    if (offset < m_position_scanned) {
+        auto counted = std::string_view(m_buffer.data(), m_position_scanned).substr(offset);
+        m_line -= static_cast<mb::u32>(std::count(counted.begin(), counted.end(), '\n'));
+    } else {
+        auto scanned = written.substr(m_position_scanned);
+        m_line += static_cast<mb::u32>(std::count(scanned.begin(), scanned.end(), '\n'));
+    }
+    m_position_scanned = offset;
+    auto line_start = written.rfind('\n');
+    auto column = line_start == std::string_view::npos ? m_flushed_column + written.size() : written.size() - line_start - 1;
+    return text_position{m_line, static_cast<mb::u32>(column)};
+}
+
+void writer::set_origin(const source_origin &origin) {
+    if (origin == m_origin)
+        return;
+    m_origin = origin;
+    switch (m_style.origins) {
+    case origin_mode::none:
+        break;
+    case origin_mode::line_directives: {
+        if (position().column != 0) {
+            line();
+        }
+        if (!origin.empty()) {
+            write("#line {} \"{}\"\n", origin.line, escaped(origin.file));
+        } else {
+            // the line after the directive
+            auto name = m_output_name.empty() ? g_default_output_name : std::string_view(m_output_name);
+            write("#line {} \"{}\"\n", position().line + 1, escaped(name));
+        }
+        break;
+    }
+    case origin_mode::source_map: {
+        if (m_layout_start != no_layout) {
+            // the line may still be broken, the position is known once it is laid out
+            m_marks.push_back(layout_mark{m_buffer.size(), 0, mark_kind::origin});
+            m_layout_origins.push_back(origin);
+            break;
+        }
+        auto at = position();
+        m_source_map.add(at.line, at.column, origin);
+        break;
+    }
+    }
+}
+
+const source_origin &writer::origin() const {
+    return m_origin;
+}
+
+void writer::set_output_name(std::string_view name) {
+    m_output_name = name;
+}
+
+const source_map &writer::mapping() const {
+    return m_source_map;
+}
+
+mb::u32 writer::indent() const {
+    return m_indent;
+}
+
+void writer::set_indent(mb::u32 indent) {
+    m_indent = indent;
+}
+
+void writer::set_memo(render_memo *memo) {
+    m_memo = memo;
+}
+
+render_memo *writer::memo() const {
+    return m_memo;
+}
+
+void writer::clear() {
+    m_buffer.clear();
+    m_indent = 0;
+    m_flushed = 0;
+    m_marks.clear();
+    m_layout_start = no_layout;
+    m_group_depth = 0;
+    m_layout_origins.clear();
+    m_origin = {};
+    m_source_map.clear();
+    m_line = 1;
+    m_flushed_column = 0;
+    m_position_scanned = 0;
+}
+
+std::size_t writer::written() const {
+    return m_flushed + m_buffer.size();
+}
+
+std::string_view writer::view() const {
+    return {m_buffer.data(), m_buffer.size()};
+}
+
+std::string writer::str() const {
+    return fmt::to_string(m_buffer);
 }
 
-}// namespace mb::codegen
\ No newline at end of file
+}// namespace mb::codegen
@@ -1,12 +1,33 @@
+#include "../bench/alloc_counter.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <mutex>
+#include <ranges>
 #include <mb/codegen/class.h>
 #include <mb/codegen/component.h>
+#include <mb/codegen/component_builder.h>
 #include <mb/codegen/definable.h>
 #include <mb/codegen/expression.h>
+#include <mb/codegen/instrument.h>
 #include <mb/codegen/lambda.h>
+#include <mb/codegen/project.h>
 #include <mb/codegen/statement.h>
+#include <mb/codegen/statement_stream.h>
+#include <mb/codegen/value.h>
 #include <mb/codegen/writer.h>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
 
 TEST(codegen, call) {
    using namespace mb::codegen;
@@ -301,3 +322,1589 @@ void foo() {
 }
 )");
 }
+
+TEST(codegen, writer_memory) {
+   using namespace mb::codegen;
+
+   writer w;
+   w.scope("void foo()");
+   w.line("return {} + {};", 2, 3);
+   w.descope();
+
+   EXPECT_EQ(w.view(), "void foo() {\n   return 2 + 3;\n}\n");
+}
+
+TEST(codegen, writer_callback_sink) {
+   using namespace mb::codegen;
+
+   std::string output;
+   std::size_t flush_count{};
+   callback_sink sink([&output, &flush_count](std::string_view data) {
+      output.append(data);
+      ++flush_count;
+   });
+
+   std::string expected;
+   {
+      writer w(sink);
+      for (int i = 0; i < 40; ++i) {
+         w.indent_in();
+      }
+      for (int i = 0; i < 10000; ++i) {
+         w.line("value_{} = {};", i, i * 2);
+         expected.append(120, ' ');
+         expected.append(fmt::format("value_{} = {};\n", i, i * 2));
+      }
+   }
+
+   EXPECT_EQ(output, expected);
+   EXPECT_LT(flush_count, 10000 / 100);
+}
+
+TEST(codegen, write_if_changed) {
+   using namespace mb::codegen;
+
+   auto dir = std::filesystem::temp_directory_path() / fmt::format("codegen_test_{}", ::getpid());
+   std::filesystem::create_directories(dir);
+
+   component cmp("mb::foo::bar");
+   cmp << function("void", "foo", std::vector<arg>(), [](statement::collector &col) {
+      col << raw("foo()");
+   });
+
+   auto first = cmp.write_files(dir / "foo.h", dir / "foo.cpp");
+   EXPECT_EQ(first.written.size(), 2);
+   EXPECT_TRUE(first.unchanged.empty());
+
+   auto second = cmp.write_files(dir / "foo.h", dir / "foo.cpp");
+   EXPECT_TRUE(second.written.empty());
+   EXPECT_EQ(second.unchanged.size(), 2);
+
+   cmp << function("void", "bar", std::vector<arg>(), [](statement::collector &col) {
+      col << raw("bar()");
+   });
+   EXPECT_TRUE(cmp.write_source_file(dir / "foo.cpp"));
+
+   std::ifstream source(dir / "foo.cpp");
+   std::stringstream contents;
+   contents << source.rdbuf();
+   std::stringstream expected;
+   cmp.write_source(expected);
+   EXPECT_EQ(contents.str(), expected.str());
+
+   std::filesystem::remove_all(dir);
+}
+
+namespace {
+
+mb::codegen::call nested_call(int depth) {
+   using namespace mb::codegen;
+   if (depth == 0)
+      return call("leaf");
+   return call("f", nested_call(depth - 1), raw("x"));
+}
+
+mb::codegen::if_statement nested_if(int depth) {
+   using namespace mb::codegen;
+   return if_statement(raw("a"), [depth](statement::collector &col) {
+      if (depth > 0) {
+         col << nested_if(depth - 1);
+      }
+      col << nested_call(2);
+   });
+}
+
+template<typename F>
+std::size_t count_allocations(F &&f) {
+   auto before = allocation_count();
+   f();
+   return allocation_count() - before;
+}
+
+}// namespace
+
+TEST(codegen, move_nested) {
+   using namespace mb::codegen;
+
+   std::stringstream ss;
+   {
+      writer w(ss);
+      nested_call(3).write_expression(w);
+   }
+   EXPECT_EQ(ss.str(), "f(f(f(leaf(), x), x), x)");
+
+   auto calls = [](int depth) {
+      return count_allocations([depth] {
+         component cmp("foo");
+         cmp << function("void", "foo", std::vector<arg>(), [depth](statement::collector &col) {
+            col << nested_call(depth);
+         });
+      });
+   };
+   EXPECT_EQ(calls(200) - calls(100), calls(100) - calls(0));
+
+   auto ifs = [](int depth) {
+      return count_allocations([depth] {
+         class_spec cls("foo");
+         cls.add_public(method("void", "foo", {}, [depth](statement::collector &col) {
+            col << nested_if(depth);
+         }));
+      });
+   };
+   EXPECT_EQ(ifs(200) - ifs(100), ifs(100) - ifs(0));
+}
+
+namespace {
+
+void add_functions(mb::codegen::component &cmp, int count) {
+   using namespace mb::codegen;
+   for (int i = 0; i < count; ++i) {
+      cmp << function("void", "function_with_a_long_name", std::vector<arg>(), [i](statement::collector &col) {
+         col << call("some_function_to_call_with_a_long_name", raw("argument_number_{}", i), nested_call(2));
+         col << if_statement(raw("condition_value_{} == expected_value", i), [](statement::collector &col) {
+            col << return_statement(raw("value_of_something_that_is_long"));
+         });
+      });
+   }
+}
+
+}// namespace
+
+TEST(codegen, context) {
+   using namespace mb::codegen;
+
+   std::stringstream expected;
+   std::size_t heap_allocations{};
+   {
+      component cmp("foo");
+      heap_allocations = count_allocations([&] {
+         add_functions(cmp, 100);
+      });
+      cmp.write_source(expected);
+   }
+
+   std::stringstream actual;
+   std::size_t allocations{};
+   {
+      context ctx;
+      auto cmp = ctx.make<component>("foo");
+      allocations = count_allocations([&] {
+         context::scope scope(ctx);
+         add_functions(*cmp, 100);
+      });
+      cmp->write_source(actual);
+   }
+
+   EXPECT_EQ(actual.str(), expected.str());
+   EXPECT_LT(allocations * 5, heap_allocations);
+}
+
+TEST(codegen, context_lazy_body) {
+   using namespace mb::codegen;
+
+   auto captured = std::make_shared<int>(0);
+   std::stringstream source;
+   {
+      context ctx;
+      context::scope scope(ctx);
+      auto cmp = make_node<component>("foo");
+      class_spec cls("bar");
+      for (int i = 0; i < 10; ++i) {
+         cls.add_public(method("int", fmt::format("value_{}", i), {}, true, block::lazy([captured, i](statement::collector &col) {
+                                  col << return_statement(raw(fmt::format("{} + {}", *captured, i)));
+                               }, block::memoization::memoize)));
+      }
+      *cmp << cls;
+      cmp->write_source(source);
+      EXPECT_GT(captured.use_count(), 1);
+   }
+   EXPECT_NE(source.str().find("return 0 + 9;"), std::string::npos);
+   // the generators and the memoized statements are released with the context
+   EXPECT_EQ(captured.use_count(), 1);
+}
+
+TEST(codegen, shared_copy) {
+   using namespace mb::codegen;
+
+   auto make_class = [](int methods) {
+      class_spec cls("foo");
+      for (int i = 0; i < methods; ++i) {
+         cls.add_public(method("void", "method_with_a_long_name", {}, [](statement::collector &col) {
+            col << nested_if(4);
+         }));
+      }
+      return cls;
+   };
+   auto copies = [](const class_spec &cls) {
+      return count_allocations([&cls] {
+         auto copy = cls.copy();
+      });
+   };
+   auto small = make_class(1);
+   auto large = make_class(100);
+   EXPECT_EQ(copies(large), copies(small));
+
+   auto render = [](const definable &def) {
+      std::stringstream ss;
+      {
+         writer w(ss);
+         def.write_declaration(w);
+         def.write_definition(w);
+      }
+      return ss.str();
+   };
+   auto before = render(large);
+   auto copy = large.copy();
+   large.add_public("int", "extra");
+   EXPECT_EQ(render(*copy), before);
+   EXPECT_NE(render(large), before);
+
+   switch_statement sw(raw("value"));
+   sw.add(raw("1"), [](statement::collector &col) {
+      col << raw("one()");
+   });
+   auto sw_copy = sw.copy();
+   sw.add(raw("2"), [](statement::collector &col) {
+      col << raw("two()");
+   });
+   std::stringstream original, copied;
+   {
+      writer w(original);
+      sw.write_statement(w);
+   }
+   {
+      writer w(copied);
+      sw_copy->write_statement(w);
+   }
+   EXPECT_NE(original.str().find("two()"), std::string::npos);
+   EXPECT_EQ(copied.str().find("two()"), std::string::npos);
+}
+
+TEST(codegen, symbols) {
+   using namespace mb::codegen;
+
+   std::string type_name("const std::vector<std::string> &");
+   symbol a(type_name);
+   symbol b("const std::vector<std::string> &");
+   EXPECT_EQ(a, b);
+   EXPECT_EQ(a.data(), b.data());
+   EXPECT_FALSE(a == symbol("int"));
+   EXPECT_EQ(symbol(""), symbol());
+   EXPECT_EQ(fmt::format("{}", a), type_name);
+
+   std::vector<arg> args{{type_name, "argument_with_a_long_name"}, {type_name, "another_argument_with_a_long_name"}};
+   auto allocations = count_allocations([&args] {
+      auto copy = args;
+   });
+   EXPECT_EQ(allocations, 1);
+
+   std::stringstream ss;
+   {
+      auto var = [] {
+         std::string type("std::vector<int>");
+         std::string name("global_values");
+         return globalvar(type, name, raw("{1, 2, 3}"));
+      }();
+      auto fun = [] {
+         std::string type("std::size_t");
+         std::string name("count_values");
+         return function(type, name, {}, [](statement::collector &col) {
+            col << return_statement(raw("global_values.size()"));
+         });
+      }();
+      writer w(ss);
+      var.write_definition(w);
+      fun.write_declaration(w);
+   }
+   EXPECT_EQ(ss.str(), "std::vector<int> global_values = {1, 2, 3};\nstd::size_t count_values();\n");
+}
+
+namespace {
+
+// counter - a user defined expression, lowered as a foreign node
+class counter : public mb::codegen::expression {
+ public:
+   void write_expression(mb::codegen::writer &w) const override {
+      w.write("counter++");
+   }
+
+   [[nodiscard]] ptr copy() const override {
+      return mb::codegen::make_node<counter>(*this);
+   }
+};
+
+mb::codegen::component make_every_node_component(bool with_foreign = true) {
+   using namespace mb::codegen;
+
+   component cmp("mb::flat", "MB_FLAT_H");
+   cmp.header_include("vector");
+   cmp.header_include_local("other.h");
+   cmp.source_include_local("flat.h");
+
+   cmp << globalvar("int", "global_value", binary_operator(raw("1"), "+", raw("2")));
+   cmp << function("void", "foo", {{"int", "a"}, {"std::vector<int> &", "values"}}, [with_foreign](statement::collector &col) {
+      auto next = with_foreign ? expression::ptr(make_node<counter>()) : expression::ptr(make_node<raw>("counter++"));
+      col << assign("a", call("bar", raw("a"), std::move(next)));
+      col << method_call(deref(raw("ptr")), "reset");
+      col << method_call(raw("values"), "push_back", raw("a"));
+      col << ranged_for_statement("int", "value", raw("values"), [](statement::collector &col) {
+         col << return_statement();
+      });
+      col << if_statement(raw("a"), [](statement::collector &) {}, [](statement::collector &col) {
+         col << raw("only_else()");
+      });
+      col << if_statement(raw("a"), [](statement::collector &col) {
+                col << raw("only_then()");
+             }).with_constexpr();
+      if_switch_statement cases;
+      cases.add_case(raw("a == 1"), [](statement::collector &col) {
+         col << raw("one()");
+      });
+      cases.add_case(raw("a == 2"), [](statement::collector &col) {
+         col << raw("two()");
+      });
+      col << cases;
+      switch_statement sw(raw("a"));
+      sw.add(raw("1"), [](statement::collector &col) {
+         col << raw("one()");
+      });
+      sw.add_default_noscope([](statement::collector &col) {
+         col << raw("other()");
+      });
+      col << sw;
+      col << lambda({{"int", "x"}}, [](statement::collector &col) {
+         col << return_statement(raw("x"));
+      }, raw("&a"));
+   });
+   cmp << template_arguments({{"typename", "T"}}, function("T", "make", {}, [](statement::collector &col) {
+      col << return_statement(raw("T{}"));
+   }));
+
+   class_spec cls("foo", "FOO_H");
+   cls.add_public(default_constructor());
+   cls.add_public(constructor({{"int", "value"}}, [](statement::collector &col) {
+      col << assign("m_value", raw("value"));
+   }));
+   cls.add_public(method("int", "value", {}, true, [](statement::collector &col) {
+      col << return_statement(raw("m_value"));
+   }));
+   cls.add_public(method_template("T", "as", {{"typename", "T"}}, {}, true, [](statement::collector &col) {
+      col << return_statement(raw("static_cast<T>(m_value)"));
+   }));
+   cls.add_private(static_method("int", "twice", {{"int", "v"}}, [](statement::collector &col) {
+      col << return_statement(binary_operator(raw("v"), "*", raw("2")));
+   }));
+   items values;
+   struct_constructor pair;
+   pair.add(raw("1"));
+   pair.add(raw("2"));
+   values.add(pair);
+   cls.add_private(static_attribute("std::vector<std::pair<int, int>>", "s_values", values));
+   cls.add_public("int", "m_public", false);
+   cls.add_private("int", "m_value");
+   cmp << cls;
+   return cmp;
+}
+
+}// namespace
+
+TEST(codegen, flat) {
+   using namespace mb::codegen;
+
+   auto cmp = make_every_node_component();
+   auto tree = cmp.lower();
+
+   writer expected_header, expected_source;
+   cmp.write_header(expected_header);
+   cmp.write_source(expected_source);
+   writer header, source;
+   tree.write_header(header);
+   tree.write_source(source);
+
+   EXPECT_EQ(header.view(), expected_header.view());
+   EXPECT_EQ(source.view(), expected_source.view());
+   EXPECT_NE(source.view().find("counter++"), std::string_view::npos);
+   EXPECT_EQ(tree.node(tree.root()).kind, flat_kind::component);
+}
+
+TEST(codegen, values) {
+   using namespace mb::codegen;
+
+   auto body = [](statement::collector &col) {
+      col << assign("a", call("bar", raw("a"), counter()));
+      col << method_call(deref(raw("ptr")), "reset");
+      col << if_statement(binary_operator(raw("a"), "<", raw("b")), [](statement::collector &col) {
+         col << return_statement(raw("a"));
+      });
+      switch_statement sw(raw("a"));
+      sw.add_noscope(raw("1"), [](statement::collector &col) {
+         col << raw("one()");
+      });
+      col << sw;
+      col << ranged_for_statement("int", "value", raw("values"), [](statement::collector &col) {
+         col << call(lambda({{"int", "x"}}, [](statement::collector &) {}, raw("&value")));
+      });
+      col << return_statement();
+   };
+
+   node_vector<statement_value> values;
+   values.emplace_back(expr_value{assign_value{symbol("a"), call_value{raw_value{"bar"}, {raw_value{"a"}, any_expression(counter())}}}});
+   values.emplace_back(expr_value{method_call_value{deref_value{raw_value{"ptr"}}, symbol("reset"), {}}});
+   values.emplace_back(if_value{binary_operator_value{raw_value{"a"}, symbol("<"), raw_value{"b"}}, {return_value{raw_value{"a"}}}, {}});
+   values.emplace_back(switch_value{raw_value{"a"}, {{raw_value{"1"}, {expr_value{raw_value{"one()"}}}, false}}, {}});
+   values.emplace_back(ranged_for_value{symbol("int"), symbol("value"), raw_value{"values"}, {expr_value{call_value{lambda_value{{raw_value{"&value"}}, {{"int", "x"}}, {}}, {}}}}});
+   values.emplace_back(return_value{});
+
+   std::stringstream expected, actual;
+   {
+      writer w(expected);
+      function("void", "foo", {}, body).write_definition(w);
+   }
+   {
+      writer w(actual);
+      function("void", "foo", {}, [&values](statement::collector &col) {
+         for (const auto &value : values) {
+            col << value_statement(value);
+         }
+      }).write_definition(w);
+   }
+   EXPECT_EQ(actual.str(), expected.str());
+
+   items_value list;
+   for (int i = 0; i < 100; ++i) {
+      list.items.emplace_back(raw_value{"x"});
+   }
+   auto allocations = count_allocations([&list] {
+      auto copy = list;
+   });
+   EXPECT_EQ(allocations, 1);
+}
+
+TEST(codegen, generator_no_allocation) {
+   using namespace mb::codegen;
+
+   auto small = count_allocations([] {
+      if_statement stmt(raw("a"), [](statement::collector &col) {
+         col << raw("b");
+      });
+   });
+   auto large = count_allocations([] {
+      std::array<std::size_t, 16> captured{};
+      if_statement stmt(raw("a"), [captured](statement::collector &col) {
+         col << raw("b{}", captured.size());
+      });
+   });
+   EXPECT_EQ(large, small);
+}
+
+void free_generator(mb::codegen::statement::collector &col) {
+   col << mb::codegen::raw("b()");
+}
+
+TEST(codegen, generator_free_function) {
+   using namespace mb::codegen;
+
+   auto *pointer = &free_generator;
+   std::stringstream ss;
+   {
+      writer w(ss);
+      if_statement(raw("a"), free_generator).write_statement(w);
+      if_statement(raw("c"), pointer).write_statement(w);
+   }
+   EXPECT_EQ(ss.str(), R"(if (a) {
+   b();
+}
+if (c) {
+   b();
+}
+)");
+}
+
+TEST(codegen, lazy_body) {
+   using namespace mb::codegen;
+
+   auto body = [](statement::collector &col) {
+      col << call("compute", raw("a"));
+      col << return_statement(raw("a"));
+   };
+   auto build = [&body](block::memoization mode, int &generated) {
+      auto counted = [&body, &generated](statement::collector &col) {
+         ++generated;
+         body(col);
+      };
+      auto assigned = [&generated](statement::collector &col) {
+         ++generated;
+         col << assign("m_a", raw("a"));
+      };
+      component cmp("foo");
+      cmp << function("int", "foo", {{"int", "a"}}, block::lazy(counted, mode));
+      class_spec cls("bar");
+      cls.add_public(method("int", "bar", {{"int", "a"}}, true, block::lazy(counted, mode)));
+      cls.add_public(constructor({{"int", "a"}}, block::lazy(assigned, mode)));
+      cmp << cls;
+      return cmp;
+   };
+
+   component eager("foo");
+   eager << function("int", "foo", {{"int", "a"}}, body);
+   class_spec cls("bar");
+   cls.add_public(method("int", "bar", {{"int", "a"}}, true, body));
+   cls.add_public(constructor({{"int", "a"}}, [](statement::collector &col) {
+      col << assign("m_a", raw("a"));
+   }));
+   eager << cls;
+   std::stringstream expected_header, expected_source;
+   eager.write_header(expected_header);
+   eager.write_source(expected_source);
+
+   int generated{};
+   auto lazy = build(block::memoization::regenerate, generated);
+   std::stringstream header;
+   lazy.write_header(header);
+   EXPECT_EQ(header.str(), expected_header.str());
+   EXPECT_EQ(generated, 0);
+
+   for (int i = 0; i < 2; ++i) {
+      std::stringstream source;
+      lazy.write_source(source);
+      EXPECT_EQ(source.str(), expected_source.str());
+   }
+   EXPECT_EQ(generated, 6);
+
+   int memo_generated{};
+   auto memoized = build(block::memoization::memoize, memo_generated);
+   for (int i = 0; i < 2; ++i) {
+      std::stringstream source;
+      memoized.write_source(source);
+      EXPECT_EQ(source.str(), expected_source.str());
+   }
+   EXPECT_EQ(memo_generated, 3);
+}
+
+TEST(codegen, parallel_build) {
+   using namespace mb::codegen;
+
+   std::atomic<int> generated{};
+   std::mutex threads_mutex;
+   std::condition_variable helped;
+   std::set<std::thread::id> threads;
+   bool parallel_run = false;
+   auto build = [&](block::memoization mode) {
+      component cmp("foo");
+      class_spec cls("bar");
+      for (int i = 0; i < 64; ++i) {
+         auto body = [&, i](statement::collector &col) {
+            ++generated;
+            if (parallel_run) {
+               // the caller also runs tasks while waiting, hold the first one until a worker takes over
+               std::unique_lock lock(threads_mutex);
+               threads.insert(std::this_thread::get_id());
+               helped.notify_all();
+               helped.wait_for(lock, std::chrono::seconds(5), [&threads] { return threads.size() > 1; });
+            }
+            for (int j = 0; j < i; ++j) {
+               col << call(fmt::format("step_{}", j), raw("a"));
+            }
+            col << return_statement(raw("a"));
+         };
+         cmp << function("int", fmt::format("foo_{}", i), {{"int", "a"}}, block::lazy(body, mode));
+         cls.add_public(method("int", fmt::format("bar_{}", i), {{"int", "a"}}, true, block::lazy(body, mode)));
+      }
+      cls.add_public(method("void", "eager", {}, [](statement::collector &col) {
+         col << call("run");
+      }));
+      cmp << cls;
+      return cmp;
+   };
+
+   auto serial = build(block::memoization::regenerate);
+   writer serial_header, serial_source;
+   serial.write_header(serial_header);
+   serial.write_source(serial_source);
+
+   thread_pool pool(4);
+   parallel_run = true;
+   for (auto mode : {block::memoization::regenerate, block::memoization::memoize}) {
+      generated = 0;
+      auto parallel = build(mode);
+      writer header, source;
+      parallel.write_header(header, pool);
+      parallel.write_source(source, pool);
+      EXPECT_EQ(header.view(), serial_header.view());
+      EXPECT_EQ(source.view(), serial_source.view());
+      EXPECT_EQ(generated, 128);
+   }
+   EXPECT_GT(threads.size(), 1);
+
+   task_group tasks(pool);
+   tasks.run([] { throw std::runtime_error("generator failed"); });
+   EXPECT_THROW(tasks.wait(), std::runtime_error);
+}
+
+TEST(codegen, project) {
+   using namespace mb::codegen;
+
+   auto dir = std::filesystem::temp_directory_path() / fmt::format("codegen_project_{}", ::getpid());
+   auto serial_dir = dir / "serial";
+   std::filesystem::create_directories(serial_dir);
+
+   project proj(3);
+   std::size_t expected_bytes{};
+   for (int i = 0; i < 20; ++i) {
+      component cmp(fmt::format("foo_{}", i));
+      cmp.header_include("string");
+      if (i % 2 == 1)
+         cmp.set_style(writer_style{.compact = true});
+      for (int j = 0; j <= i; ++j) {
+         cmp << function("void", fmt::format("bar_{}", j), {{"int", "a"}}, [j](statement::collector &col) {
+            col << call(fmt::format("baz_{}", j), raw("a"));
+         });
+      }
+      auto header = fmt::format("foo_{}.h", i);
+      auto source = fmt::format("foo_{}.cpp", i);
+      cmp.write_files(serial_dir / header, serial_dir / source);
+      expected_bytes += std::filesystem::file_size(serial_dir / header) + std::filesystem::file_size(serial_dir / source);
+      proj.add(std::move(cmp), dir / header, dir / source);
+   }
+   EXPECT_EQ(proj.size(), 20);
+
+   thread_pool pool(4);
+   auto first = proj.write(pool);
+   EXPECT_EQ(first.component_count, 20);
+   EXPECT_EQ(first.file_count, 40);
+   EXPECT_EQ(first.files.written.size(), 40);
+   EXPECT_EQ(first.bytes, expected_bytes);
+   EXPECT_EQ(first.files.written.front(), dir / "foo_0.h");
+   EXPECT_EQ(first.files.written.back(), dir / "foo_19.cpp");
+
+   auto read = [](const std::filesystem::path &path) {
+      std::ifstream file(path);
+      std::stringstream contents;
+      contents << file.rdbuf();
+      return contents.str();
+   };
+   for (int i = 0; i < 20; ++i) {
+      EXPECT_EQ(read(dir / fmt::format("foo_{}.h", i)), read(serial_dir / fmt::format("foo_{}.h", i)));
+      EXPECT_EQ(read(dir / fmt::format("foo_{}.cpp", i)), read(serial_dir / fmt::format("foo_{}.cpp", i)));
+   }
+
+   auto second = proj.write(pool);
+   EXPECT_TRUE(second.files.written.empty());
+   EXPECT_EQ(second.files.unchanged, first.files.written);
+   EXPECT_EQ(second.bytes, expected_bytes);
+
+   std::filesystem::remove_all(dir);
+}
+
+TEST(codegen, project_shard) {
+   using namespace mb::codegen;
+
+   EXPECT_EQ(project_shard::parse("2/4").index, 2);
+   EXPECT_EQ(project_shard::parse("2/4").count, 4);
+   EXPECT_THROW((void) project_shard::parse("4/4"), std::invalid_argument);
+   EXPECT_THROW((void) project_shard::parse("1/0"), std::invalid_argument);
+   EXPECT_THROW((void) project_shard::parse("1"), std::invalid_argument);
+   EXPECT_THROW((void) project_shard::parse("a/2"), std::invalid_argument);
+
+   auto dir = std::filesystem::temp_directory_path() / fmt::format("codegen_shard_{}", ::getpid());
+   std::atomic<std::size_t> built{};
+   auto make_project = [&built](const std::filesystem::path &out) {
+      project proj;
+      for (int i = 0; i < 30; ++i) {
+         proj.add_lazy([&built, i] {
+            ++built;
+            component cmp(fmt::format("foo_{}", i));
+            cmp << function("int", fmt::format("bar_{}", i), {}, [i](statement::collector &col) {
+               col << return_statement(raw(fmt::format("{}", i)));
+            });
+            return cmp;
+         }, out / "include" / fmt::format("foo_{}.h", i), out / fmt::format("foo_{}.cpp", i));
+      }
+      return proj;
+   };
+
+   std::filesystem::create_directories(dir / "whole" / "include");
+   auto whole = make_project(dir / "whole");
+   EXPECT_EQ(whole.write().component_count, 30);
+   whole.write_aggregate(dir / "whole" / "all.h");
+
+   // every shard runs in its own process, as it would on separate machines
+   constexpr mb::u32 shard_count = 3;
+   auto sharded_dir = dir / "sharded";
+   std::filesystem::create_directories(sharded_dir / "include");
+   std::vector<pid_t> children;
+   for (mb::u32 i = 0; i < shard_count; ++i) {
+      auto pid = ::fork();
+      ASSERT_GE(pid, 0);
+      if (pid == 0) {
+         auto proj = make_project(sharded_dir);
+         auto report = proj.write(project_shard{i, shard_count});
+         ::_exit(report.file_count == report.component_count * 2 ? 0 : 1);
+      }
+      children.push_back(pid);
+   }
+   for (auto pid : children) {
+      int status{};
+      ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+      EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   }
+   make_project(sharded_dir).write_aggregate(sharded_dir / "all.h");
+
+   auto read = [](const std::filesystem::path &path) {
+      std::ifstream file(path);
+      std::stringstream contents;
+      contents << file.rdbuf();
+      return contents.str();
+   };
+   std::size_t file_count{};
+   for (const auto &file : std::filesystem::recursive_directory_iterator(dir / "whole")) {
+      if (!file.is_regular_file())
+         continue;
+      auto relative = file.path().lexically_relative(dir / "whole");
+      EXPECT_EQ(read(sharded_dir / relative), read(file.path())) << relative;
+      ++file_count;
+   }
+   EXPECT_EQ(file_count, 61);
+   EXPECT_NE(read(sharded_dir / "all.h").find("#include \"include/foo_29.h\""), std::string::npos);
+
+   // a shard builds only the components it owns
+   std::size_t owned{};
+   for (mb::u32 i = 0; i < shard_count; ++i) {
+      built = 0;
+      auto count = make_project(sharded_dir).write(project_shard{i, shard_count}).component_count;
+      EXPECT_LT(count, 30);
+      EXPECT_EQ(built, count);
+      owned += count;
+   }
+   EXPECT_EQ(owned, 30);
+   // only the file name of the header decides
+   project_shard first{0, shard_count};
+   EXPECT_EQ(first.owns("include/foo_0.h"), first.owns("other/foo_0.h"));
+
+   std::filesystem::remove_all(dir);
+}
+
+TEST(codegen, streaming_component) {
+   using namespace mb::codegen;
+
+   auto add_elements = [](auto &cmp) {
+      for (int i = 0; i < 8; ++i) {
+         class_spec cls(fmt::format("foo_{}", i));
+         cls.add_private("int", "m_value");
+         cls.add_public(method("int", "value", {}, true, [](statement::collector &col) {
+            col << return_statement(raw("m_value"));
+         }));
+         cmp << cls;
+         cmp << function("void", fmt::format("bar_{}", i), {{"int", "a"}}, [i](statement::collector &col) {
+            col << call("baz", raw("a"), raw(fmt::format("{}", i)));
+         });
+      }
+   };
+
+   component expected("mb::foo", "FOO_H");
+   expected.header_include("string");
+   expected.source_include_local("foo.h");
+   add_elements(expected);
+   std::stringstream expected_header, expected_source;
+   expected.write_header(expected_header);
+   expected.write_source(expected_source);
+
+   std::stringstream header_stream, source_stream;
+   writer header(header_stream), source(source_stream);
+   streaming_component streaming(header, source, "mb::foo", "FOO_H");
+   streaming.header_include("string");
+   streaming.source_include_local("foo.h");
+   add_elements(streaming);
+   EXPECT_THROW(streaming.header_include("vector"), std::logic_error);
+   streaming.finish();
+
+   EXPECT_EQ(header_stream.str(), expected_header.str());
+   EXPECT_EQ(source_stream.str(), expected_source.str());
+
+   std::stringstream unfinished_header, unfinished_source;
+   {
+      writer header(unfinished_header), source(unfinished_source);
+      streaming_component unfinished(header, source, "mb::foo", "FOO_H");
+      unfinished.header_include("string");
+      unfinished.source_include_local("foo.h");
+      add_elements(unfinished);
+   }
+   EXPECT_EQ(unfinished_header.str(), expected_header.str());
+   EXPECT_EQ(unfinished_source.str(), expected_source.str());
+}
+
+namespace {
+
+// live_statement - counts statements alive at the same time
+class live_statement : public mb::codegen::statement {
+   int m_index;
+
+ public:
+   static inline int live{};
+   static inline int peak{};
+
+   explicit live_statement(int index) : m_index(index) {
+      peak = std::max(peak, ++live);
+   }
+
+   live_statement(const live_statement &other) : live_statement(other.m_index) {}
+
+   ~live_statement() noexcept override {
+      --live;
+   }
+
+   void write_statement(mb::codegen::writer &w) const override {
+      w.line("case_{}();", m_index);
+   }
+
+   [[nodiscard]] ptr copy() const override {
+      return mb::codegen::make_node<live_statement>(*this);
+   }
+};
+
+mb::codegen::statement_stream dispatch(int count) {
+   for (int i = 0; i < count; ++i) {
+      co_yield live_statement(i);
+   }
+   co_yield mb::codegen::return_statement(mb::codegen::raw("0"));
+}
+
+}// namespace
+
+TEST(codegen, statement_stream) {
+   using namespace mb::codegen;
+
+   constexpr int count = 10000;
+   auto eager_body = [](statement::collector &col) {
+      for (int i = 0; i < count; ++i) {
+         col << live_statement(i);
+      }
+      col << return_statement(raw("0"));
+   };
+   std::stringstream expected;
+   {
+      component cmp("foo");
+      cmp << function("int", "dispatch", {}, eager_body);
+      class_spec cls("bar");
+      cls.add_public(method("int", "dispatch", {}, true, eager_body));
+      cmp << cls;
+      cmp << globalvar("auto", "handler", lambda({}, eager_body));
+      cmp.write_source(expected);
+   }
+
+   live_statement::peak = 0;
+   auto streamed = block::stream([] { return dispatch(count); });
+   component cmp("foo");
+   cmp << function("int", "dispatch", {}, streamed);
+   class_spec cls("bar");
+   cls.add_public(method("int", "dispatch", {}, true, streamed));
+   cmp << cls;
+   cmp << globalvar("auto", "handler", lambda({}, streamed));
+   std::stringstream source;
+   cmp.write_source(source);
+   EXPECT_EQ(source.str(), expected.str());
+   // the yielded temporary and the node taken from it
+   EXPECT_LE(live_statement::peak, 2);
+   EXPECT_EQ(live_statement::live, 0);
+
+   auto failing = block::stream([]() -> statement_stream {
+      co_yield raw("a");
+      throw std::runtime_error("schema error");
+   });
+   writer w;
+   EXPECT_THROW(failing.write(w), std::runtime_error);
+}
+
+TEST(codegen, render_cache) {
+   using namespace mb::codegen;
+
+   auto build = [](int changed) {
+      component cmp("foo");
+      for (int i = 0; i < 10; ++i) {
+         class_spec cls(fmt::format("bar_{}", i));
+         cls.add_public(method("int", "value", {}, true, [i, changed](statement::collector &col) {
+            col << return_statement(raw(i == changed ? "1" : "0"));
+         }));
+         cmp << cls;
+      }
+      cmp << globalvar("int", "next", counter());
+      return cmp;
+   };
+
+   EXPECT_EQ(raw("a").fingerprint(), raw("a").fingerprint());
+   EXPECT_NE(raw("a").fingerprint(), raw("b").fingerprint());
+   EXPECT_NE(call("f", raw("a")).fingerprint(), call("f", raw("a"), raw("b")).fingerprint());
+   EXPECT_NE(method("int", "f", {}, true, [](statement::collector &) {}).fingerprint(),
+             method("int", "f", {}, false, [](statement::collector &) {}).fingerprint());
+
+   auto dir = std::filesystem::temp_directory_path() / fmt::format("codegen_cache_{}", ::getpid());
+   std::filesystem::create_directories(dir);
+   auto cache_path = dir / "render.cache";
+
+   render_cache cache;
+   EXPECT_FALSE(cache.load(cache_path));
+   auto first = build(-1);
+   writer header, source;
+   first.write(header, source, cache);
+   EXPECT_EQ(cache.hits(), 0);
+   EXPECT_EQ(cache.misses(), 11);
+   EXPECT_TRUE(cache.save(cache_path));
+
+   render_cache next;
+   EXPECT_TRUE(next.load(cache_path));
+   EXPECT_EQ(next.size(), 11);
+   auto second = build(3);
+   writer cached_header, cached_source;
+   second.write(cached_header, cached_source, next);
+   EXPECT_EQ(next.hits(), 10);
+   EXPECT_EQ(next.misses(), 1);
+   EXPECT_NEAR(next.hit_rate(), 10.0 / 11.0, 1e-9);
+
+   writer expected_header, expected_source;
+   second.write_header(expected_header);
+   second.write_source(expected_source);
+   EXPECT_EQ(cached_header.view(), expected_header.view());
+   EXPECT_EQ(cached_source.view(), expected_source.view());
+
+   // only the entries used by the last run are kept
+   EXPECT_TRUE(next.save(cache_path));
+   render_cache last;
+   EXPECT_TRUE(last.load(cache_path));
+   EXPECT_EQ(last.size(), 11);
+
+   // each text is cached apart for the style of the writer rendering it
+   render_cache styled;
+   writer plain_header, compact_source;
+   compact_source.set_style(writer_style{.compact = true});
+   second.write(plain_header, compact_source, styled);
+   writer styled_header, styled_source;
+   second.write(styled_header, styled_source, styled);
+   EXPECT_EQ(styled.hits(), 0);
+   EXPECT_EQ(styled_header.view(), expected_header.view());
+   EXPECT_EQ(styled_source.view(), expected_source.view());
+
+   // fingerprints are kept by the nodes and follow edits
+   class_spec edited("baz");
+   auto empty = edited.fingerprint();
+   auto copy = edited;
+   edited.add_public("int", "m_value");
+   EXPECT_NE(edited.fingerprint(), empty);
+   EXPECT_EQ(copy.fingerprint(), empty);
+
+   // lazy bodies are never generated for their fingerprint, a body without a key is never cached
+   int generated{};
+   auto lazy_component = [&generated] {
+      component cmp("foo");
+      auto body = [&generated](statement::collector &col) {
+         ++generated;
+         col << return_statement(raw("0"));
+      };
+      cmp << function("int", "keyed", {}, block::lazy(body, block::memoization::regenerate, 42));
+      cmp << function("int", "unkeyed", {}, block::lazy(body));
+      return cmp;
+   };
+   render_cache lazy_cache;
+   auto lazy_first = lazy_component();
+   writer lazy_header, lazy_source;
+   lazy_first.write(lazy_header, lazy_source, lazy_cache);
+   EXPECT_EQ(generated, 2);
+   EXPECT_EQ(lazy_cache.misses(), 1);
+
+   auto lazy_second = lazy_component();
+   writer lazy_cached_header, lazy_cached_source;
+   lazy_second.write(lazy_cached_header, lazy_cached_source, lazy_cache);
+   EXPECT_EQ(generated, 3);
+   EXPECT_EQ(lazy_cache.hits(), 1);
+   EXPECT_EQ(lazy_cached_source.view(), lazy_source.view());
+
+   std::filesystem::remove_all(dir);
+}
+
+TEST(codegen, render_memo) {
+   using namespace mb::codegen;
+
+   auto dispatch = [](statement::collector &col) {
+      switch_statement sw(raw("kind"));
+      for (int i = 0; i < 4; ++i) {
+         sw.add(raw(fmt::format("{}", i)), [i](statement::collector &col) {
+            col << call("handle", raw("value"), raw(fmt::format("{}", i)));
+            col << raw("break");
+         });
+      }
+      col << sw;
+   };
+
+   component cmp("foo");
+   for (int i = 0; i < 20; ++i) {
+      cmp << function("void", fmt::format("dispatch_{}", i), {{"int", "kind"}}, [&dispatch](statement::collector &col) {
+         dispatch(col);
+         col << if_statement(raw("nested"), dispatch);
+         col << assign("fn", lambda({{"int", "kind"}}, dispatch));
+      });
+   }
+   cmp << globalvar("auto", "handler", lambda({{"int", "kind"}}, dispatch));
+
+   auto tree = cmp.lower();
+   writer expected;
+   tree.write_source(expected);
+
+   tree.index_hashes();
+   render_memo memo;
+   writer w;
+   w.set_memo(&memo);
+   tree.write_source(w);
+   EXPECT_EQ(w.view(), expected.view());
+   EXPECT_GT(memo.hits(), 40);
+   // the switch is rendered once per indentation level
+   EXPECT_LT(memo.misses(), 10);
+
+   // writers of another style sharing the memo get text rendered in their own style
+   writer_style allman{.braces = brace_style::allman};
+   writer expected_allman, allman_writer;
+   expected_allman.set_style(allman);
+   allman_writer.set_style(allman);
+   allman_writer.set_memo(&memo);
+   tree.write_source(expected_allman);
+   tree.write_source(allman_writer);
+   EXPECT_NE(expected_allman.view(), expected.view());
+   EXPECT_EQ(allman_writer.view(), expected_allman.view());
+}
+
+TEST(codegen, flat_serialization) {
+   using namespace mb::codegen;
+
+   EXPECT_THROW((void) make_every_node_component().lower().serialize(), std::invalid_argument);
+
+   auto cmp = make_every_node_component(false);
+   auto tree = cmp.lower();
+   writer expected_header, expected_source;
+   cmp.write_header(expected_header);
+   cmp.write_source(expected_source);
+
+   auto dir = std::filesystem::temp_directory_path() / fmt::format("codegen_flat_{}", ::getpid());
+   std::filesystem::create_directories(dir);
+   auto path = dir / "component.ast";
+   EXPECT_TRUE(tree.save(path));
+   EXPECT_FALSE(tree.save(path));
+
+   {
+      auto mapped = flat_tree::map(path);
+      EXPECT_EQ(mapped.node_count(), tree.node_count());
+      writer header, source;
+      mapped.write_header(header);
+      mapped.write_source(source);
+      EXPECT_EQ(header.view(), expected_header.view());
+      EXPECT_EQ(source.view(), expected_source.view());
+      EXPECT_EQ(mapped.hash(mapped.root()), tree.hash(tree.root()));
+      EXPECT_EQ(mapped.serialize(), tree.serialize());
+   }
+
+   auto image = tree.serialize();
+   EXPECT_THROW((void) flat_tree::view(std::string_view(image).substr(0, image.size() - 1)), std::runtime_error);
+   auto outdated = image;
+   outdated[4] = static_cast<char>(flat_tree::format_version + 1);
+   EXPECT_THROW((void) flat_tree::view(outdated), std::runtime_error);
+
+   // every word of every node record pointing outside of the tree or into the middle of a record,
+   // a corrupted image is either rejected or renders safely
+   constexpr std::size_t nodes_offset = 56;
+   constexpr std::size_t node_words_offset = 24;
+   mb::u64 node_words{};
+   std::memcpy(&node_words, image.data() + node_words_offset, sizeof(node_words));
+   EXPECT_GT(node_words, tree.node_count());
+   for (std::size_t word = 0; word < node_words; ++word) {
+      for (mb::u32 invalid : {0x7ffffff0u, 1u}) {
+         auto corrupted = image;
+         std::memcpy(corrupted.data() + nodes_offset + word * sizeof(flat_index), &invalid, sizeof(invalid));
+         try {
+            auto loaded = flat_tree::view(corrupted);
+            writer header, source;
+            loaded.write_header(header);
+            loaded.write_source(source);
+         } catch (const std::runtime_error &) {
+         }
+      }
+   }
+   // the root component record comes first, its first operand is the namespace text
+   auto text_out_of_range = image;
+   text_out_of_range[nodes_offset + sizeof(flat_index) + 3] = 0x7f;
+   EXPECT_THROW((void) flat_tree::view(text_out_of_range), std::runtime_error);
+   auto unknown_kind = image;
+   unknown_kind[nodes_offset] = static_cast<char>(0xff);
+   EXPECT_THROW((void) flat_tree::view(unknown_kind), std::runtime_error);
+
+   std::filesystem::remove_all(dir);
+}
+
+TEST(codegen, component_builder) {
+   using namespace mb::codegen;
+
+   constexpr int thread_count = 4;
+   constexpr int per_thread = 50;
+   auto make = [](std::string_view type, std::string name) {
+      return function(type, std::move(name), {}, [](statement::collector &) {});
+   };
+   auto without_ties = [](std::string_view text) {
+      std::string result;
+      for (auto line : std::views::split(text, '\n')) {
+         std::string_view l(line.begin(), line.end());
+         if (!l.starts_with("void tie_")) {
+            result.append(l).push_back('\n');
+         }
+      }
+      return result;
+   };
+
+   component expected("foo");
+   expected.header_include("string");
+   expected.header_include_local("foo.h");
+   for (int i = 0; i < thread_count * per_thread; ++i) {
+      expected << make("int", fmt::format("foo_{}", i));
+   }
+   writer expected_header;
+   expected.write_header(expected_header);
+
+   std::string first_header;
+   for (int run = 0; run < 3; ++run) {
+      component_builder builder;
+      std::vector<std::thread> producers;
+      for (int t = 0; t < thread_count; ++t) {
+         producers.emplace_back([&builder, &make, t] {
+            auto &shard = builder.make_shard();
+            shard.header_include("string");
+            shard.header_include_local("foo.h");
+            // sequence numbers interleave between the threads
+            for (int i = per_thread - 1; i >= 0; --i) {
+               auto index = i * thread_count + t;
+               shard.add(static_cast<mb::u64>(index), make("int", fmt::format("foo_{}", index)));
+            }
+            // equal keys from different threads are ordered by their contents
+            shard.add("tie", make("void", fmt::format("tie_{}", t)));
+         });
+      }
+      for (auto &producer : producers) {
+         producer.join();
+      }
+
+      component cmp("foo");
+      builder.merge_into(cmp);
+      writer header;
+      cmp.write_header(header);
+      if (run == 0) {
+         first_header = header.view();
+      }
+      EXPECT_EQ(header.view(), first_header);
+      EXPECT_EQ(without_ties(header.view()), without_ties(expected_header.view()));
+   }
+}
+
+TEST(codegen, component_builder_lazy_ties) {
+   using namespace mb::codegen;
+
+   constexpr int shard_count = 4;
+   constexpr int per_shard = 8;
+   auto make = [](int index) {
+      return function("int", fmt::format("lazy_{}", index), {}, block::lazy([index](statement::collector &col) {
+         col << return_statement(raw("{}", index));
+      }));
+   };
+   EXPECT_EQ(make(0).fingerprint(), fingerprint_none);
+
+   std::string expected;
+   for (int i = 0; i < shard_count * per_shard; ++i) {
+      expected += fmt::format("int lazy_{}();\n", i);
+   }
+
+   for (int run = 0; run < 5; ++run) {
+      component_builder builder;
+      // shards are made in a fixed order, elements without a fingerprint keep the order of the shards
+      std::vector<component_builder::shard *> shards;
+      for (int t = 0; t < shard_count; ++t) {
+         shards.push_back(&builder.make_shard());
+      }
+      std::vector<std::thread> producers;
+      for (int t = shard_count - 1; t >= 0; --t) {
+         producers.emplace_back([&make, shard = shards[t], t] {
+            for (int i = 0; i < per_shard; ++i) {
+               shard->add("lazy", make(t * per_shard + i));
+            }
+         });
+      }
+      for (auto &producer : producers) {
+         producer.join();
+      }
+
+      component cmp("foo");
+      builder.merge_into(cmp);
+      writer header;
+      cmp.write_header(header);
+      EXPECT_NE(header.view().find(expected), std::string_view::npos) << header.view();
+   }
+}
+
+TEST(codegen, instrumentation) {
+   using namespace mb::codegen;
+
+   EXPECT_EQ(node_type_name<if_statement>(), "if_statement");
+
+   instrumentation stats("foo");
+   writer header, source;
+   {
+      instrumentation::scope recording(stats);
+      component cmp("foo");
+      cmp << function("int", "small", {}, [](statement::collector &col) {
+         col << return_statement(raw("0"));
+      });
+      cmp << function("int", "large", {{"int", "a"}}, [](statement::collector &col) {
+         for (int i = 0; i < 8; ++i) {
+            col << if_statement(raw("a > {}", i), [i](statement::collector &col) {
+               col << return_statement(call("compute", raw("{}", i)));
+            });
+         }
+         col << return_statement(raw("a"));
+      });
+      cmp.write_header(header);
+      cmp.write_source(source);
+   }
+
+   if constexpr (!instrumentation_enabled) {
+      EXPECT_TRUE(stats.nodes().empty());
+      EXPECT_TRUE(stats.definables().empty());
+      EXPECT_EQ(stats.node_allocations(), 0);
+      return;
+   }
+
+   EXPECT_EQ(stats.nodes().at("if_statement").constructed, 8);
+   EXPECT_EQ(stats.nodes().at("call").constructed, 8);
+   EXPECT_EQ(stats.nodes().at("function").constructed, 2);
+   EXPECT_GT(stats.node_allocations(), 0);
+   EXPECT_GT(stats.time(instrumentation::phase::generate).count(), 0);
+   EXPECT_GT(stats.time(instrumentation::phase::write).count(), 0);
+
+   ASSERT_EQ(stats.definables().size(), 4);
+   EXPECT_EQ(stats.definables()[0].label, "int small();");
+   EXPECT_EQ(stats.definables()[3].label, "int large(int a)");
+   std::size_t bytes{};
+   for (const auto &def : stats.definables()) {
+      bytes += def.bytes;
+   }
+   EXPECT_LT(bytes, header.view().size() + source.view().size());
+
+   auto text = stats.text();
+   EXPECT_NE(text.find("instrumentation foo"), std::string::npos);
+   EXPECT_NE(text.find(fmt::format("node allocations {} ", stats.node_allocations())), std::string::npos);
+   auto json = stats.json();
+   EXPECT_TRUE(json.starts_with("{\"name\":\"foo\""));
+   // the largest definable is listed first
+   EXPECT_NE(json.find("\"definables\":[{\"label\":\"int large(int a)\""), std::string::npos);
+   EXPECT_NE(json.find("\"if_statement\":{\"constructed\":8,\"copies\":0}"), std::string::npos);
+}
+
+TEST(codegen, size_report) {
+   using namespace mb::codegen;
+
+   component cmp("foo");
+   cmp << function("int", "small", {}, [](statement::collector &col) {
+      col << return_statement(raw("0"));
+   });
+   class_spec cls("bar");
+   cls.add_private("int", "m_value");
+   cls.add_public(method("int", "value", {}, true, [](statement::collector &col) {
+      col << if_statement(raw("m_value > 0"), [](statement::collector &col) {
+         col << return_statement(raw("m_value"));
+      });
+      col << return_statement(raw("0"));
+   }));
+   cls.add_public(method_template("void", "visit", {{"typename", "T"}}, {{"T", "visitor"}}, [](statement::collector &col) {
+      col << call("visitor", raw("m_value"));
+   }));
+   cmp << cls;
+   cmp << template_arguments({{"typename", "T"}}, function("T", "make", {}, [](statement::collector &col) {
+      col << return_statement(raw("T{}"));
+   }));
+
+   auto report = cmp.measure(size_budget{.statements = 2});
+   ASSERT_EQ(report.entries.size(), 7);
+   EXPECT_EQ(report.entries[0].label, "function small");
+   EXPECT_EQ(report.entries[0].header.lines, 1);
+   EXPECT_EQ(report.entries[0].source.statements, 1);
+   EXPECT_EQ(report.entries[1].label, "class bar");
+   EXPECT_EQ(report.entries[2].label, "attribute m_value");
+   EXPECT_EQ(report.entries[2].depth, 1);
+   EXPECT_EQ(report.entries[3].label, "method bar::value");
+   EXPECT_EQ(report.entries[3].source.statements, 3);
+   EXPECT_EQ(report.entries[4].label, "method_template visit");
+   EXPECT_EQ(report.entries[4].header.templates, 1);
+   EXPECT_EQ(report.entries[4].header.statements, 1);
+   EXPECT_EQ(report.entries[1].total().statements, 4);
+   EXPECT_EQ(report.entries[5].label, "template function make");
+   EXPECT_EQ(report.entries[5].header.templates, 1);
+   EXPECT_EQ(report.entries[5].source.bytes, 0);
+   EXPECT_EQ(report.entries[6].depth, 1);
+   EXPECT_EQ(report.entries[6].header.statements, 1);
+
+   // members add up to at most their class, which also has its braces and access labels
+   auto members = report.entries[2].total() + report.entries[3].total() + report.entries[4].total();
+   EXPECT_LT(members.bytes, report.entries[1].total().bytes);
+
+   auto over = report.over_budget();
+   ASSERT_EQ(over.size(), 2);
+   EXPECT_EQ(over[0]->label, "class bar");
+   EXPECT_EQ(over[1]->label, "method bar::value");
+
+   // elements account for everything but the includes and the namespace
+   writer header, source, empty_header, empty_source;
+   cmp.write_header(header);
+   cmp.write_source(source);
+   component empty("foo");
+   empty.write_header(empty_header);
+   empty.write_source(empty_source);
+   EXPECT_EQ(report.header.bytes, header.view().size() - empty_header.view().size());
+   EXPECT_EQ(report.source.bytes, source.view().size() - empty_source.view().size());
+
+   EXPECT_NE(report.text().find("!   method bar::value"), std::string::npos);
+
+   // sizes follow the component style
+   writer_style compact_style{.compact = true};
+   cmp.set_style(compact_style);
+   auto compact = cmp.measure();
+   writer compact_header, compact_source, compact_empty_header, compact_empty_source;
+   for (auto *w : {&compact_header, &compact_source, &compact_empty_header, &compact_empty_source}) {
+      w->set_style(compact_style);
+   }
+   cmp.write_header(compact_header);
+   cmp.write_source(compact_source);
+   empty.write_header(compact_empty_header);
+   empty.write_source(compact_empty_source);
+   EXPECT_LT(compact.source.bytes, report.source.bytes);
+   EXPECT_EQ(compact.header.bytes, compact_header.view().size() - compact_empty_header.view().size());
+   EXPECT_EQ(compact.source.bytes, compact_source.view().size() - compact_empty_source.view().size());
+}
+
+TEST(codegen, pretty_printer) {
+   using namespace mb::codegen;
+
+   function fun("int", "compute", {{"int", "first_argument"}, {"int", "second_argument"}}, [](statement::collector &col) {
+      col << call("combine", raw("first_argument"), raw("second_argument"), call("scale", raw("first_argument"), raw("1000")));
+      col << if_statement(binary_operator(raw("first_argument"), ">", raw("second_argument")), [](statement::collector &col) {
+         col << return_statement(raw("first_argument"));
+      });
+      col << return_statement(binary_operator(raw("first_argument_times_two"), "+", raw("second_argument_times_two")));
+   });
+
+   writer plain;
+   fun.write_definition(plain);
+   EXPECT_EQ(plain.view(), R"(int compute(int first_argument, int second_argument) {
+   combine(first_argument, second_argument, scale(first_argument, 1000));
+   if (first_argument > second_argument) {
+      return first_argument;
+   }
+   return first_argument_times_two + second_argument_times_two;
+}
+
+)");
+
+   writer narrow;
+   narrow.set_style(writer_style{.column_limit = 40});
+   fun.write_definition(narrow);
+   EXPECT_EQ(narrow.view(), R"(int compute(int first_argument,
+            int second_argument) {
+   combine(first_argument,
+           second_argument,
+           scale(first_argument, 1000));
+   if (first_argument >
+       second_argument) {
+      return first_argument;
+   }
+   return first_argument_times_two +
+          second_argument_times_two;
+}
+
+)");
+   for (auto line : std::views::split(narrow.view(), '\n')) {
+      EXPECT_LE(std::ranges::distance(line), 40);
+   }
+
+   // the flat tree renders the same layout
+   component cmp("foo");
+   cmp.set_style(writer_style{.column_limit = 40});
+   cmp << fun;
+   writer flat_narrow;
+   flat_narrow.set_style(cmp.style());
+   cmp.lower().write_source(flat_narrow);
+   EXPECT_NE(flat_narrow.view().find(narrow.view()), std::string_view::npos);
+
+   writer allman;
+   allman.set_style(writer_style{.indent_width = 2, .use_tabs = true, .braces = brace_style::allman});
+   if_statement cond(raw("ready"), [](statement::collector &col) {
+      col << call("run");
+   }, [](statement::collector &col) {
+      col << call("wait");
+   });
+   allman.indent_in();
+   cond.write_statement(allman);
+   EXPECT_EQ(allman.view(), "\tif (ready)\n\t{\n\t\trun();\n\t}\n\telse\n\t{\n\t\twait();\n\t}\n");
+}
+
+TEST(codegen, compact_style) {
+   using namespace mb::codegen;
+
+   component cmp("foo", "FOO_H");
+   cmp.header_include("vector");
+   class_spec cls("bar", "BAR_CLASS");
+   cls.add_private("int", "m_value");
+   cls.add_public(method("int", "value", {}, true, [](statement::collector &col) {
+      col << raw("// keeps its own line");
+      col << if_statement(raw("m_value"), [](statement::collector &col) {
+         col << return_statement(raw("m_value"));
+      }, [](statement::collector &col) {
+         col << return_statement(raw("0"));
+      });
+   }));
+   cmp << cls;
+
+   writer header, source;
+   header.set_style(writer_style{.compact = true});
+   source.set_style(writer_style{.compact = true});
+   cmp.write_header(header);
+   cmp.write_source(source);
+   EXPECT_EQ(header.view(), R"(#ifndef FOO_H
+#define FOO_H
+#include <vector>
+namespace foo {
+#ifndef BAR_CLASS
+#define BAR_CLASS
+class bar{
+int m_value{};
+ public:
+int value() const;
+};
+#endif//BAR_CLASS
+}
+#endif//FOO_H
+)");
+   EXPECT_EQ(source.view(), R"(namespace foo {
+int bar::value() const{
+// keeps its own line;
+if (m_value){
+return m_value;
+}else{
+return 0;
+}
+}
+})");
+
+   // the flat tree emits the same text
+   writer flat_header;
+   flat_header.set_style(writer_style{.compact = true});
+   cmp.lower().write_header(flat_header);
+   EXPECT_EQ(flat_header.view(), header.view());
+
+   writer pretty;
+   cmp.write_source(pretty);
+   EXPECT_LT(source.view().size(), pretty.view().size());
+}
+
+TEST(codegen, origins) {
+   using namespace mb::codegen;
+
+   component cmp("foo");
+   cmp << located_definable(source_origin{"schema/foo.proto", 12}, function("void", "handle", {}, [](statement::collector &col) {
+                               col << call("prepare");
+                               col << located_statement(source_origin{"schema/foo.proto", 14}, return_statement(raw("send()")));
+                            }));
+   cmp << function("void", "plain", {}, [](statement::collector &col) {
+      col << call("run");
+   });
+
+   writer lines;
+   lines.set_style(writer_style{.origins = origin_mode::line_directives});
+   lines.set_output_name("gen/foo.cpp");
+   cmp.write_source(lines);
+   EXPECT_EQ(lines.view(), R"(
+namespace foo {
+
+#line 12 "schema/foo.proto"
+void handle() {
+   prepare();
+#line 14 "schema/foo.proto"
+   return send();
+#line 12 "schema/foo.proto"
+}
+
+#line 13 "gen/foo.cpp"
+void plain() {
+   run();
+}
+
+})");
+
+   writer mapped;
+   mapped.set_style(writer_style{.origins = origin_mode::source_map});
+   cmp.write_source(mapped);
+   const auto &map = mapped.mapping();
+   ASSERT_EQ(map.files().size(), 1);
+   EXPECT_EQ(map.text(), "file schema/foo.proto\n4:0 0:12\n6:0 0:14\n7:0 0:12\n9:0 -\n");
+   EXPECT_EQ(map.find(5, 3), (source_origin{"schema/foo.proto", 12}));
+   EXPECT_EQ(map.find(6, 10), (source_origin{"schema/foo.proto", 14}));
+   EXPECT_TRUE(map.find(9, 0).empty());
+   EXPECT_TRUE(map.find(1, 0).empty());
+
+   // entries set within a layout group are placed where the line is broken
+   component grouped("foo");
+   grouped << function("void", "subscribe", {}, [](statement::collector &col) {
+      col << call("register_handler", raw("first_argument_name"), lambda({{"int", "x"}}, [](statement::collector &col) {
+                     col << located_statement(source_origin{"schema/foo.proto", 20}, expr(call("inner_call", raw("x"))));
+                  }));
+   });
+   writer laid_out;
+   laid_out.set_style(writer_style{.column_limit = 50, .origins = origin_mode::source_map});
+   grouped.write_source(laid_out);
+   EXPECT_EQ(laid_out.view(), R"(
+namespace foo {
+
+void subscribe() {
+   register_handler(first_argument_name,
+                    [](int x) {
+      inner_call(x);
+   });
+}
+
+})");
+   EXPECT_EQ(laid_out.mapping().text(), "file schema/foo.proto\n7:0 0:20\n8:0 -\n");
+   EXPECT_EQ(laid_out.mapping().find(7, 6), (source_origin{"schema/foo.proto", 20}));
+   EXPECT_TRUE(laid_out.mapping().find(6, 0).empty());
+
+   // the flat tree emits the same origins
+   writer flat_lines;
+   flat_lines.set_style(lines.style());
+   flat_lines.set_output_name("gen/foo.cpp");
+   cmp.lower().write_source(flat_lines);
+   EXPECT_EQ(flat_lines.view(), lines.view());
+
+   // the position is kept across flushes
+   std::string output;
+   callback_sink sink([&output](std::string_view data) { output.append(data); });
+   writer w(sink);
+   w.write("ab\ncd");
+   w.flush();
+   w.write("ef");
+   EXPECT_EQ(w.position().line, 2);
+   EXPECT_EQ(w.position().column, 4);
+}
+
+TEST(codegen, origins_without_output_name) {
+   using namespace mb::codegen;
+
+   writer w;
+   w.set_style(writer_style{.origins = origin_mode::line_directives});
+   w.set_origin(source_origin{"schema/foo.proto", 3});
+   w.line("int a;");
+   w.set_origin(source_origin{});
+   w.line("int b;");
+   EXPECT_EQ(w.view(), R"(#line 3 "schema/foo.proto"
+int a;
+#line 4 "<generated>"
+int b;
+)");
+}